@@ -0,0 +1,280 @@
+#include "coast.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "common.hpp"
+#include "earth.hpp"
+#include "profile.hpp"
+
+/* longest step of the difference from the reference orbit */
+static const double ENCKE_STEP = 60.0;
+/* rectify once the difference is this fraction of the radius */
+static const double ENCKE_RECTIFY = 1e-5;
+
+static double dot(const double a[3], const double b[3]){
+  return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/* the stumpff functions c2 and c3, on series near zero where the closed forms
+ * cancel
+ */
+static void stumpff(double z, double *C, double *S){
+  if(z > 0.01){
+    const double s = sqrt(z);
+    *C = (1.0 - cos(s))/z;
+    *S = (s - sin(s))/(s*z);
+  }else if(z < -0.01){
+    const double s = sqrt(-z);
+    *C = (cosh(s) - 1.0)/-z;
+    *S = (sinh(s) - s)/(s*-z);
+  }else{
+    *C = 1.0/2 - z*(1.0/24 - z*(1.0/720 - z*(1.0/40320 - z/3628800)));
+    *S = 1.0/6 - z*(1.0/120 - z*(1.0/5040 - z*(1.0/362880 - z/39916800)));
+  }
+}
+
+/* how far the time of flight at chi is from t, times sqrt(mu) */
+static double timeOfFlightError(double chi, double alpha, double r0n, double sigma0, double sqrt_mu, double t){
+  double C, S;
+  const double chi2 = chi*chi;
+  stumpff(alpha*chi2,&C,&S);
+  return sigma0*chi2*C + (1.0 - alpha*r0n)*chi2*chi*S + r0n*chi - sqrt_mu*t;
+}
+
+/* keplerPropagate, starting the root find from *chi unless it is nan and
+ * leaving the root there, consecutive times of a coast then take one or two
+ * iterations each
+ */
+static bool keplerFrom(const double r0[3], const double v0[3], double mu, double t, double r[3], double v[3], double *guess){
+  const double sqrt_mu = sqrt(mu);
+  const double r0n = sqrt(dot(r0,r0));
+  const double rv = dot(r0,v0);
+  const double sigma0 = rv/sqrt_mu;
+  /* the inverse of the semi major axis, positive for an ellipse */
+  const double alpha = 2.0/r0n - dot(v0,v0)/mu;
+
+  /* whole periods of an ellipse change nothing */
+  if(alpha > 0.0){
+    t = fmod(t,2.0*M_PI/(sqrt_mu*alpha*sqrt(alpha)));
+  }
+
+  double chi = sqrt_mu*t/r0n;
+  if(!std::isnan(*guess)){
+    chi = *guess;
+  }else if(alpha > 1e-12){
+    chi = sqrt_mu*alpha*t;
+  }else if(alpha < -1e-12){
+    /* the guess for a hyperbola is for long times, short ones keep the
+     * straight line guess
+     */
+    const double a = 1.0/alpha;
+    const double sign = t < 0.0 ? -1.0 : 1.0;
+    const double guess = sign*sqrt(-a)*log(-2.0*mu*alpha*t/(rv + sign*sqrt(-mu*a)*(1.0 - r0n*alpha)));
+    if(std::isfinite(guess) && guess*sign > 0.0 &&
+        fabs(timeOfFlightError(guess,alpha,r0n,sigma0,sqrt_mu,t)) < fabs(timeOfFlightError(chi,alpha,r0n,sigma0,sqrt_mu,t))){
+      chi = guess;
+    }
+  }
+
+  /* laguerre's method on the time of flight, converges from much further
+   * out than newton's
+   */
+  const double n = 5.0;
+  double C, S;
+  bool converged = false;
+  for(int i = 0; i < 100 && !converged; ++i){
+    const double chi2 = chi*chi;
+    const double z = alpha*chi2;
+    stumpff(z,&C,&S);
+    const double F = sigma0*chi2*C + (1.0 - alpha*r0n)*chi2*chi*S + r0n*chi - sqrt_mu*t;
+    const double dF = chi2*C + sigma0*chi*(1.0 - z*S) + r0n*(1.0 - z*C);
+    const double ddF = sigma0*(1.0 - z*C) + (1.0 - alpha*r0n)*chi*(1.0 - z*S);
+    const double root = sqrt(fabs((n - 1.0)*(n - 1.0)*dF*dF - n*(n - 1.0)*F*ddF));
+    const double delta = n*F/(dF >= 0.0 ? dF + root : dF - root);
+    if(!std::isfinite(delta)){
+      return false;
+    }
+    chi -= delta;
+    converged = fabs(delta) <= 1e-12*std::max(1.0,fabs(chi));
+  }
+  if(!converged){
+    *guess = NAN;
+    return false;
+  }
+  *guess = chi;
+
+  /* lagrange coefficients */
+  const double chi2 = chi*chi;
+  stumpff(alpha*chi2,&C,&S);
+  const double f = 1.0 - chi2/r0n*C;
+  const double g = t - chi2*chi/sqrt_mu*S;
+  for(int i = 0; i < 3; ++i){
+    r[i] = f*r0[i] + g*v0[i];
+  }
+  const double rn = sqrt(dot(r,r));
+  const double fdot = sqrt_mu/(rn*r0n)*(alpha*chi2*chi*S - chi);
+  const double gdot = 1.0 - chi2/rn*C;
+  for(int i = 0; i < 3; ++i){
+    v[i] = fdot*r0[i] + gdot*v0[i];
+  }
+  return std::isfinite(rn) && std::isfinite(fdot);
+}
+
+bool keplerPropagate(const double r0[3], const double v0[3], double mu, double t, double r[3], double v[3]){
+  double chi = NAN;
+  return keplerFrom(r0,v0,mu,t,r,v,&chi);
+}
+
+CoastOrbit::CoastOrbit(const double r[3], const double v[3], double drag_rate):
+  epoch(0.0),
+  previous(0.0),
+  time(0.0),
+  drag_rate(drag_rate),
+  chi(NAN){
+    memcpy(this->epoch_r,r,sizeof(this->epoch_r));
+    memcpy(this->epoch_v,v,sizeof(this->epoch_v));
+    memset(this->previous_dr,0,sizeof(this->previous_dr));
+    memset(this->previous_dv,0,sizeof(this->previous_dv));
+    memset(this->dr,0,sizeof(this->dr));
+    memset(this->dv,0,sizeof(this->dv));
+  }
+
+/* rate of change of the difference d = (dr, dv) from the reference orbit
+ * rho, Battin's f(q) keeps the difference of the two gravities exact even
+ * as dr goes to zero
+ */
+static void enckeDerivative(const double rho[3], const double rhodot[3], const double d[6], double drag_rate, double dd[6]){
+  const double mu = gravitiational_constant*earth.mass;
+  double r[3], v[3], separation[3];
+  for(int i = 0; i < 3; ++i){
+    r[i] = rho[i] + d[i];
+    v[i] = rhodot[i] + d[3+i];
+    separation[i] = d[i] - 2.0*r[i];
+  }
+  const double q = dot(d,separation)/dot(r,r);
+  const double f = -q*(3.0 + 3.0*q + q*q)/(1.0 + pow(1.0 + q,1.5));
+  const double rho_n = sqrt(dot(rho,rho));
+  const double k = mu/(rho_n*rho_n*rho_n);
+  for(int i = 0; i < 3; ++i){
+    dd[i] = d[3+i];
+    dd[3+i] = k*(f*r[i] - d[i]) - drag_rate*v[i];
+  }
+}
+
+bool CoastOrbit::enckeStep(){
+  const double mu = gravitiational_constant*earth.mass;
+  const double h = ENCKE_STEP;
+  double rho[3][3], rhodot[3][3]; /* the reference at the start, middle and end */
+  if(!keplerPropagate(this->epoch_r,this->epoch_v,mu,this->time - this->epoch,rho[0],rhodot[0])){
+    return false;
+  }
+
+  /* move the epoch up before the difference loses precision */
+  if(sqrt(dot(this->dr,this->dr)) > ENCKE_RECTIFY*sqrt(dot(rho[0],rho[0]))){
+    RSIM_PROFILE_COUNT("encke rectifications",1);
+    for(int i = 0; i < 3; ++i){
+      rho[0][i] += this->dr[i];
+      rhodot[0][i] += this->dv[i];
+    }
+    memcpy(this->epoch_r,rho[0],sizeof(this->epoch_r));
+    memcpy(this->epoch_v,rhodot[0],sizeof(this->epoch_v));
+    this->epoch = this->time;
+    this->chi = NAN;
+    memset(this->dr,0,sizeof(this->dr));
+    memset(this->dv,0,sizeof(this->dv));
+  }
+  const double tau = this->time - this->epoch;
+  for(int s = 1; s < 3; ++s){
+    if(!keplerPropagate(this->epoch_r,this->epoch_v,mu,tau + 0.5*h*s,rho[s],rhodot[s])){
+      return false;
+    }
+  }
+
+  double d[6], tmp[6], k1[6], k2[6], k3[6], k4[6];
+  memcpy(d,this->dr,sizeof(this->dr));
+  memcpy(&d[3],this->dv,sizeof(this->dv));
+  enckeDerivative(rho[0],rhodot[0],d,this->drag_rate,k1);
+  for(int i = 0; i < 6; ++i){
+    tmp[i] = d[i] + 0.5*h*k1[i];
+  }
+  enckeDerivative(rho[1],rhodot[1],tmp,this->drag_rate,k2);
+  for(int i = 0; i < 6; ++i){
+    tmp[i] = d[i] + 0.5*h*k2[i];
+  }
+  enckeDerivative(rho[1],rhodot[1],tmp,this->drag_rate,k3);
+  for(int i = 0; i < 6; ++i){
+    tmp[i] = d[i] + h*k3[i];
+  }
+  enckeDerivative(rho[2],rhodot[2],tmp,this->drag_rate,k4);
+
+  memcpy(this->previous_dr,this->dr,sizeof(this->dr));
+  memcpy(this->previous_dv,this->dv,sizeof(this->dv));
+  this->previous = this->time;
+  for(int i = 0; i < 3; ++i){
+    this->dr[i] += h/6.0*(k1[i] + 2.0*k2[i] + 2.0*k3[i] + k4[i]);
+    this->dv[i] += h/6.0*(k1[3+i] + 2.0*k2[3+i] + 2.0*k3[3+i] + k4[3+i]);
+  }
+  this->time += h;
+  return true;
+}
+
+bool CoastOrbit::advance(double t, double r[3], double v[3]){
+  RSIM_PROFILE_SCOPE("CoastOrbit::advance");
+  const double mu = gravitiational_constant*earth.mass;
+  double d[3], dd[3];
+  if(this->drag_rate != 0.0){
+    /* whole steps past t, then back to it on the cubic through both ends */
+    while(this->time < t){
+      if(!this->enckeStep()){
+        return false;
+      }
+    }
+    const double h = this->time - this->previous;
+    const double s = h > 0.0 ? (t - this->previous)/h : 1.0;
+    const double s2 = s*s, s3 = s2*s;
+    const double h00 = 2.0*s3 - 3.0*s2 + 1.0, h10 = s3 - 2.0*s2 + s;
+    const double h01 = -2.0*s3 + 3.0*s2, h11 = s3 - s2;
+    const double g00 = 6.0*s2 - 6.0*s, g10 = 3.0*s2 - 4.0*s + 1.0;
+    const double g01 = -6.0*s2 + 6.0*s, g11 = 3.0*s2 - 2.0*s;
+    for(int i = 0; i < 3; ++i){
+      d[i] = h00*this->previous_dr[i] + h10*h*this->previous_dv[i] + h01*this->dr[i] + h11*h*this->dv[i];
+      dd[i] = h > 0.0 ? (g00*this->previous_dr[i] + g01*this->dr[i])/h + g10*this->previous_dv[i] + g11*this->dv[i] : this->dv[i];
+    }
+  }else{
+    memset(d,0,sizeof(d));
+    memset(dd,0,sizeof(dd));
+  }
+
+  if(!keplerFrom(this->epoch_r,this->epoch_v,mu,t - this->epoch,r,v,&this->chi)){
+    return false;
+  }
+  for(int i = 0; i < 3; ++i){
+    r[i] += d[i];
+    v[i] += dd[i];
+  }
+  return true;
+}
+
+void coastRotation(const double R0[9], const double w[3], double t, double R[9]){
+  const double rate = sqrt(dot(w,w));
+  if(!(rate > 0.0)){
+    memcpy(R,R0,9*sizeof(double));
+    return;
+  }
+  /* rodrigues' formula for the turn about w */
+  const double angle = rate*t;
+  const double k[3] = {w[0]/rate, w[1]/rate, w[2]/rate};
+  const double s = sin(angle);
+  const double c = 1.0 - cos(angle);
+  const double turn[9] = {
+    1.0 - c*(k[1]*k[1] + k[2]*k[2]), -s*k[2] + c*k[0]*k[1], s*k[1] + c*k[0]*k[2],
+    s*k[2] + c*k[0]*k[1], 1.0 - c*(k[0]*k[0] + k[2]*k[2]), -s*k[0] + c*k[1]*k[2],
+    -s*k[1] + c*k[0]*k[2], s*k[0] + c*k[1]*k[2], 1.0 - c*(k[0]*k[0] + k[1]*k[1])};
+  for(int i = 0; i < 3; ++i){
+    for(int j = 0; j < 3; ++j){
+      R[i*3+j] = turn[i*3+0]*R0[0*3+j] + turn[i*3+1]*R0[1*3+j] + turn[i*3+2]*R0[2*3+j];
+    }
+  }
+}
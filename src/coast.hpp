@@ -0,0 +1,66 @@
+#ifndef RSIM_COAST_HPP
+#define RSIM_COAST_HPP
+/* the payload's flight once its engines stop, without stepping through it
+ *
+ * With no thrust the only forces left are the earth's gravity and the linear
+ * drag. Gravity alone is a Kepler orbit. It is solved in closed form with the
+ * universal variable, which covers elliptic, parabolic and hyperbolic orbits
+ * alike. So the state at any time comes from one root find, however far away
+ * that time is.
+ *
+ * With drag, Encke's method integrates only the difference between the true
+ * orbit and the Kepler orbit of some epoch. That difference is small and
+ * smooth, so it takes steps of a minute instead of a hundredth of a second.
+ * Times between the steps take the reference orbit there plus the difference
+ * interpolated from the step's ends. The epoch is moved up to the true state
+ * (rectified) at the start of a step once the difference has grown past a set
+ * fraction of the radius.
+ */
+
+enum coast_mode_t{
+  COAST_INTEGRATE, /* the general integrator, as during a burn */
+  COAST_KEPLER, /* gravity only, drag ignored */
+  COAST_ENCKE /* gravity and drag, Kepler alone while the drag is zero */
+};
+
+/* r and v after t seconds of two body motion from r0 and v0, relative to the
+ * body of gravitational parameter mu, false if the root find failed
+ */
+bool keplerPropagate(const double r0[3], const double v0[3], double mu, double t, double r[3], double v[3]);
+
+/* one coast from where the engines stopped */
+class CoastOrbit{
+public:
+  /* r and v relative to the earth's centre, drag_rate is the drag over the
+   * mass in 1/s
+   */
+  CoastOrbit(const double r[3], const double v[3], double drag_rate);
+
+  /* the state t seconds after the start, t never less than the last time
+   * asked for, false if the orbit could not be solved
+   */
+  bool advance(double t, double r[3], double v[3]);
+
+private:
+  double epoch_r[3]; /* the reference orbit at its epoch */
+  double epoch_v[3];
+  double epoch; /* seconds after the start */
+  /* true minus reference orbit at the ends of the last step, times between
+   * them are interpolated
+   */
+  double previous_dr[3];
+  double previous_dv[3];
+  double previous;
+  double dr[3];
+  double dv[3];
+  double time;
+  double drag_rate;
+  double chi; /* universal variable of the last query, where the next starts */
+
+  bool enckeStep();
+};
+
+/* R after t seconds of turning at a constant angular velocity w */
+void coastRotation(const double R0[9], const double w[3], double t, double R[9]);
+
+#endif
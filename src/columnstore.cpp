@@ -0,0 +1,517 @@
+#include "columnstore.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rocket.hpp"
+
+/* file layout: header, compressed blocks in the order they were finished,
+ * the run index and a trailer pointing back at the index
+ */
+struct ColumnStoreHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t column_count;
+  uint32_t block_rows;
+  uint32_t reserved;
+};
+
+struct ColumnStoreTrailer{
+  uint64_t index_offset;
+  char magic[8];
+};
+
+static const char COLUMNSTORE_MAGIC[8] = {'R','S','I','M','C','O','L','\0'};
+static const char COLUMNSTORE_INDEX_MAGIC[8] = {'R','S','I','M','I','D','X','\0'};
+static const uint32_t COLUMNSTORE_VERSION = 1;
+
+static const char *const column_names[COLUMN_COUNT] = {
+  "time",
+  "sx", "sy", "sz",
+  "r00", "r01", "r02",
+  "r10", "r11", "r12",
+  "r20", "r21", "r22",
+  "px", "py", "pz",
+  "lx", "ly", "lz",
+  "mass",
+  "stage"
+};
+
+const char *columnName(unsigned int column){
+  if(column >= COLUMN_COUNT){
+    return "unknown";
+  }
+  return column_names[column];
+}
+
+unsigned int columnByName(const char *name){
+  for(unsigned int i = 0; i < COLUMN_COUNT; ++i){
+    if(strcmp(name,column_names[i]) == 0){
+      return i;
+    }
+  }
+  return COLUMN_COUNT;
+}
+
+static bool writeFully(int fd, const void *data, size_t size, uint64_t offset){
+  const char *bytes = (const char *) data;
+  while(size > 0){
+    const ssize_t written = pwrite(fd,bytes,size,offset);
+    if(written <= 0){
+      return false;
+    }
+    bytes += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+/* bits are packed most significant first */
+class BitWriter{
+public:
+  BitWriter(std::vector<uint8_t> &out):
+    out(out),
+    used(0){}
+
+  void write(uint64_t value, unsigned int bits){
+    while(bits > 0){
+      if(used == 0){
+        out.push_back(0);
+      }
+      const unsigned int space = 8 - used;
+      const unsigned int take = bits < space ? bits : space;
+      const uint8_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+      out.back() |= chunk << (space - take);
+      used = (used + take) & 7;
+      bits -= take;
+    }
+  }
+
+private:
+  std::vector<uint8_t> &out;
+  unsigned int used; /* bits used in the last byte */
+};
+
+/* reads past the end give zeros and mark the reader as overrun */
+class BitReader{
+public:
+  BitReader(const uint8_t *data, size_t size):
+    data(data),
+    position(0),
+    limit(8*(uint64_t)size){}
+
+  uint64_t read(unsigned int bits){
+    uint64_t value = 0;
+    if(position + bits > limit){
+      position = limit + 1;
+      return 0;
+    }
+    while(bits > 0){
+      const unsigned int available = 8 - (position & 7);
+      const unsigned int take = bits < available ? bits : available;
+      const uint8_t byte = data[position >> 3];
+      value = (value << take) | ((byte >> (available - take)) & ((1u << take) - 1));
+      position += take;
+      bits -= take;
+    }
+    return value;
+  }
+
+  bool overrun() const{
+    return position > limit;
+  }
+
+private:
+  const uint8_t *data;
+  uint64_t position;
+  uint64_t limit; /* bits */
+};
+
+static uint64_t doubleBits(double value){
+  uint64_t bits;
+  memcpy(&bits,&value,sizeof(bits));
+  return bits;
+}
+
+static double bitsDouble(uint64_t bits){
+  double value;
+  memcpy(&value,&bits,sizeof(value));
+  return value;
+}
+
+/* predict a sample from the two before it, a straight line through them */
+static double predict(const double *previous, size_t i){
+  if(i == 1){
+    return previous[0];
+  }
+  return 2.0*previous[1] - previous[0];
+}
+
+/* XOR against the prediction, then per sample:
+ *   0                    exact prediction
+ *   10 <bits>            meaningful bits fit the previous leading/trailing window
+ *   11 <6 lead> <6 len-1> <bits>   new window
+ */
+static void encodeColumn(const double *values, size_t count, std::vector<uint8_t> &out){
+  out.clear();
+  if(count == 0){
+    return;
+  }
+  BitWriter writer(out);
+  writer.write(doubleBits(values[0]),64);
+  unsigned int window_lead = 65;
+  unsigned int window_trail = 0;
+  for(size_t i = 1; i < count; ++i){
+    const double prediction = predict(&values[i < 2 ? 0 : i-2],i);
+    const uint64_t x = doubleBits(values[i]) ^ doubleBits(prediction);
+    if(x == 0){
+      writer.write(0,1);
+      continue;
+    }
+    unsigned int lead = __builtin_clzll(x);
+    const unsigned int trail = __builtin_ctzll(x);
+    if(lead > 63){
+      lead = 63;
+    }
+    if(window_lead <= lead && window_trail <= trail){
+      writer.write(2,2);
+      writer.write(x >> window_trail,64 - window_lead - window_trail);
+    }else{
+      const unsigned int meaningful = 64 - lead - trail;
+      writer.write(3,2);
+      writer.write(lead,6);
+      writer.write(meaningful - 1,6);
+      writer.write(x >> trail,meaningful);
+      window_lead = lead;
+      window_trail = trail;
+    }
+  }
+}
+
+/* false if the block's bytes run out before count samples are decoded, out
+ * is then left as it was
+ */
+static bool decodeColumn(const uint8_t *data, size_t size, size_t count, std::vector<double> &out){
+  if(count == 0){
+    return true;
+  }
+  /* the first sample takes 64 bits and every other at least one */
+  if(size < 8 || count - 1 > 8*(uint64_t)(size - 8)){
+    return false;
+  }
+  const size_t first = out.size();
+  out.resize(first + count);
+  double *values = &out[first];
+  BitReader reader(data,size);
+  values[0] = bitsDouble(reader.read(64));
+  unsigned int window_lead = 0;
+  unsigned int window_trail = 0;
+  for(size_t i = 1; i < count; ++i){
+    const double prediction = predict(&values[i < 2 ? 0 : i-2],i);
+    uint64_t x = 0;
+    if(reader.read(1) != 0){
+      if(reader.read(1) != 0){
+        window_lead = reader.read(6);
+        const unsigned int meaningful = reader.read(6) + 1;
+        window_trail = 64 - window_lead - meaningful;
+      }
+      x = reader.read(64 - window_lead - window_trail) << window_trail;
+    }
+    values[i] = bitsDouble(doubleBits(prediction) ^ x);
+  }
+  if(reader.overrun()){
+    out.resize(first);
+    return false;
+  }
+  return true;
+}
+
+ColumnStoreWriter::ColumnStoreWriter(const char *filename, uint32_t block_rows):
+  fd(open(filename,O_WRONLY | O_CREAT | O_TRUNC,0644)),
+  block_rows(block_rows > 0 ? block_rows : 1),
+  end(sizeof(ColumnStoreHeader)){
+    if(this->fd < 0){
+      std::cerr << "Error opening column store for writing: " << filename << std::endl;
+      return;
+    }
+    ColumnStoreHeader header;
+    memcpy(header.magic,COLUMNSTORE_MAGIC,sizeof(header.magic));
+    header.version = COLUMNSTORE_VERSION;
+    header.column_count = COLUMN_COUNT;
+    header.block_rows = this->block_rows;
+    header.reserved = 0;
+    writeFully(this->fd,&header,sizeof(header),0);
+  }
+
+ColumnStoreWriter::~ColumnStoreWriter(){
+  this->close();
+}
+
+bool ColumnStoreWriter::isOpen() const {
+  return this->fd >= 0;
+}
+
+uint32_t ColumnStoreWriter::blockRows() const {
+  return this->block_rows;
+}
+
+uint64_t ColumnStoreWriter::dataBytes() const {
+  return this->end.load() - sizeof(ColumnStoreHeader);
+}
+
+uint64_t ColumnStoreWriter::appendBlock(const std::vector<uint8_t> &data){
+  const uint64_t offset = this->end.fetch_add(data.size());
+  if(this->fd >= 0 && !data.empty() && !writeFully(this->fd,&data[0],data.size(),offset)){
+    std::cerr << "Error writing column store block" << std::endl;
+  }
+  return offset;
+}
+
+void ColumnStoreWriter::commitRun(RunIndex &index){
+  std::lock_guard<std::mutex> lock(this->index_mutex);
+  this->runs.push_back(RunIndex());
+  this->runs.back().run_id = index.run_id;
+  this->runs.back().samples = index.samples;
+  this->runs.back().blocks.swap(index.blocks);
+}
+
+static bool compare_run_id(const RunIndex &a, const RunIndex &b){
+  return a.run_id < b.run_id;
+}
+
+void ColumnStoreWriter::close(){
+  if(this->fd < 0){
+    return;
+  }
+  std::lock_guard<std::mutex> lock(this->index_mutex);
+  std::sort(this->runs.begin(),this->runs.end(),compare_run_id);
+
+  /* run count, then per run: id, samples, block count and its blocks */
+  std::vector<uint8_t> index;
+  const uint64_t run_count = this->runs.size();
+  index.insert(index.end(),(const uint8_t *) &run_count,(const uint8_t *) &run_count + sizeof(run_count));
+  for(size_t i = 0; i < this->runs.size(); ++i){
+    const RunIndex &run = this->runs[i];
+    const uint64_t fields[3] = {run.run_id,run.samples,run.blocks.size()/COLUMN_COUNT};
+    index.insert(index.end(),(const uint8_t *) fields,(const uint8_t *) fields + sizeof(fields));
+    if(!run.blocks.empty()){
+      const uint8_t *blocks = (const uint8_t *) &run.blocks[0];
+      index.insert(index.end(),blocks,blocks + run.blocks.size()*sizeof(ColumnBlock));
+    }
+  }
+
+  ColumnStoreTrailer trailer;
+  trailer.index_offset = this->end.load();
+  memcpy(trailer.magic,COLUMNSTORE_INDEX_MAGIC,sizeof(trailer.magic));
+  writeFully(this->fd,&index[0],index.size(),trailer.index_offset);
+  writeFully(this->fd,&trailer,sizeof(trailer),trailer.index_offset + index.size());
+
+  ::close(this->fd);
+  this->fd = -1;
+}
+
+RunWriter::RunWriter(ColumnStoreWriter &store, uint64_t run_id):
+  store(store),
+  finished(false){
+    this->index.run_id = run_id;
+    this->index.samples = 0;
+    for(unsigned int i = 0; i < COLUMN_COUNT; ++i){
+      this->columns[i].reserve(store.blockRows());
+    }
+  }
+
+RunWriter::~RunWriter(){
+  this->finish();
+}
+
+void RunWriter::append(double time, const double state[], unsigned int stage){
+  this->columns[COLUMN_TIME].push_back(time);
+  /* position, rotation and both momenta are laid out as in the state */
+  for(unsigned int i = 0; i < 18; ++i){
+    this->columns[COLUMN_SX+i].push_back(state[i]);
+  }
+  this->columns[COLUMN_MASS].push_back(state[19]);
+  this->columns[COLUMN_STAGE].push_back(stage);
+  if(this->columns[COLUMN_TIME].size() >= this->store.blockRows()){
+    this->flushBlock();
+  }
+}
+
+void RunWriter::append(Rocket &rocket){
+  this->append(rocket.getTime(),rocket.getState()->data,rocket.getStageProgress());
+}
+
+void RunWriter::flushBlock(){
+  const size_t count = this->columns[COLUMN_TIME].size();
+  if(count == 0){
+    return;
+  }
+  for(unsigned int i = 0; i < COLUMN_COUNT; ++i){
+    encodeColumn(&this->columns[i][0],count,this->scratch);
+    ColumnBlock block;
+    block.offset = this->store.appendBlock(this->scratch);
+    block.bytes = this->scratch.size();
+    block.samples = count;
+    this->index.blocks.push_back(block);
+    this->columns[i].clear();
+  }
+  this->index.samples += count;
+}
+
+void RunWriter::finish(){
+  if(this->finished){
+    return;
+  }
+  this->flushBlock();
+  this->store.commitRun(this->index);
+  this->finished = true;
+}
+
+ColumnStore::ColumnStore(const char *filename):
+  mapping(NULL),
+  mapping_size(0),
+  block_rows(0){
+    const int fd = open(filename,O_RDONLY);
+    if(fd < 0){
+      std::cerr << "Error opening column store: " << filename << std::endl;
+      return;
+    }
+
+    struct stat info;
+    if(fstat(fd,&info) != 0 || (size_t)info.st_size < sizeof(ColumnStoreHeader) + sizeof(ColumnStoreTrailer)){
+      std::cerr << "Column store is too small: " << filename << std::endl;
+      ::close(fd);
+      return;
+    }
+
+    void *data = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if(data == MAP_FAILED){
+      std::cerr << "Error mapping column store: " << filename << std::endl;
+      return;
+    }
+    this->mapping = data;
+    this->mapping_size = info.st_size;
+
+    const uint8_t *bytes = (const uint8_t *) data;
+    const ColumnStoreHeader *header = (const ColumnStoreHeader *) bytes;
+    ColumnStoreTrailer trailer;
+    memcpy(&trailer,bytes + info.st_size - sizeof(trailer),sizeof(trailer));
+    if(memcmp(header->magic,COLUMNSTORE_MAGIC,sizeof(header->magic)) != 0
+        || header->version != COLUMNSTORE_VERSION
+        || header->column_count != COLUMN_COUNT
+        || memcmp(trailer.magic,COLUMNSTORE_INDEX_MAGIC,sizeof(trailer.magic)) != 0
+        || trailer.index_offset > info.st_size - sizeof(trailer)){
+      /* a writer that never closed leaves no index */
+      std::cerr << "Not a finished column store or wrong version: " << filename << std::endl;
+      return;
+    }
+    this->block_rows = header->block_rows;
+
+    /* the counts come from the file, so they are checked against the bytes
+     * left rather than used to move a pointer that could overflow
+     */
+    const uint8_t *position = bytes + trailer.index_offset;
+    const uint8_t *index_end = bytes + info.st_size - sizeof(trailer);
+    uint64_t run_count = 0;
+    if((size_t)(index_end - position) >= sizeof(run_count)){
+      memcpy(&run_count,position,sizeof(run_count));
+      position += sizeof(run_count);
+    }
+    for(uint64_t i = 0; i < run_count; ++i){
+      uint64_t fields[3];
+      if((size_t)(index_end - position) < sizeof(fields)){
+        break;
+      }
+      memcpy(fields,position,sizeof(fields));
+      position += sizeof(fields);
+      if(fields[2] > (size_t)(index_end - position)/(COLUMN_COUNT*sizeof(ColumnBlock))){
+        break;
+      }
+      const size_t block_count = fields[2]*COLUMN_COUNT;
+      RunIndex run;
+      run.run_id = fields[0];
+      run.samples = fields[1];
+      run.blocks.resize(block_count);
+      if(block_count > 0){
+        memcpy(&run.blocks[0],position,block_count*sizeof(ColumnBlock));
+      }
+      position += block_count*sizeof(ColumnBlock);
+      this->runs.push_back(RunIndex());
+      this->runs.back().run_id = run.run_id;
+      this->runs.back().samples = run.samples;
+      this->runs.back().blocks.swap(run.blocks);
+    }
+    if(this->runs.size() != run_count){
+      std::cerr << "Column store index is truncated: " << filename << std::endl;
+    }
+  }
+
+ColumnStore::~ColumnStore(){
+  if(this->mapping != NULL){
+    munmap(this->mapping,this->mapping_size);
+  }
+}
+
+bool ColumnStore::isOpen() const {
+  return this->block_rows > 0;
+}
+
+size_t ColumnStore::runCount() const {
+  return this->runs.size();
+}
+
+const RunIndex &ColumnStore::run(size_t i) const {
+  return this->runs[i];
+}
+
+bool ColumnStore::readColumn(size_t run, unsigned int column, std::vector<double> &out) const {
+  out.clear();
+  if(run >= this->runs.size() || column >= COLUMN_COUNT){
+    return false;
+  }
+  const RunIndex &index = this->runs[run];
+  if(index.samples > (uint64_t)(index.blocks.size()/COLUMN_COUNT)*this->block_rows){
+    std::cerr << "Column store run " << index.run_id << " claims more samples than its blocks hold" << std::endl;
+    return false;
+  }
+  out.reserve(index.samples);
+  const uint8_t *bytes = (const uint8_t *) this->mapping;
+  for(size_t b = column; b < index.blocks.size(); b += COLUMN_COUNT){
+    const ColumnBlock &block = index.blocks[b];
+    if(block.offset > this->mapping_size || block.bytes > this->mapping_size - block.offset
+        || block.samples > this->block_rows || out.size() + block.samples > index.samples
+        || !decodeColumn(bytes + block.offset,block.bytes,block.samples,out)){
+      std::cerr << "Column store block " << b << " of run " << index.run_id << " is corrupt" << std::endl;
+      out.clear();
+      return false;
+    }
+  }
+  if(out.size() != index.samples){
+    std::cerr << "Column store run " << index.run_id << " is missing samples" << std::endl;
+    out.clear();
+    return false;
+  }
+  return true;
+}
+
+bool ColumnStore::readColumn(unsigned int column, std::vector<double> &out, std::vector<size_t> &run_start) const {
+  out.clear();
+  run_start.clear();
+  std::vector<double> values;
+  bool complete = true;
+  for(size_t i = 0; i < this->runs.size(); ++i){
+    run_start.push_back(out.size());
+    complete = this->readColumn(i,column,values) && complete;
+    out.insert(out.end(),values.begin(),values.end());
+  }
+  run_start.push_back(out.size());
+  return complete;
+}
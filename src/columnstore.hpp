@@ -0,0 +1,154 @@
+#ifndef RSIM_COLUMNSTORE_HPP
+#define RSIM_COLUMNSTORE_HPP
+/* columnar, compressed storage for the full state of many flights
+ *
+ * Every run is cut into blocks of up to block_rows samples and each column of
+ * a block is compressed on its own: a value is predicted from the two before
+ * it (constant rate of change), the prediction is XORed with the real bits
+ * and the XOR is packed by its leading and trailing zeros. Smooth columns such
+ * as time, position and mass shrink to a few bits per sample, and the
+ * encoding is lossless.
+ *
+ * Blocks go to the file as soon as they fill, in whatever order the writing
+ * threads finish them. A footer written on close indexes every run's blocks
+ * by column, so a reader can pull one column out of every run without
+ * touching the others.
+ */
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+class Rocket;
+
+enum column_t{
+  COLUMN_TIME,
+  COLUMN_SX, COLUMN_SY, COLUMN_SZ,
+  COLUMN_R00, COLUMN_R01, COLUMN_R02,
+  COLUMN_R10, COLUMN_R11, COLUMN_R12,
+  COLUMN_R20, COLUMN_R21, COLUMN_R22,
+  COLUMN_PX, COLUMN_PY, COLUMN_PZ,
+  COLUMN_LX, COLUMN_LY, COLUMN_LZ,
+  COLUMN_MASS,
+  COLUMN_STAGE,
+  COLUMN_COUNT
+};
+
+const char *columnName(unsigned int column);
+
+/* the column with a name, or COLUMN_COUNT if there is none */
+unsigned int columnByName(const char *name);
+
+/* where one column of one block of a run lives in the file */
+struct ColumnBlock{
+  uint64_t offset;
+  uint32_t bytes;
+  uint32_t samples;
+};
+
+/* the blocks of one run, block major: blocks[b*COLUMN_COUNT + column] */
+struct RunIndex{
+  uint64_t run_id;
+  uint64_t samples;
+  std::vector<ColumnBlock> blocks;
+};
+
+/* the file that any number of RunWriters stream into at once */
+class ColumnStoreWriter{
+public:
+  ColumnStoreWriter(const char *filename, uint32_t block_rows=4096);
+  ~ColumnStoreWriter();
+
+  bool isOpen() const;
+
+  /* write the run index and close the file, called by the destructor */
+  void close();
+
+  uint32_t blockRows() const;
+
+  /* bytes of compressed blocks written so far */
+  uint64_t dataBytes() const;
+
+private:
+  friend class RunWriter;
+
+  int fd;
+  uint32_t block_rows;
+  std::atomic<uint64_t> end; /* next free offset, blocks claim space here */
+  std::mutex index_mutex;
+  std::vector<RunIndex> runs;
+
+  /* claim space and write a block, safe to call from any thread */
+  uint64_t appendBlock(const std::vector<uint8_t> &data);
+
+  void commitRun(RunIndex &index);
+
+  ColumnStoreWriter(const ColumnStoreWriter&);
+  ColumnStoreWriter &operator=(const ColumnStoreWriter&);
+};
+
+/* one flight's samples, used by a single thread */
+class RunWriter{
+public:
+  RunWriter(ColumnStoreWriter &store, uint64_t run_id);
+  ~RunWriter();
+
+  /* time, the 20 entry rigid body state and the stage */
+  void append(double time, const double state[], unsigned int stage);
+
+  /* record the current state of a rocket */
+  void append(Rocket &rocket);
+
+  /* flush the last partial block and hand the index to the store, called by
+   * the destructor if not before
+   */
+  void finish();
+
+private:
+  ColumnStoreWriter &store;
+  RunIndex index;
+  std::vector<double> columns[COLUMN_COUNT];
+  std::vector<uint8_t> scratch;
+  bool finished;
+
+  void flushBlock();
+
+  RunWriter(const RunWriter&);
+  RunWriter &operator=(const RunWriter&);
+};
+
+/* a store mapped for reading */
+class ColumnStore{
+public:
+  ColumnStore(const char *filename);
+  ~ColumnStore();
+
+  bool isOpen() const;
+
+  size_t runCount() const;
+
+  const RunIndex &run(size_t i) const;
+
+  /* decompress one column of one run, replacing out. False with out empty if
+   * a block's sample count does not fit its bytes or the run's total
+   */
+  bool readColumn(size_t run, unsigned int column, std::vector<double> &out) const;
+
+  /* one column of every run back to back, run_start[i] is where run i begins
+   * and run_start has one extra entry holding the total. A run that fails to
+   * read is left empty and the result is false
+   */
+  bool readColumn(unsigned int column, std::vector<double> &out, std::vector<size_t> &run_start) const;
+
+private:
+  void *mapping;
+  size_t mapping_size;
+  uint32_t block_rows;
+  std::vector<RunIndex> runs;
+
+  ColumnStore(const ColumnStore&);
+  ColumnStore &operator=(const ColumnStore&);
+};
+
+#endif
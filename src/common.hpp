@@ -6,14 +6,6 @@
 
 const double gravitiational_constant = 6.67408e-11;
 
-const double max_ISP = 307.4; /* specific impulse in vacuum of stage 1 engine */
-const double min_ISP = 281.8; /* sealevel */
-const double merlinvac_isp = 348.0; /* stage 2 engine ISP */
-
-/* fuel consumption of stage 1 and 2 */
-const double merlin1d_fuel = -273.6*9;
-const double merlinvac_fuel = -273.6;
-
 /* low earth orbit */
 const double LEO = 2000000;
 
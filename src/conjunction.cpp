@@ -0,0 +1,398 @@
+#include "conjunction.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+#include "common.hpp"
+#include "earth.hpp"
+#include "profile.hpp"
+
+/* the time of closest approach is found to this, s */
+static const double TIME_TOLERANCE = 1e-6;
+static const unsigned int TIME_ITERATIONS = 100;
+
+/* bits of each cell coordinate in a key */
+static const unsigned int CELL_BITS = 21;
+static const uint64_t CELL_MASK = (uint64_t(1) << CELL_BITS) - 1;
+
+ConjunctionOptions::ConjunctionOptions():
+  start(0.0),
+  end(3600.0),
+  step(10.0),
+  threshold(5000.0),
+  threads(std::max(1u,std::thread::hardware_concurrency()))
+  {}
+
+/* every object at one sample, one thread's worth */
+struct SampleStates{
+  std::vector<double> x, y, z, vx, vy, vz;
+  /* how far a pair can be apart at the sample and still come within the
+   * threshold in its window, and how near their straight line motion has to
+   * come for that
+   */
+  double reach;
+  double linear_reach;
+
+  void resize(size_t count){
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    vx.resize(count);
+    vy.resize(count);
+    vz.resize(count);
+  }
+};
+
+/* the window of a sample, the half step either side of it within the span */
+struct SampleWindow{
+  double time;
+  double begin;
+  double end;
+};
+
+static size_t sampleCount(const ConjunctionOptions &options){
+  if(!(options.end > options.start) || !(options.step > 0.0)){
+    return 1;
+  }
+  return (size_t)ceil((options.end - options.start)/options.step - 0.5) + 1;
+}
+
+static SampleWindow sampleWindow(const ConjunctionOptions &options, size_t k){
+  SampleWindow window;
+  window.time = options.start + k*options.step;
+  window.begin = std::max(options.start,window.time - 0.5*options.step);
+  window.end = std::min(options.end,window.time + 0.5*options.step);
+  return window;
+}
+
+static void sampleStates(const Constellation &objects, const ConjunctionOptions &options, const SampleWindow &window,
+    SampleStates *states){
+  objects.statesAt(window.time,&states->x[0],&states->y[0],&states->z[0],&states->vx[0],&states->vy[0],&states->vz[0],1);
+  double fastest = 0.0;
+  double nearest = HUGE_VAL;
+  for(size_t i = 0; i < objects.size(); ++i){
+    fastest = std::max(fastest,states->vx[i]*states->vx[i] + states->vy[i]*states->vy[i] + states->vz[i]*states->vz[i]);
+    nearest = std::min(nearest,states->x[i]*states->x[i] + states->y[i]*states->y[i] + states->z[i]*states->z[i]);
+  }
+  /* gravity is at most this on any object, so a pair's relative velocity
+   * turns by at most twice it
+   */
+  const double gravity = gravitiational_constant*earth.mass/nearest;
+  const double half = 0.5*options.step;
+  const double closing_speed = 2.0*sqrt(fastest) + 2.0*gravity*half;
+  states->reach = options.threshold + closing_speed*half;
+  states->linear_reach = options.threshold + gravity*half*half;
+}
+
+/* one object at a sample, the grid keeps them in order of cell so the
+ * objects compared with each other sit together in memory
+ */
+struct SampleBody{
+  double r[3];
+  double v[3];
+  size_t index;
+};
+
+/* whether b can come within the threshold of a during the window: near
+ * enough at the sample and then on a straight line
+ */
+static bool nearPair(const SampleStates &s, const SampleWindow &window, const SampleBody &a, const SampleBody &b){
+  const double r[3] = {b.r[0] - a.r[0], b.r[1] - a.r[1], b.r[2] - a.r[2]};
+  const double rr = r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+  if(rr > s.reach*s.reach){
+    return false;
+  }
+  const double v[3] = {b.v[0] - a.v[0], b.v[1] - a.v[1], b.v[2] - a.v[2]};
+  const double rv = r[0]*v[0] + r[1]*v[1] + r[2]*v[2];
+  const double vv = v[0]*v[0] + v[1]*v[1] + v[2]*v[2];
+  double tau = vv > 0.0 ? -rv/vv : 0.0;
+  tau = std::min(std::max(tau,window.begin - window.time),window.end - window.time);
+  double d2 = 0.0;
+  for(int k = 0; k < 3; ++k){
+    const double d = r[k] + v[k]*tau;
+    d2 += d*d;
+  }
+  return d2 <= s.linear_reach*s.linear_reach;
+}
+
+/* relative position and velocity of second from first at time, the distance
+ * is at its least where their dot product crosses zero from below
+ */
+static double closing(const Constellation &objects, size_t first, size_t second, double time, double r[3], double v[3]){
+  double ra[3], va[3], rb[3], vb[3];
+  objects.stateOf(first,time,ra,va);
+  objects.stateOf(second,time,rb,vb);
+  for(int k = 0; k < 3; ++k){
+    r[k] = rb[k] - ra[k];
+    v[k] = vb[k] - va[k];
+  }
+  return r[0]*v[0] + r[1]*v[1] + r[2]*v[2];
+}
+
+/* the closest approach of a near pair if it falls in the window and within
+ * the threshold. The window owns a minimum just after its start up to its
+ * end, so one crossing on the boundary is reported once. The span's own ends
+ * report an approach cut off by them.
+ */
+static bool refinePair(const Constellation &objects, const ConjunctionOptions &options, const SampleWindow &window,
+    size_t first, size_t second, Conjunction *out){
+  double r[3], v[3];
+  double a = window.begin, b = window.end;
+  double fa = closing(objects,first,second,a,r,v);
+  double fb = closing(objects,first,second,b,r,v);
+  double time;
+  if(fa >= 0.0){
+    if(window.begin > options.start){
+      return false;
+    }
+    time = a;
+  }else if(fb < 0.0){
+    if(window.end < options.end){
+      return false;
+    }
+    time = b;
+  }else{
+    /* false position, halving the weight of an end that keeps being kept
+     * (illinois) so it does not stall on the curved side
+     */
+    int side = 0;
+    time = b;
+    for(unsigned int iteration = 0; iteration < TIME_ITERATIONS && b - a > TIME_TOLERANCE; ++iteration){
+      time = (a*fb - b*fa)/(fb - fa);
+      const double f = closing(objects,first,second,time,r,v);
+      if(f < 0.0){
+        a = time;
+        fa = f;
+        if(side == -1){
+          fb *= 0.5;
+        }
+        side = -1;
+      }else{
+        b = time;
+        fb = f;
+        if(side == 1){
+          fa *= 0.5;
+        }
+        side = 1;
+      }
+    }
+  }
+  closing(objects,first,second,time,r,v);
+  const double distance = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+  if(!(distance <= options.threshold)){
+    return false;
+  }
+  out->first = first;
+  out->second = second;
+  out->time = time;
+  out->distance = distance;
+  out->speed = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+  return true;
+}
+
+static void checkPair(const Constellation &objects, const ConjunctionOptions &options, const SampleStates &states,
+    const SampleWindow &window, const SampleBody &a, const SampleBody &b, std::vector<Conjunction> &found){
+  if(!nearPair(states,window,a,b)){
+    return;
+  }
+  RSIM_PROFILE_COUNT("conjunction candidates",1);
+  Conjunction conjunction;
+  if(refinePair(objects,options,window,std::min(a.index,b.index),std::max(a.index,b.index),&conjunction)){
+    found.push_back(conjunction);
+  }
+}
+
+/* a cell's key, its coordinates side by side so adding a neighbour's offsets
+ * to the key gives the neighbour's. They are kept clear of the ends of their
+ * bits: an object past them is put in the last cell, which only has it
+ * compared with more objects than it needs.
+ */
+static uint64_t cellKey(double x, double y, double z, double size){
+  const double bias = double(uint64_t(1) << (CELL_BITS - 1));
+  const double last = double(CELL_MASK - 1);
+  const uint64_t cx = (uint64_t)std::min(std::max(floor(x/size) + bias,1.0),last);
+  const uint64_t cy = (uint64_t)std::min(std::max(floor(y/size) + bias,1.0),last);
+  const uint64_t cz = (uint64_t)std::min(std::max(floor(z/size) + bias,1.0),last);
+  return (cx << (2*CELL_BITS)) | (cy << CELL_BITS) | cz;
+}
+
+static int64_t cellOffset(int64_t x, int64_t y, int64_t z){
+  return x*(int64_t(1) << (2*CELL_BITS)) + y*(int64_t(1) << CELL_BITS) + z;
+}
+
+/* the occupied cells of one sample: the objects sorted by cell and the run of
+ * them in each cell. The keys are in order, so the cells next to each cell
+ * are found by walking the runs alongside it rather than looking them up.
+ */
+class SampleGrid{
+public:
+  void build(const SampleStates &states, size_t count){
+    this->objects.resize(count);
+    for(size_t i = 0; i < count; ++i){
+      this->objects[i].key = cellKey(states.x[i],states.y[i],states.z[i],states.reach);
+      this->objects[i].index = i;
+    }
+    std::sort(this->objects.begin(),this->objects.end(),compareCellObject);
+    this->sorted.resize(count);
+    for(size_t k = 0; k < count; ++k){
+      const size_t i = this->objects[k].index;
+      SampleBody &body = this->sorted[k];
+      body.r[0] = states.x[i];
+      body.r[1] = states.y[i];
+      body.r[2] = states.z[i];
+      body.v[0] = states.vx[i];
+      body.v[1] = states.vy[i];
+      body.v[2] = states.vz[i];
+      body.index = i;
+    }
+
+    this->cells.clear();
+    for(size_t i = 0; i < count;){
+      Cell cell = {this->objects[i].key, i, i + 1};
+      while(cell.end < count && this->objects[cell.end].key == cell.key){
+        ++cell.end;
+      }
+      this->cells.push_back(cell);
+      i = cell.end;
+    }
+  }
+
+  /* every object, in order of cell */
+  const std::vector<SampleBody> &bodies() const{
+    return this->sorted;
+  }
+
+  /* every pair in the same or neighbouring cells once */
+  template<typename Visit>
+  void pairs(Visit visit) const{
+    /* half the 26 neighbours, the other half see this cell as theirs: the
+     * cell above and the columns of three in four directions
+     */
+    const int64_t above = cellOffset(0,0,1);
+    static const int COLUMNS = 4;
+    const int64_t columns[COLUMNS] = {cellOffset(0,1,0), cellOffset(1,-1,0), cellOffset(1,0,0), cellOffset(1,1,0)};
+    size_t cursor[COLUMNS] = {0, 0, 0, 0};
+    for(size_t c = 0; c < this->cells.size(); ++c){
+      const Cell &cell = this->cells[c];
+      for(size_t a = cell.begin; a < cell.end; ++a){
+        for(size_t b = a + 1; b < cell.end; ++b){
+          visit(this->sorted[a],this->sorted[b]);
+        }
+      }
+      if(c + 1 < this->cells.size() && this->cells[c + 1].key == cell.key + above){
+        this->visitCells(cell,this->cells[c + 1],visit);
+      }
+      for(int n = 0; n < COLUMNS; ++n){
+        const uint64_t low = cell.key + columns[n] - above;
+        const uint64_t high = cell.key + columns[n] + above;
+        size_t &k = cursor[n];
+        while(k < this->cells.size() && this->cells[k].key < low){
+          ++k;
+        }
+        for(size_t m = k; m < this->cells.size() && this->cells[m].key <= high; ++m){
+          this->visitCells(cell,this->cells[m],visit);
+        }
+      }
+    }
+  }
+
+private:
+  struct CellObject{
+    uint64_t key;
+    size_t index;
+  };
+  struct Cell{
+    uint64_t key;
+    size_t begin; /* run in objects */
+    size_t end;
+  };
+  std::vector<CellObject> objects;
+  std::vector<SampleBody> sorted;
+  std::vector<Cell> cells;
+
+  static bool compareCellObject(const CellObject &a, const CellObject &b){
+    return a.key < b.key;
+  }
+
+  template<typename Visit>
+  void visitCells(const Cell &cell, const Cell &other, Visit &visit) const{
+    for(size_t a = cell.begin; a < cell.end; ++a){
+      for(size_t b = other.begin; b < other.end; ++b){
+        visit(this->sorted[a],this->sorted[b]);
+      }
+    }
+  }
+};
+
+static bool compareConjunction(const Conjunction &a, const Conjunction &b){
+  if(a.time != b.time){
+    return a.time < b.time;
+  }
+  if(a.first != b.first){
+    return a.first < b.first;
+  }
+  return a.second < b.second;
+}
+
+/* screen every sample on every thread, grid or all pairs */
+static std::vector<Conjunction> screen(const Constellation &objects, const ConjunctionOptions &options, bool all_pairs){
+  const size_t samples = sampleCount(options);
+  const size_t count = objects.size();
+  std::vector<std::vector<Conjunction> > found(std::max(1u,options.threads));
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  const unsigned int thread_count = std::max<size_t>(1,std::min<size_t>(options.threads,samples));
+  for(unsigned int t = 0; t < thread_count; ++t){
+    workers.push_back(std::thread([&,t](){
+      SampleStates states;
+      states.resize(count);
+      SampleGrid grid;
+      for(size_t k = next++; k < samples; k = next++){
+        const SampleWindow window = sampleWindow(options,k);
+        sampleStates(objects,options,window,&states);
+        grid.build(states,count);
+        if(all_pairs){
+          const std::vector<SampleBody> &bodies = grid.bodies();
+          for(size_t i = 0; i < count; ++i){
+            for(size_t j = i + 1; j < count; ++j){
+              checkPair(objects,options,states,window,bodies[i],bodies[j],found[t]);
+            }
+          }
+        }else{
+          grid.pairs([&](const SampleBody &a, const SampleBody &b){
+            checkPair(objects,options,states,window,a,b,found[t]);
+          });
+        }
+      }
+    }));
+  }
+  for(size_t t = 0; t < workers.size(); ++t){
+    workers[t].join();
+  }
+
+  std::vector<Conjunction> all;
+  for(size_t t = 0; t < found.size(); ++t){
+    all.insert(all.end(),found[t].begin(),found[t].end());
+  }
+  std::sort(all.begin(),all.end(),compareConjunction);
+  return all;
+}
+
+std::vector<Conjunction> screenConjunctions(const Constellation &objects, const ConjunctionOptions &options){
+  RSIM_PROFILE_SCOPE("screenConjunctions");
+  if(objects.size() < 2){
+    return std::vector<Conjunction>();
+  }
+  return screen(objects,options,false);
+}
+
+std::vector<Conjunction> screenConjunctionsAllPairs(const Constellation &objects, const ConjunctionOptions &options){
+  RSIM_PROFILE_SCOPE("screenConjunctionsAllPairs");
+  if(objects.size() < 2){
+    return std::vector<Conjunction>();
+  }
+  return screen(objects,options,true);
+}
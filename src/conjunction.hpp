@@ -0,0 +1,52 @@
+#ifndef RSIM_CONJUNCTION_HPP
+#define RSIM_CONJUNCTION_HPP
+/* close approaches between the objects of a constellation
+ *
+ * Checking every pair at every time grows with the square of the objects, so
+ * the span is sampled every step and each sample only compares objects that
+ * share or neighbour a cell of a uniform grid. The objects are sorted by
+ * cell key, so the occupied cells come in key order. Each cell is compared
+ * with the 13 of its 26 neighbours that come after it, reached by cursors
+ * that only move forward through the sorted cells. The cells are as wide as
+ * the threshold plus how far two objects can close on each other in half a
+ * step, so no pair that comes within the threshold in the half step either
+ * side of a sample can be in cells apart. A pair near enough is kept if its
+ * straight line relative motion, widened by the most gravity can bend it,
+ * comes within the threshold. The time of closest approach is then found
+ * from the exact states, where the relative velocity is square to the
+ * relative position.
+ *
+ * Each sample owns the half step either side of it, so the samples are
+ * independent and are shared out over threads.
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include "constellation.hpp"
+
+struct ConjunctionOptions{
+  double start; /* s */
+  double end;
+  double step; /* between samples */
+  double threshold; /* m, approaches closer than this are reported */
+  unsigned int threads;
+
+  ConjunctionOptions();
+};
+
+struct Conjunction{
+  size_t first; /* objects in the order they were added, first < second */
+  size_t second;
+  double time; /* of closest approach */
+  double distance; /* m at that time */
+  double speed; /* m/s relative at that time */
+};
+
+/* every approach within the threshold between start and end, in order of time */
+std::vector<Conjunction> screenConjunctions(const Constellation &objects, const ConjunctionOptions &options);
+
+/* the same comparing every pair at every sample, to check the grid against */
+std::vector<Conjunction> screenConjunctionsAllPairs(const Constellation &objects, const ConjunctionOptions &options);
+
+#endif
@@ -0,0 +1,304 @@
+#include "constellation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "common.hpp"
+#include "earth.hpp"
+#include "profile.hpp"
+
+/* the earth's second zonal harmonic and the equatorial radius it is given for */
+static const double J2 = 1.08262668e-3;
+static const double J2_RADIUS = 6378137.0;
+
+/* objects per batch, enough to fill the vectors while the batch's scratch
+ * arrays stay in the L1 cache
+ */
+static const size_t BATCH = 256;
+
+/* the Kepler equation is solved to this in radians, around 1e-6 m in low orbit */
+static const double ANOMALY_TOLERANCE = 1e-13;
+static const unsigned int ANOMALY_ITERATIONS = 50;
+
+/* added to and taken away from x this rounds it to the nearest integer, for
+ * |x| < 2^51, as one add and one subtract that vectorise where floor does not
+ * without SSE4.1
+ */
+static const double ROUNDING = 6755399441055744.0;
+
+/* pi split in two, the first has 33 bits so k times it is exact for any k
+ * below 2^20
+ */
+static const double PI_HIGH = 3.1415926534682512e+00;
+static const double PI_LOW = 1.2154201013012384e-10;
+
+static inline double nearest(double x){
+  return (x + ROUNDING) - ROUNDING;
+}
+
+/* x in (-pi, pi] plus any whole number of turns */
+static inline double wrapAngle(double x){
+  return x - 2.0*M_PI*nearest(x*(0.5/M_PI));
+}
+
+/* sin and cos without a library call or a branch so the loops around them
+ * vectorise. x less its nearest multiple k of pi is within pi/2, where the
+ * taylor series to the 22nd power is good to the last bit, and the k odd flip
+ * the sign of both. Only meant for |x| up to a few pi, which is all the
+ * wrapped angles here reach.
+ */
+static inline void sinCos(double x, double *s, double *c){
+  const double k = nearest(x*(1.0/M_PI));
+  const double r = (x - k*PI_HIGH) - k*PI_LOW;
+  const double r2 = r*r;
+  const double odd = k - 2.0*nearest(0.5*k); /* -1, 0 or 1 */
+  const double sign = 1.0 - 2.0*odd*odd;
+  const double sr = r + r*r2*(-1.0/6 + r2*(1.0/120 + r2*(-1.0/5040 + r2*(1.0/362880
+      + r2*(-1.0/39916800 + r2*(1.0/6227020800 + r2*(-1.0/1307674368000 + r2*(1.0/355687428096000
+      + r2*(-1.0/121645100408832000 + r2*(1.0/51090942171709440000.0 + r2*(-1.0/25852016738884976640000.0)))))))))));
+  const double cr = 1.0 + r2*(-1.0/2 + r2*(1.0/24 + r2*(-1.0/720 + r2*(1.0/40320
+      + r2*(-1.0/3628800 + r2*(1.0/479001600 + r2*(-1.0/87178291200 + r2*(1.0/20922789888000
+      + r2*(-1.0/6402373705728000 + r2*(1.0/2432902008176640000.0 + r2*(-1.0/1124000727777607680000.0)))))))))));
+  *s = sign*sr;
+  *c = sign*cr;
+}
+
+static double dot(const double a[3], const double b[3]){
+  return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+static void cross(const double a[3], const double b[3], double out[3]){
+  out[0] = a[1]*b[2] - a[2]*b[1];
+  out[1] = a[2]*b[0] - a[0]*b[2];
+  out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+Constellation::Constellation(unsigned int threads):
+  threads(threads > 0 ? threads : std::max(1u,std::thread::hardware_concurrency()))
+  {}
+
+bool Constellation::add(const double r[3], const double v[3], double time){
+  const double mu = gravitiational_constant*earth.mass;
+  const double r_norm = sqrt(dot(r,r));
+  const double v2 = dot(v,v);
+  double a = 1.0/(2.0/r_norm - v2/mu);
+  double h[3];
+  cross(r,v,h);
+  const double h_norm = sqrt(dot(h,h));
+  const double rv = dot(r,v);
+  double e_vector[3];
+  for(int i = 0; i < 3; ++i){
+    e_vector[i] = ((v2 - mu/r_norm)*r[i] - rv*v[i])/mu;
+  }
+  const double e = sqrt(dot(e_vector,e_vector));
+  if(!(a > 0.0) || !(e < 1.0) || !(h_norm > 0.0)){
+    return false;
+  }
+
+  double h_unit[3] = {h[0]/h_norm, h[1]/h_norm, h[2]/h_norm};
+  /* the node is along z cross h, an equatorial orbit takes x for its node and
+   * a circular one its node for its perigee
+   */
+  double node_unit[3] = {-h[1], h[0], 0.0};
+  const double node_norm = sqrt(dot(node_unit,node_unit));
+  if(node_norm > 1e-12*h_norm){
+    node_unit[0] /= node_norm;
+    node_unit[1] /= node_norm;
+  }else{
+    node_unit[0] = 1.0;
+    node_unit[1] = 0.0;
+  }
+  double perigee_unit[3] = {node_unit[0], node_unit[1], node_unit[2]};
+  if(e > 1e-12){
+    for(int i = 0; i < 3; ++i){
+      perigee_unit[i] = e_vector[i]/e;
+    }
+  }
+  double across[3];
+  cross(node_unit,perigee_unit,across);
+  const double argument = atan2(dot(across,h_unit),dot(node_unit,perigee_unit));
+  cross(perigee_unit,r,across);
+  const double true_anomaly = atan2(dot(across,h_unit),dot(perigee_unit,r));
+  const double root = sqrt(1.0 - e*e);
+  const double eccentric = atan2(root*sin(true_anomaly),e + cos(true_anomaly));
+  const double mean_anomaly = eccentric - e*sin(eccentric);
+
+  /* J2 makes the semi major axis of r and v swing about its mean within each
+   * orbit by up to about 10 km in low orbit. The mean is what sets the period,
+   * taking the swing for it would put the object hundreds of km along its
+   * orbit out within a day, so it is taken away to first order (Kozai).
+   */
+  const double cos_i = h[2]/h_norm;
+  const double sin2_i = 1.0 - cos_i*cos_i;
+  const double a_r3 = (a/r_norm)*(a/r_norm)*(a/r_norm);
+  const double swing = J2*J2_RADIUS*J2_RADIUS/a*((1.0 - 1.5*sin2_i)*(a_r3 - 1.0/(root*root*root))
+      + 1.5*sin2_i*a_r3*cos(2.0*(argument + true_anomaly)));
+  a -= swing;
+
+  /* the secular J2 rates of the mean elements */
+  const double n = sqrt(mu/(a*a*a));
+  const double p = a*root*root;
+  const double k = 1.5*J2*(J2_RADIUS/p)*(J2_RADIUS/p)*n;
+
+  this->semi_major_axis.push_back(a);
+  this->eccentricity.push_back(e);
+  this->semi_minor_ratio.push_back(root);
+  this->cos_inclination.push_back(cos_i);
+  this->sin_inclination.push_back(sqrt(std::max(0.0,sin2_i)));
+  /* every element is kept as at time 0 so objects added at different times
+   * share one epoch
+   */
+  this->node_rate.push_back(-k*cos_i);
+  this->node.push_back(atan2(node_unit[1],node_unit[0]) - this->node_rate.back()*time);
+  this->perigee_rate.push_back(k*(2.0 - 2.5*sin2_i));
+  this->perigee.push_back(argument - this->perigee_rate.back()*time);
+  this->anomaly_rate.push_back(n + k*root*(1.0 - 1.5*sin2_i));
+  this->anomaly.push_back(mean_anomaly - this->anomaly_rate.back()*time);
+  return true;
+}
+
+size_t Constellation::size() const{
+  return this->semi_major_axis.size();
+}
+
+void Constellation::positionsAt(double time, double x[], double y[], double z[], unsigned int threads) const{
+  RSIM_PROFILE_SCOPE("Constellation::positionsAt");
+  this->query<false>(time,x,y,z,NULL,NULL,NULL,threads);
+}
+
+void Constellation::statesAt(double time, double x[], double y[], double z[], double vx[], double vy[], double vz[],
+    unsigned int threads) const{
+  RSIM_PROFILE_SCOPE("Constellation::statesAt");
+  this->query<true>(time,x,y,z,vx,vy,vz,threads);
+}
+
+void Constellation::stateOf(size_t object, double time, double r[3], double v[3]) const{
+  this->batch<true>(object,1,time,&r[0],&r[1],&r[2],&v[0],&v[1],&v[2]);
+}
+
+template<bool velocities>
+void Constellation::query(double time, double *x, double *y, double *z, double *vx, double *vy, double *vz, unsigned int threads) const{
+  const size_t count = this->size();
+  const size_t batches = (count + BATCH - 1)/BATCH;
+  const unsigned int thread_count = std::min<size_t>(threads > 0 ? threads : this->threads,batches);
+  auto run = [&](size_t b){
+    const size_t o = b*BATCH;
+    if(velocities){
+      this->batch<velocities>(o,std::min(BATCH,count - o),time,x + o,y + o,z + o,vx + o,vy + o,vz + o);
+    }else{
+      this->batch<velocities>(o,std::min(BATCH,count - o),time,x + o,y + o,z + o,NULL,NULL,NULL);
+    }
+  };
+  if(thread_count <= 1){
+    for(size_t b = 0; b < batches; ++b){
+      run(b);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < thread_count; ++t){
+    workers.push_back(std::thread([&](){
+      for(size_t b = next++; b < batches; b = next++){
+        run(b);
+      }
+    }));
+  }
+  for(size_t t = 0; t < workers.size(); ++t){
+    workers[t].join();
+  }
+}
+
+/* objects first to first+count, the loops over them are the ones that
+ * vectorise so they stay free of branches and calls
+ */
+template<bool velocities>
+void Constellation::batch(size_t first, size_t count, double time, double *x, double *y, double *z, double *vx, double *vy, double *vz) const{
+  const double *e = &this->eccentricity[first];
+  const double *M0 = &this->anomaly[first];
+  const double *M_rate = &this->anomaly_rate[first];
+  double M[BATCH], E[BATCH], step[BATCH];
+
+  /* newton on E - e sin E = M for the whole batch until every object has
+   * converged, the first guess is within e^2 so circular orbits take one or two
+   */
+  for(size_t l = 0; l < count; ++l){
+    double s, c;
+    M[l] = wrapAngle(M0[l] + M_rate[l]*time);
+    sinCos(M[l],&s,&c);
+    E[l] = M[l] + e[l]*s;
+  }
+  for(unsigned int iteration = 0; iteration < ANOMALY_ITERATIONS; ++iteration){
+    for(size_t l = 0; l < count; ++l){
+      double s, c;
+      sinCos(E[l],&s,&c);
+      step[l] = (E[l] - e[l]*s - M[l])/(1.0 - e[l]*c);
+      E[l] -= step[l];
+    }
+    /* counting in the loop above would stop it vectorising */
+    size_t l = 0;
+    while(l < count && fabs(step[l]) <= ANOMALY_TOLERANCE){
+      ++l;
+    }
+    if(l == count){
+      break;
+    }
+  }
+
+  /* written to local arrays first so the loop needs no checks that the
+   * outputs overlap the elements
+   */
+  double out[6][BATCH];
+  const double *a = &this->semi_major_axis[first];
+  const double *ratio = &this->semi_minor_ratio[first];
+  const double *cos_i = &this->cos_inclination[first];
+  const double *sin_i = &this->sin_inclination[first];
+  const double *w0 = &this->perigee[first];
+  const double *w_rate = &this->perigee_rate[first];
+  const double *O0 = &this->node[first];
+  const double *O_rate = &this->node_rate[first];
+  for(size_t l = 0; l < count; ++l){
+    double sin_E, cos_E, sin_w, cos_w, sin_O, cos_O;
+    sinCos(E[l],&sin_E,&cos_E);
+    sinCos(wrapAngle(w0[l] + w_rate[l]*time),&sin_w,&cos_w);
+    sinCos(wrapAngle(O0[l] + O_rate[l]*time),&sin_O,&cos_O);
+    const double b = a[l]*ratio[l];
+
+    /* the perifocal axes, towards perigee and 90 degrees on, in the frame */
+    const double P[3] = {
+      cos_O*cos_w - sin_O*sin_w*cos_i[l],
+      sin_O*cos_w + cos_O*sin_w*cos_i[l],
+      sin_w*sin_i[l]};
+    const double Q[3] = {
+      -cos_O*sin_w - sin_O*cos_w*cos_i[l],
+      -sin_O*sin_w + cos_O*cos_w*cos_i[l],
+      cos_w*sin_i[l]};
+    const double p = a[l]*(cos_E - e[l]);
+    const double q = b*sin_E;
+    /* the velocity is the derivative of exactly that position: E runs at the
+     * J2 mean anomaly rate, the perigee turning moves P towards Q and Q
+     * towards -P, and the node turning swings everything about z
+     */
+    const double rate = M_rate[l]/(1.0 - e[l]*cos_E);
+    const double dp = -a[l]*sin_E*rate - q*w_rate[l];
+    const double dq = b*cos_E*rate + p*w_rate[l];
+    for(int i = 0; i < 3; ++i){
+      out[i][l] = p*P[i] + q*Q[i];
+      out[3 + i][l] = dp*P[i] + dq*Q[i];
+    }
+    out[3][l] -= O_rate[l]*out[1][l];
+    out[4][l] += O_rate[l]*out[0][l];
+  }
+
+  memcpy(x,out[0],count*sizeof(double));
+  memcpy(y,out[1],count*sizeof(double));
+  memcpy(z,out[2],count*sizeof(double));
+  if(velocities){
+    memcpy(vx,out[3],count*sizeof(double));
+    memcpy(vy,out[4],count*sizeof(double));
+    memcpy(vz,out[5],count*sizeof(double));
+  }
+}
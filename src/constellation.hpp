@@ -0,0 +1,72 @@
+#ifndef RSIM_CONSTELLATION_HPP
+#define RSIM_CONSTELLATION_HPP
+/* many delivered payloads flown at once on mean orbital elements
+ *
+ * Each object is kept as the six elements of its orbit, one array per
+ * element, plus the rates the earth's oblateness (J2) gives them on average:
+ * the node and the perigee turn steadily and the mean anomaly runs a little
+ * fast or slow. The wobble J2 adds within each orbit is left out, in low orbit
+ * that is some tens of km which comes and goes rather than growing. So the
+ * state at any time is only the elements moved on at their rates and one
+ * Kepler equation solved, with no steps between.
+ *
+ * Queries run a batch of objects at a time through loops with no branches or
+ * library calls, each line of which the compiler turns into vector
+ * instructions, and the batches are shared out over threads.
+ *
+ * Positions and velocities are relative to the earth's centre with its pole
+ * along z, so the flights here, flown in the x-y plane, are equatorial.
+ */
+
+#include <cstddef>
+#include <vector>
+
+class Constellation{
+public:
+  explicit Constellation(unsigned int threads = 0); /* 0 for every core */
+
+  /* add the object at r and v, in m and m/s, at time seconds, false and not
+   * added if its orbit is not bound
+   */
+  bool add(const double r[3], const double v[3], double time);
+
+  size_t size() const;
+
+  /* where every object is at time, one entry per object in each of x, y
+   * and z in the order they were added, threads 0 for the constellation's own
+   */
+  void positionsAt(double time, double x[], double y[], double z[], unsigned int threads = 0) const;
+
+  /* as positionsAt with the velocities too, the rates of change of those
+   * positions with the J2 drifts included
+   */
+  void statesAt(double time, double x[], double y[], double z[], double vx[], double vy[], double vz[],
+      unsigned int threads = 0) const;
+
+  /* one object alone */
+  void stateOf(size_t object, double time, double r[3], double v[3]) const;
+
+private:
+  unsigned int threads;
+  /* the elements at time 0 and their rates */
+  std::vector<double> semi_major_axis;
+  std::vector<double> eccentricity;
+  std::vector<double> semi_minor_ratio; /* sqrt(1 - e^2) */
+  std::vector<double> cos_inclination;
+  std::vector<double> sin_inclination;
+  std::vector<double> node; /* right ascension of the ascending node */
+  std::vector<double> node_rate;
+  std::vector<double> perigee; /* argument of perigee */
+  std::vector<double> perigee_rate;
+  std::vector<double> anomaly; /* mean anomaly */
+  std::vector<double> anomaly_rate;
+
+  template<bool velocities>
+  void query(double time, double *x, double *y, double *z, double *vx, double *vy, double *vz, unsigned int threads) const;
+
+  /* objects first to first+count, written from x[0] on */
+  template<bool velocities>
+  void batch(size_t first, size_t count, double time, double *x, double *y, double *z, double *vx, double *vy, double *vz) const;
+};
+
+#endif
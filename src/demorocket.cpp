@@ -4,7 +4,9 @@
 #include "demorocket.hpp"
 
 // STD
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -26,11 +28,14 @@
 
 // project
 #include "meshdata.hpp"
+#include "planetmesh.hpp"
 #include "vao.hpp"
 #include "rocket.hpp"
-#include "tiny_obj_loader.h"
+#include "trajectory.hpp"
 #include "earth.hpp"
 #include "common.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
 
 // global constants
 static const std::string FRAGMENT_SHADER_PATH = "../render.fs";
@@ -39,24 +44,65 @@ static const char* UMODELVIEW = "uModelView";
 static const char* UPROJECTION = "uProjection";
 static const char* UCOLOR = "uColor";
 
-/// colours are like ROY G BIV
-static const glm::vec4 STAGE_COLOURS[Rocket::NUMBER_OF_STAGES] = {
+/// colours are like ROY G BIV, indexed by stage progress which runs from 1 to
+/// one past the last stage
+static const unsigned int STAGE_COLOUR_COUNT = DEMO_MAX_STAGES + 2;
+static const glm::vec4 STAGE_COLOURS[STAGE_COLOUR_COUNT] = {
   glm::vec4(1.0, 0.2, 0.2, 1.0)
   , glm::vec4(1.0, 0.5, 0.2, 1.0)
   , glm::vec4(1.0, 1.0, 0.2, 1.0)
   , glm::vec4(0.1, 0.8, 0.1, 1.0)
   , glm::vec4(0.2, 0.2, 1.0, 1.0)
+  , glm::vec4(0.3, 0.0, 0.5, 1.0)
+  , glm::vec4(0.6, 0.2, 0.9, 1.0)
+  , glm::vec4(0.9, 0.4, 0.9, 1.0)
+  , glm::vec4(0.7, 0.7, 0.7, 1.0)
+  , glm::vec4(1.0, 1.0, 1.0, 1.0)
+};
+
+// anything past the table, say from a foreign recording, shows as the last
+static unsigned int viewStage(unsigned int stage) {
+    return stage < STAGE_COLOUR_COUNT ? stage : STAGE_COLOUR_COUNT - 1;
+}
+
+// earth patch on the gpu, its vertices are relative to centre which is in
+// metres from the earth's centre
+struct EarthPatch {
+    RSimView::VertexArrayObject vao;
+    double centre[3];
+    unsigned long last_selected;
 };
 
 // global variables
 static std::vector<RSimView::VertexArrayObject> VAO_LIST;
+static RSimView::PlanetMesh* PLANET = NULL;
+static std::map<uint64_t, EarthPatch> EARTH_PATCHES;
+static GLuint EARTH_INDICES = 0;
+static GLuint EARTH_PROGRAM = 0;
+static unsigned long EARTH_SELECTION = 0;
 static Rocket* ROCKET_MODEL = NULL;
 static int ROCKET_ITER = 0;
 static glm::mat4 ROTATION_MATRIX;
 static bool USE_SPREADSHEET = false;
+static TrajectoryWriter* RECORDER = NULL;
+static Trajectory* REPLAY = NULL;
+
+// what is currently shown, either the live rocket or a replayed record,
+// kept in double and only turned into floats relative to the camera
+static double VIEW_POSITION[3];
+static unsigned int VIEW_STAGE = 1;
+
+// replay clock in simulation seconds
+static double REPLAY_TIME = 0.0;
+static double REPLAY_SPEED = 1.0;
+static bool REPLAY_PAUSED = false;
+static int REPLAY_LAST_TICK = 0;
+static const double REPLAY_SCRUB_STEP = 10.0;
 
 // updates rocket VAO to reflect changes
-void updateView(double height, glm::vec3 thrust_direction, int stage) {
+void updateView(double height, const double position[3], unsigned int stage) {
+    RSIM_PROFILE_SCOPE("updateView");
+    RSIM_TRACE_SCOPE("updateView");
     double max_height = 100*1e3;
     glm::vec3 ground_color(205.0/255, 111.0/255, 1.0);
     glm::vec3 space_color(33.0/255, 27.0/255, 53.0/255);
@@ -68,12 +114,10 @@ void updateView(double height, glm::vec3 thrust_direction, int stage) {
     glm::vec3 clear_color = (1-percent_up)*ground_color + percent_up*space_color;
     //printf("height %f percent %f\n", height, percent_up);
 
-    /* TODO: differentiate rocket from earth better */
     for(int i = 0; i < 3; ++i){
-      RSimView::VertexArrayObject *vao = &VAO_LIST[i];
-      glm::vec3 position(ROCKET_MODEL->getPositionGLM());
-      vao->translation = position;
+      VIEW_POSITION[i] = position[i];
     }
+    VIEW_STAGE = viewStage(stage);
 
     glClearColor(clear_color.x,clear_color.y,clear_color.z,1.0);
     glutPostRedisplay();
@@ -180,6 +224,45 @@ int buildProgram(int vs, int fs) {
     }
 }
 
+// keep buffers for the selected earth patches, only the newly picked ones are
+// built and those unused the longest are dropped once too many are kept
+static void updateEarthPatches(const double eye[3]) {
+    if(!PLANET->update(eye[0] - earth.position[0], eye[1] - earth.position[1], eye[2] - earth.position[2])) {
+        return;
+    }
+    ++EARTH_SELECTION;
+    std::vector<RSimView::InterleavedVertex> vertices;
+    const std::vector<uint64_t>& selected = PLANET->selected();
+    for(size_t i = 0; i < selected.size(); ++i) {
+        std::map<uint64_t, EarthPatch>::iterator it = EARTH_PATCHES.find(selected[i]);
+        if(it == EARTH_PATCHES.end()) {
+            EarthPatch patch;
+            PLANET->buildPatch(selected[i], vertices, patch.centre);
+            patch.vao = RSimView::loadMeshIntoBuffer(vertices.data(), vertices.size()
+                , EARTH_INDICES, PLANET->indices().size(), EARTH_PROGRAM);
+            it = EARTH_PATCHES.insert(std::make_pair(selected[i], patch)).first;
+            RSIM_PROFILE_COUNT("planet patches built", 1);
+        }
+        it->second.last_selected = EARTH_SELECTION;
+    }
+
+    const size_t keep = 2*PLANET->maxPatches();
+    if(EARTH_PATCHES.size() > keep) {
+        std::vector<std::pair<unsigned long, uint64_t> > unused;
+        for(std::map<uint64_t, EarthPatch>::iterator it = EARTH_PATCHES.begin(); it != EARTH_PATCHES.end(); ++it) {
+            if(it->second.last_selected != EARTH_SELECTION) {
+                unused.push_back(std::make_pair(it->second.last_selected, it->first));
+            }
+        }
+        std::sort(unused.begin(), unused.end());
+        for(size_t i = 0; i < unused.size() && EARTH_PATCHES.size() > keep; ++i) {
+            std::map<uint64_t, EarthPatch>::iterator it = EARTH_PATCHES.find(unused[i].second);
+            RSimView::releaseMeshBuffer(it->second.vao);
+            EARTH_PATCHES.erase(it);
+        }
+    }
+}
+
 namespace window {
 glm::mat4 PROJECTION;
 float CAMERA_LONGITUDE, CAMERA_COLATITUDE, CAMERA_RADIUS;
@@ -190,37 +273,30 @@ void updateProjection(int width, int height) {
 }
 
 void onDisplay(void) {
-    // create view
-    glm::vec3 rpos(ROCKET_MODEL->getPositionGLM());
-    const float rad = (1.0 - fmin(normalize(rpos.y,0.0,10000),0.85))*500;
-    glm::vec3 eye(rpos.x+rad,rpos.y,rpos.z);
-    //std::cout << "eye: " << eye.x << ", " << eye.y << ", " << eye.z << std::endl;
-    glm::vec3 center(ROCKET_MODEL->getPositionGLM());
+    RSIM_PROFILE_SCOPE("onDisplay");
+    RSIM_TRACE_SCOPE("onDisplay");
+    // create view, the camera sits at the origin and everything is placed
+    // relative to it in double before being handed over as floats
+    const float rad = (1.0 - fmin(normalize(VIEW_POSITION[1],0.0,10000),0.85))*500;
+    const double eye[3] = {VIEW_POSITION[0]+rad, VIEW_POSITION[1], VIEW_POSITION[2]};
+    updateEarthPatches(eye);
+    //std::cout << "eye: " << eye[0] << ", " << eye[1] << ", " << eye[2] << std::endl;
+    glm::vec3 center(-rad, 0.0f, 0.0f);
     glm::vec3 up(0.0f,1.0f,0.0f);
-    glm::mat4 view(glm::lookAt(eye, center, up));
+    glm::mat4 view(glm::lookAt(glm::vec3(0.0f), center, up));
     glm::mat4 projection(PROJECTION);
-    glm::mat4 modelView = view;
-    glm::vec4 color = STAGE_COLOURS[ROCKET_MODEL->getStageProgress()];
+    glm::vec4 color = STAGE_COLOURS[VIEW_STAGE];
     glm::vec4 earth_color = glm::vec4(0.0,0.8,0.2,1.0);
-    glm::mat4 earth_model = glm::mat4(1.0)*view;
 
     // draw stuff
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    int obj = 0;
     for(RSimView::VertexArrayObject vao : VAO_LIST) {
         // here's the program we're using
         glUseProgram(vao.program);
 
-        glm::mat4 translation = glm::translate(vao.translation);
+        glm::mat4 translation = glm::translate(center);
         glm::mat4 scale = glm::scale(vao.scale);
-        glm::mat4 mvts;
-        if(obj < 3){
-          glm::mat4 intrans = glm::inverse(translation);
-          glm::mat4 origin_rotation = ROTATION_MATRIX*intrans;
-          mvts = view*scale*translation*ROTATION_MATRIX;
-        }else{
-          mvts = earth_model*translation*scale;
-        }
+        glm::mat4 mvts = view*scale*translation*ROTATION_MATRIX;
 
         // get uniforms
         int uModelView = glGetUniformLocation(vao.program, UMODELVIEW);
@@ -230,16 +306,30 @@ void onDisplay(void) {
         // set uniforms
         glUniformMatrix4fv(uModelView, 1, false, glm::value_ptr(mvts));
         glUniformMatrix4fv(uProjection, 1, false, glm::value_ptr(projection));
-        if(obj < 3){
-          glUniform4fv(uColor, 1, glm::value_ptr(color));
-        }else{
-          glUniform4fv(uColor, 1, glm::value_ptr(earth_color));
-        }
+        glUniform4fv(uColor, 1, glm::value_ptr(color));
 
         // draw it
         glBindVertexArray(vao.id);
         glDrawElements(GL_TRIANGLES, vao.index_count, GL_UNSIGNED_INT, NULL);
-        ++obj;
+    }
+
+    // earth patches, each moved from its centre to the camera
+    glUseProgram(EARTH_PROGRAM);
+    int uModelView = glGetUniformLocation(EARTH_PROGRAM, UMODELVIEW);
+    int uProjection = glGetUniformLocation(EARTH_PROGRAM, UPROJECTION);
+    int uColor = glGetUniformLocation(EARTH_PROGRAM, UCOLOR);
+    glUniformMatrix4fv(uProjection, 1, false, glm::value_ptr(projection));
+    glUniform4fv(uColor, 1, glm::value_ptr(earth_color));
+    const std::vector<uint64_t>& selected = PLANET->selected();
+    for(size_t i = 0; i < selected.size(); ++i) {
+        const EarthPatch& patch = EARTH_PATCHES[selected[i]];
+        glm::vec3 offset(earth.position[0] + patch.centre[0] - eye[0]
+            , earth.position[1] + patch.centre[1] - eye[1]
+            , earth.position[2] + patch.centre[2] - eye[2]);
+        glm::mat4 mvts = view*glm::translate(offset);
+        glUniformMatrix4fv(uModelView, 1, false, glm::value_ptr(mvts));
+        glBindVertexArray(patch.vao.id);
+        glDrawElements(GL_TRIANGLES, patch.vao.index_count, GL_UNSIGNED_INT, NULL);
     }
     glutSwapBuffers();
 }
@@ -253,7 +343,44 @@ void onVisibilityChange(int state) {
     //...
 }
 void onCharacterKeyEvent(unsigned char key, int mouseX, int mouseY) {
-    //...
+    if(REPLAY == NULL) {
+        return;
+    }
+
+    // replay controls, seeking is a binary search so any jump is instant
+    switch(key) {
+        case ' ':
+            REPLAY_PAUSED = !REPLAY_PAUSED;
+            break;
+
+        case 'r':
+            REPLAY_TIME = REPLAY->startTime();
+            break;
+
+        case ',':
+            REPLAY_TIME -= REPLAY_SCRUB_STEP;
+            break;
+
+        case '.':
+            REPLAY_TIME += REPLAY_SCRUB_STEP;
+            break;
+
+        case '[':
+            REPLAY_SPEED /= 2.0;
+            break;
+
+        case ']':
+            REPLAY_SPEED *= 2.0;
+            break;
+
+        case '-':
+            REPLAY_SPEED = -REPLAY_SPEED;
+            break;
+
+        default:
+            break;
+    }
+    REPLAY_TIME = fmin(REPLAY->endTime(), fmax(REPLAY->startTime(), REPLAY_TIME));
 }
 
 void onOtherKeyEvent(int key, int mouseX, int mouseY) {
@@ -290,6 +417,7 @@ void onOtherKeyEvent(int key, int mouseX, int mouseY) {
 }
 
 void onIdle() {
+    RSIM_TRACE_SCOPE("onIdle");
     static const int max_iter = 300000;
     static const double max_height = 480*1e4;
     if(ROCKET_ITER >= max_iter) {
@@ -297,36 +425,52 @@ void onIdle() {
         return;
     }
     ROCKET_MODEL->step();
-    double height = ROCKET_MODEL->getPositionGLM().y;
-    glm::vec4 thrust_direction_vec4(ROCKET_MODEL->getThrustDirectionGLM());
-    glm::vec3 thrust_direction(thrust_direction_vec4.x,thrust_direction_vec4.y,thrust_direction_vec4.z);
-    int stage = 0;
-    //printf("onIdle: step %d height %f rotation %f, %f, %f, %f\n", ROCKET_ITER, height, thrust_direction_vec4.x, thrust_direction_vec4.y, thrust_direction_vec4.z, thrust_direction_vec4.w);
+    const double* position = ROCKET_MODEL->getState()->data;
+    double height = position[1];
+    //printf("onIdle: step %d height %f\n", ROCKET_ITER, height);
     ROCKET_MODEL->print(USE_SPREADSHEET);
-    updateView(height, thrust_direction, stage);
+    if(RECORDER != NULL) {
+        RECORDER->write(*ROCKET_MODEL);
+    }
+    updateView(height, position, ROCKET_MODEL->getStageProgress());
     ROCKET_ITER++;
 
     // stop after 100 secondsd
     if(ROCKET_ITER == max_iter || height >= max_height) {
         printf("done\n");
+        if(RECORDER != NULL) {
+            RECORDER->flush();
+            printf("recorded %zu of %zu samples\n", RECORDER->recordsWritten(), RECORDER->recordsSeen());
+        }
         exit(0);
     }
 }
 
-} // namespace window
+void onReplayIdle() {
+    RSIM_TRACE_SCOPE("onReplayIdle");
+    // advance the replay clock by the wall clock time since the last frame
+    int tick = glutGet(GLUT_ELAPSED_TIME);
+    double elapsed = (tick - REPLAY_LAST_TICK)/1000.0;
+    REPLAY_LAST_TICK = tick;
+    if(!REPLAY_PAUSED) {
+        REPLAY_TIME += elapsed*REPLAY_SPEED;
+        REPLAY_TIME = fmin(REPLAY->endTime(), fmax(REPLAY->startTime(), REPLAY_TIME));
+    }
 
-int demoRocket(Rocket& rocket, bool use_spreadsheet, int* argc, char** argv) {
-    // set that
-    USE_SPREADSHEET = use_spreadsheet;
+    TrajectoryRecord record;
+    REPLAY->sample(REPLAY_TIME, &record);
+    updateView(record.position[1], record.position, record.stage);
+}
+
+} // namespace window
 
+// load meshes and shaders and open the window, shared by live and replay modes
+static int setupView(int* argc, char** argv) {
     // load payload
     RSimView::MeshData first_stage_mesh = RSimView::firstStageMeshData();
     RSimView::MeshData second_stage_mesh = RSimView::secondStageMeshData();
     RSimView::MeshData payload_mesh = RSimView::payloadMeshData();
 
-    // set pointer
-    ROCKET_MODEL = &rocket;
-
     // figure out window size
     int width = 640;
     int height = 640;
@@ -382,40 +526,73 @@ int demoRocket(Rocket& rocket, bool use_spreadsheet, int* argc, char** argv) {
     VAO_LIST.push_back(first_stage_vao);
     VAO_LIST.push_back(second_stage_vao);
 
-    /* load earth */
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string err = tinyobj::LoadObj(shapes, materials, "sphere.obj", 0);
-    if(err.size() != 0){
-        std::cerr << "Error loading object file: " << err << std::endl;
-        exit(-1);
-    }
-
-    RSimView::MeshData earth_mesh(shapes[0].mesh.positions.data(),shapes[0].mesh.normals.data(),
-      shapes[0].mesh.positions.size(),shapes[0].mesh.indices.data(),shapes[0].mesh.indices.size());
-    RSimView::VertexArrayObject earth_vao = RSimView::loadMeshIntoBuffer(earth_mesh,program);
-
-    /* set location and scale of earth */
-
-    earth_vao.translation = glm::vec3(0,earth.position[1],0);
-    earth_vao.scale = glm::vec3(earth.radius,earth.radius,earth.radius);
-
-    VAO_LIST.push_back(earth_vao);
+    /* generate earth, the patches are picked around the camera every frame
+     * and all of them draw with the same triangles
+     */
+    PLANET = new RSimView::PlanetMesh(earth.radius);
+    EARTH_PROGRAM = program;
+    EARTH_INDICES = RSimView::loadIndexBuffer(PLANET->indices().data(), PLANET->indices().size());
 
     // hookup glut functions
     glutDisplayFunc(window::onDisplay);
     glutReshapeFunc(window::onReshape);
     glutKeyboardFunc(window::onCharacterKeyEvent);
     glutSpecialFunc(window::onOtherKeyEvent);
-    glutIdleFunc(window::onIdle);
     glutVisibilityFunc(window::onVisibilityChange);
 
     // enable things
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.6,0.6,0.6,1.0);
+    return 0;
+}
+
+int demoRocket(Rocket& rocket, bool use_spreadsheet, TrajectoryWriter* recorder, int* argc, char** argv) {
+    // set that
+    USE_SPREADSHEET = use_spreadsheet;
+    RECORDER = recorder;
+
+    // set pointer
+    ROCKET_MODEL = &rocket;
+    for(int i = 0; i < 3; ++i) {
+        VIEW_POSITION[i] = rocket.getState()->data[i];
+    }
+    VIEW_STAGE = viewStage(rocket.getStageProgress());
+    // the launch pad, so the replay starts where the flight did
+    if(RECORDER != NULL) {
+        RECORDER->write(rocket);
+    }
+
+    int ret = setupView(argc, argv);
+    if(ret != 0) {
+        return ret;
+    }
+    glutIdleFunc(window::onIdle);
 
     // startup main loop
     std::cout << "Launching Simulation" << std::endl;
     glutMainLoop();
     return 0;
 }
+
+int demoReplay(Trajectory& trajectory, int* argc, char** argv) {
+    REPLAY = &trajectory;
+    REPLAY_TIME = trajectory.startTime();
+    for(int i = 0; i < 3; ++i) {
+        VIEW_POSITION[i] = trajectory[0].position[i];
+    }
+    VIEW_STAGE = viewStage(trajectory[0].stage);
+
+    int ret = setupView(argc, argv);
+    if(ret != 0) {
+        return ret;
+    }
+    glutIdleFunc(window::onReplayIdle);
+    REPLAY_LAST_TICK = glutGet(GLUT_ELAPSED_TIME);
+
+    // startup main loop
+    std::cout << "Replaying " << trajectory.size() << " records, "
+        << "space pauses, ',' and '.' scrub, '[' and ']' change speed, "
+        << "'-' reverses and 'r' rewinds" << std::endl;
+    glutMainLoop();
+    return 0;
+}
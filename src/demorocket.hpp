@@ -2,8 +2,17 @@
 #define RSIM_DEMO_ROCKET_HPP
 
 #include "rocket.hpp"
+#include "trajectory.hpp"
 
-int demoRocket(Rocket& rocket, bool use_spreadsheet, int* argc, char** argv);
+/// most stages the viewer has colours for, with one more for after the last
+/// burnout
+static const unsigned int DEMO_MAX_STAGES = 8;
+
+/// run the simulation live, optionally recording it for replay
+int demoRocket(Rocket& rocket, bool use_spreadsheet, TrajectoryWriter* recorder, int* argc, char** argv);
+
+/// show a recorded flight without simulating it
+int demoReplay(Trajectory& trajectory, int* argc, char** argv);
 
 
 #endif //RSIM_DEMO_ROCKET_HPP
\ No newline at end of file
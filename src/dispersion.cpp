@@ -0,0 +1,360 @@
+#include "dispersion.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "flightpropagator.hpp"
+#include "profile.hpp"
+
+static const unsigned int E = DISPERSION_EVENT_COUNT;
+static const unsigned int O = DISPERSION_OUTPUT_COUNT;
+
+static const char *const output_names[DISPERSION_OUTPUT_COUNT] = {
+  "time",
+  "altitude",
+  "speed",
+  "flight_path_angle",
+  "mass"
+};
+
+static const char *const event_names[DISPERSION_EVENT_COUNT] = {
+  "staging",
+  "insertion"
+};
+
+FlightDispersion::FlightDispersion(const FlightParameters<double> &mean):
+  mean(mean){
+    memset(covariance,0,sizeof(covariance));
+  }
+
+FlightDistributions::FlightDistributions(const FlightParameters<double> &base):
+  base(base){
+    for(unsigned int i = 0; i < FLIGHT_PARAMETER_COUNT; ++i){
+      input[i] = InputDistribution(DISTRIBUTION_FIXED,base[i]);
+    }
+  }
+
+unsigned int FlightDistributions::varying() const {
+  unsigned int n = 0;
+  for(unsigned int i = 0; i < FLIGHT_PARAMETER_COUNT; ++i){
+    if(input[i].type != DISTRIBUTION_FIXED){
+      ++n;
+    }
+  }
+  return n;
+}
+
+DispersionOptions::DispersionOptions():
+  dt(0.01),
+  end_time(3600.0),
+  threads(std::max(1u,std::thread::hardware_concurrency())),
+  alpha(1.0),
+  beta(2.0),
+  kappa(0.0)
+  {}
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void measure(const FlightState<double> &flight, double out[DISPERSION_OUTPUT_COUNT]){
+  const double *x = &flight.y[STATE_POSITION_START];
+  const double *p = &flight.y[STATE_LINEAR_MOMENTUM_START];
+  const double m = flight.y[STATE_MASS];
+  double r[3], v[3];
+  for(int i = 0; i < 3; ++i){
+    r[i] = x[i] - earth.position[i];
+    v[i] = p[i]/m;
+  }
+  const double dist = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+  const double speed = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+  const double radial = (r[0]*v[0] + r[1]*v[1] + r[2]*v[2])/dist;
+  out[OUTPUT_TIME] = flight.time;
+  out[OUTPUT_ALTITUDE] = dist - earth.radius;
+  out[OUTPUT_SPEED] = speed;
+  out[OUTPUT_FLIGHT_PATH_ANGLE] = speed > 0.0 ? asin(radial/speed) : M_PI/2;
+  out[OUTPUT_MASS] = m;
+}
+
+void flyToEvents(const FlightParameters<double> &parameters, const DispersionOptions &options, DispersionOutcome *out){
+  RSIM_PROFILE_SCOPE("flyToEvents");
+  FlightState<double> flight;
+  launchState(parameters,&flight);
+  const unsigned int stages = flight.table.stages;
+
+  flight_phase_t phase = PHASE_ATMOSPHERE;
+  FlightDerivative<double>::type derivative = phaseDerivativeFor<double>(phase);
+  bool staged = false;
+  while(flight.time < options.end_time && flight.stage <= stages){
+    double h;
+    const flight_event_t event = nextFlightStep(flight,parameters,options.dt,options.end_time,&h);
+    const flight_phase_t next = flightPhase(flight.y,flight.body,options.dt);
+    if(next != phase){
+      phase = next;
+      derivative = phaseDerivativeFor<double>(phase);
+    }
+    rk4Step(flight.y,h,flight.body,derivative);
+    flight.time += h;
+
+    if(event == EVENT_NONE){
+      updateMassProperties(&flight);
+      continue;
+    }
+    /* measured at burnout, before the stage's dry mass drops */
+    if(event == EVENT_BURNOUT && !staged){
+      measure(flight,out->value[AT_STAGING]);
+      staged = true;
+    }
+    if(event == EVENT_BURNOUT && flight.stage == stages){
+      measure(flight,out->value[AT_INSERTION]);
+    }
+    applyFlightEvent(&flight,event,parameters);
+  }
+
+  if(!staged){
+    measure(flight,out->value[AT_STAGING]);
+  }
+  if(flight.stage <= stages){
+    measure(flight,out->value[AT_INSERTION]);
+  }
+}
+
+/* fly every parameter set on every thread */
+static void flyAll(const std::vector<FlightParameters<double> > &parameters, const DispersionOptions &options,
+    std::vector<DispersionOutcome> &outcomes){
+  outcomes.resize(parameters.size());
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  const unsigned int thread_count = std::max<size_t>(1,std::min<size_t>(options.threads,parameters.size()));
+  for(unsigned int t = 0; t < thread_count; ++t){
+    workers.push_back(std::thread([&](){
+      for(size_t n = next++; n < parameters.size(); n = next++){
+        flyToEvents(parameters[n],options,&outcomes[n]);
+      }
+    }));
+  }
+  for(size_t t = 0; t < workers.size(); ++t){
+    workers[t].join();
+  }
+}
+
+/* lower triangular L with L L^T the covariance of the parameters that vary,
+ * varying[k] is the parameter of row and column k
+ */
+static bool choleskyFactor(const FlightDispersion &inputs, unsigned int varying[], unsigned int *count, double L[][FLIGHT_PARAMETER_COUNT]){
+  unsigned int n = 0;
+  for(unsigned int i = 0; i < FLIGHT_PARAMETER_COUNT; ++i){
+    if(inputs.covariance[i][i] > 0.0){
+      varying[n++] = i;
+    }
+  }
+  *count = n;
+  for(unsigned int i = 0; i < n; ++i){
+    for(unsigned int j = 0; j <= i; ++j){
+      double sum = inputs.covariance[varying[i]][varying[j]];
+      for(unsigned int k = 0; k < j; ++k){
+        sum -= L[i][k]*L[j][k];
+      }
+      if(i == j){
+        if(!(sum > 0.0)){
+          return false;
+        }
+        L[i][i] = sqrt(sum);
+      }else{
+        L[i][j] = sum/L[j][j];
+      }
+    }
+    for(unsigned int j = i + 1; j < FLIGHT_PARAMETER_COUNT; ++j){
+      L[i][j] = 0.0;
+    }
+  }
+  return true;
+}
+
+/* weighted mean and covariance of the outcomes */
+static void combine(const std::vector<DispersionOutcome> &outcomes,
+    const std::vector<double> &mean_weight, const std::vector<double> &covariance_weight,
+    DispersionStatistics *out){
+  for(unsigned int e = 0; e < E; ++e){
+    for(unsigned int i = 0; i < O; ++i){
+      double mean = 0.0;
+      for(size_t k = 0; k < outcomes.size(); ++k){
+        mean += mean_weight[k]*outcomes[k].value[e][i];
+      }
+      out->mean[e][i] = mean;
+    }
+    for(unsigned int i = 0; i < O; ++i){
+      for(unsigned int j = 0; j <= i; ++j){
+        double sum = 0.0;
+        for(size_t k = 0; k < outcomes.size(); ++k){
+          sum += covariance_weight[k]*(outcomes[k].value[e][i] - out->mean[e][i])*(outcomes[k].value[e][j] - out->mean[e][j]);
+        }
+        out->covariance[e][i][j] = sum;
+        out->covariance[e][j][i] = sum;
+      }
+    }
+  }
+  out->flights = outcomes.size();
+}
+
+bool unscentedDispersion(const FlightDispersion &inputs, const DispersionOptions &options, DispersionStatistics *out){
+  RSIM_PROFILE_SCOPE("unscentedDispersion");
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned int varying[FLIGHT_PARAMETER_COUNT];
+  unsigned int n;
+  double L[FLIGHT_PARAMETER_COUNT][FLIGHT_PARAMETER_COUNT];
+  if(!choleskyFactor(inputs,varying,&n,L)){
+    return false;
+  }
+
+  const double alpha2 = options.alpha*options.alpha;
+  const double lambda = alpha2*(n + options.kappa) - n;
+  if(n > 0 && !(n + lambda > 0.0)){
+    return false;
+  }
+  const double spread = sqrt(n + lambda);
+
+  /* the mean, then plus and minus each column of the scaled square root */
+  std::vector<FlightParameters<double> > points(2*n + 1,inputs.mean);
+  for(unsigned int k = 0; k < n; ++k){
+    for(unsigned int i = k; i < n; ++i){
+      points[1 + k][varying[i]] += spread*L[i][k];
+      points[1 + n + k][varying[i]] -= spread*L[i][k];
+    }
+  }
+
+  std::vector<DispersionOutcome> outcomes;
+  flyAll(points,options,outcomes);
+
+  /* nothing varies, the one flight is the answer */
+  const double centre_mean = n > 0 ? lambda/(n + lambda) : 1.0;
+  const double centre_covariance = n > 0 ? centre_mean + 1.0 - alpha2 + options.beta : 0.0;
+  const double side = n > 0 ? 0.5/(n + lambda) : 0.0;
+  std::vector<double> mean_weight(points.size(),side);
+  std::vector<double> covariance_weight(points.size(),side);
+  mean_weight[0] = centre_mean;
+  covariance_weight[0] = centre_covariance;
+  combine(outcomes,mean_weight,covariance_weight,out);
+  out->seconds = secondsSince(start);
+  return true;
+}
+
+bool monteCarloDispersion(const FlightDispersion &inputs, unsigned int samples, unsigned long seed,
+    const DispersionOptions &options, DispersionStatistics *out){
+  RSIM_PROFILE_SCOPE("monteCarloDispersion");
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned int varying[FLIGHT_PARAMETER_COUNT];
+  unsigned int n;
+  double L[FLIGHT_PARAMETER_COUNT][FLIGHT_PARAMETER_COUNT];
+  if(!choleskyFactor(inputs,varying,&n,L) || samples < 2){
+    return false;
+  }
+
+  std::vector<FlightParameters<double> > draws(samples,inputs.mean);
+  for(unsigned int s = 0; s < samples; ++s){
+    std::mt19937_64 generator(seed + s);
+    std::normal_distribution<double> normal;
+    double z[FLIGHT_PARAMETER_COUNT];
+    for(unsigned int k = 0; k < n; ++k){
+      z[k] = normal(generator);
+    }
+    for(unsigned int i = 0; i < n; ++i){
+      for(unsigned int k = 0; k <= i; ++k){
+        draws[s][varying[i]] += L[i][k]*z[k];
+      }
+    }
+  }
+
+  std::vector<DispersionOutcome> outcomes;
+  flyAll(draws,options,outcomes);
+
+  combine(outcomes,std::vector<double>(samples,1.0/samples),std::vector<double>(samples,1.0/(samples - 1)),out);
+  out->seconds = secondsSince(start);
+  return true;
+}
+
+void flightFromUnit(const FlightDistributions &inputs, const double u[], FlightParameters<double> *out){
+  *out = inputs.base;
+  unsigned int d = 0;
+  for(unsigned int i = 0; i < FLIGHT_PARAMETER_COUNT; ++i){
+    if(inputs.input[i].type != DISTRIBUTION_FIXED){
+      (*out)[i] = inverseDistribution(inputs.input[i],u[d++]);
+    }
+  }
+}
+
+void drawFlight(const FlightDistributions &inputs, const Sampler &sampler, size_t index, FlightParameters<double> *out){
+  double u[SAMPLER_MAX_DIMENSIONS];
+  sampler.point(index,u);
+  flightFromUnit(inputs,u,out);
+}
+
+bool sampledDispersion(const FlightDistributions &inputs, const Sampler &sampler, size_t first, size_t count,
+    const DispersionOptions &options, DispersionStatistics *out){
+  RSIM_PROFILE_SCOPE("sampledDispersion");
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if(sampler.getDimensions() != inputs.varying() || count < 2){
+    return false;
+  }
+
+  std::vector<FlightParameters<double> > draws(count,inputs.base);
+  for(size_t s = 0; s < count; ++s){
+    drawFlight(inputs,sampler,first + s,&draws[s]);
+  }
+
+  std::vector<DispersionOutcome> outcomes;
+  flyAll(draws,options,outcomes);
+
+  combine(outcomes,std::vector<double>(count,1.0/count),std::vector<double>(count,1.0/(count - 1)),out);
+  out->seconds = secondsSince(start);
+  return true;
+}
+
+void mergeDispersion(const DispersionStatistics &shard, DispersionStatistics *total){
+  if(total->flights == 0){
+    *total = shard;
+    return;
+  }
+  const double a = total->flights;
+  const double b = shard.flights;
+  const double n = a + b;
+  for(unsigned int e = 0; e < E; ++e){
+    double delta[O];
+    for(unsigned int i = 0; i < O; ++i){
+      delta[i] = shard.mean[e][i] - total->mean[e][i];
+    }
+    /* sums of squares about each mean, then about the combined one */
+    for(unsigned int i = 0; i < O; ++i){
+      for(unsigned int j = 0; j < O; ++j){
+        const double squares = total->covariance[e][i][j]*(a - 1.0) + shard.covariance[e][i][j]*(b - 1.0)
+          + delta[i]*delta[j]*a*b/n;
+        total->covariance[e][i][j] = squares/(n - 1.0);
+      }
+    }
+    for(unsigned int i = 0; i < O; ++i){
+      total->mean[e][i] += delta[i]*b/n;
+    }
+  }
+  total->flights += shard.flights;
+  total->seconds += shard.seconds;
+}
+
+const char *dispersionOutputName(unsigned int output){
+  if(output >= DISPERSION_OUTPUT_COUNT){
+    return "unknown";
+  }
+  return output_names[output];
+}
+
+const char *dispersionEventName(unsigned int event){
+  if(event >= DISPERSION_EVENT_COUNT){
+    return "unknown";
+  }
+  return event_names[event];
+}
@@ -0,0 +1,133 @@
+#ifndef RSIM_DISPERSION_HPP
+#define RSIM_DISPERSION_HPP
+/* how far the flight scatters when its parameters are uncertain
+ *
+ * The parameters are given as a mean and a covariance. Monte Carlo draws
+ * thousands of flights from them. The unscented transform flies only 2n+1
+ * deterministic ones, n being the number of parameters that vary: one at the
+ * mean and one either side of it along each column of a square root of the
+ * scaled covariance. The weighted mean and covariance of those outcomes match
+ * the true ones exactly when the outcomes are linear in the parameters. They
+ * also get the second order terms of the mean right.
+ *
+ * The outcomes are taken at the first staging and at the last burnout, which
+ * is where the payload is inserted into its orbit. Both events land exactly on
+ * a step of the fixed step propagator, so the outcomes stay smooth in the
+ * parameters instead of jumping by a step whenever an event moves across one.
+ *
+ * Inputs that are not gaussian, or want fewer flights than Monte Carlo for
+ * the same error, are given one distribution each and sampled through a
+ * Sampler, which with Sobol points gets an error close to 1/N in place of
+ * 1/sqrt(N). Sample i is fixed by its index and the seed, so a design can be
+ * flown in shards anywhere and the shards' statistics merged.
+ */
+
+#include <cstddef>
+
+#include "flightmodel.hpp"
+#include "sampling.hpp"
+
+/* what is measured at each event */
+enum dispersion_output_t{
+  OUTPUT_TIME, /* s since launch */
+  OUTPUT_ALTITUDE, /* m above the earth's radius */
+  OUTPUT_SPEED, /* m/s */
+  OUTPUT_FLIGHT_PATH_ANGLE, /* rad from the horizon up to the velocity */
+  OUTPUT_MASS, /* kg */
+  DISPERSION_OUTPUT_COUNT
+};
+
+enum dispersion_event_t{
+  AT_STAGING, /* the first stage dropped */
+  AT_INSERTION, /* the last stage burnt out */
+  DISPERSION_EVENT_COUNT
+};
+
+/* uncertain flight parameters, the covariance starts at zero so every
+ * parameter is known exactly until given a variance
+ */
+struct FlightDispersion{
+  FlightParameters<double> mean;
+  double covariance[FLIGHT_PARAMETER_COUNT][FLIGHT_PARAMETER_COUNT];
+
+  explicit FlightDispersion(const FlightParameters<double> &mean);
+};
+
+/* independent uncertain flight parameters, each with a distribution of its
+ * own, those left fixed keep their value in base
+ */
+struct FlightDistributions{
+  FlightParameters<double> base;
+  InputDistribution input[FLIGHT_PARAMETER_COUNT];
+
+  explicit FlightDistributions(const FlightParameters<double> &base);
+
+  /* inputs that are not fixed, one sampler dimension each in parameter order */
+  unsigned int varying() const;
+};
+
+struct DispersionOptions{
+  double dt;
+  double end_time; /* an event not reached by then is taken at end_time */
+  unsigned int threads;
+  /* the scaled unscented transform: alpha spreads the sigma points, beta of
+   * 2 is exact for the fourth moments of a gaussian and kappa adds weight to
+   * the centre point
+   */
+  double alpha;
+  double beta;
+  double kappa;
+
+  DispersionOptions();
+};
+
+struct DispersionOutcome{
+  double value[DISPERSION_EVENT_COUNT][DISPERSION_OUTPUT_COUNT];
+};
+
+struct DispersionStatistics{
+  double mean[DISPERSION_EVENT_COUNT][DISPERSION_OUTPUT_COUNT];
+  double covariance[DISPERSION_EVENT_COUNT][DISPERSION_OUTPUT_COUNT][DISPERSION_OUTPUT_COUNT];
+  unsigned int flights;
+  double seconds;
+};
+
+/* fly one flight to its events */
+void flyToEvents(const FlightParameters<double> &parameters, const DispersionOptions &options, DispersionOutcome *out);
+
+/* the 2n+1 sigma point flights, false if the covariance is not positive
+ * definite over the parameters that vary or alpha and kappa leave the
+ * sigma points no spread
+ */
+bool unscentedDispersion(const FlightDispersion &inputs, const DispersionOptions &options, DispersionStatistics *out);
+
+/* flights drawn from a gaussian, sample i is the same whatever the thread
+ * count, false as for unscentedDispersion
+ */
+bool monteCarloDispersion(const FlightDispersion &inputs, unsigned int samples, unsigned long seed,
+    const DispersionOptions &options, DispersionStatistics *out);
+
+/* the parameters at a point of the unit cube, one coordinate per varying
+ * input in parameter order
+ */
+void flightFromUnit(const FlightDistributions &inputs, const double u[], FlightParameters<double> *out);
+
+/* the parameters of point index of the sampler's design */
+void drawFlight(const FlightDistributions &inputs, const Sampler &sampler, size_t index, FlightParameters<double> *out);
+
+/* points first to first + count of the sampler's design, false if the
+ * sampler does not have a dimension per varying input or count is under 2
+ */
+bool sampledDispersion(const FlightDistributions &inputs, const Sampler &sampler, size_t first, size_t count,
+    const DispersionOptions &options, DispersionStatistics *out);
+
+/* add the statistics of a shard to total, as if they had been flown
+ * together, a total of 0 flights takes the shard as it is
+ */
+void mergeDispersion(const DispersionStatistics &shard, DispersionStatistics *total);
+
+const char *dispersionOutputName(unsigned int output);
+
+const char *dispersionEventName(unsigned int event);
+
+#endif
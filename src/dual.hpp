@@ -0,0 +1,169 @@
+#ifndef RSIM_DUAL_HPP
+#define RSIM_DUAL_HPP
+/* forward mode automatic differentiation
+ *
+ * A Dual<N> carries a value together with its derivatives along N directions,
+ * so one evaluation of a templated function gives the value and N directional
+ * derivatives at once. Comparisons only look at the value, which is what
+ * branches in the model should depend on.
+ */
+
+#include <cmath>
+
+template<unsigned int N>
+struct Dual{
+  double value;
+  double d[N];
+
+  Dual():
+    value(0.0){
+      for(unsigned int i = 0; i < N; ++i){
+        d[i] = 0.0;
+      }
+    }
+
+  /* constants have no derivative */
+  Dual(double value):
+    value(value){
+      for(unsigned int i = 0; i < N; ++i){
+        d[i] = 0.0;
+      }
+    }
+
+  /* an input, seeded with derivative 1 along direction */
+  static Dual variable(double value, unsigned int direction){
+    Dual out(value);
+    out.d[direction] = 1.0;
+    return out;
+  }
+
+  Dual &operator+=(const Dual &other){
+    value += other.value;
+    for(unsigned int i = 0; i < N; ++i){
+      d[i] += other.d[i];
+    }
+    return *this;
+  }
+
+  Dual &operator-=(const Dual &other){
+    value -= other.value;
+    for(unsigned int i = 0; i < N; ++i){
+      d[i] -= other.d[i];
+    }
+    return *this;
+  }
+
+  Dual &operator*=(const Dual &other){
+    for(unsigned int i = 0; i < N; ++i){
+      d[i] = d[i]*other.value + value*other.d[i];
+    }
+    value *= other.value;
+    return *this;
+  }
+
+  Dual &operator*=(double scale){
+    value *= scale;
+    for(unsigned int i = 0; i < N; ++i){
+      d[i] *= scale;
+    }
+    return *this;
+  }
+
+  Dual &operator/=(const Dual &other){
+    const double inverse = 1.0/other.value;
+    value *= inverse;
+    for(unsigned int i = 0; i < N; ++i){
+      d[i] = (d[i] - value*other.d[i])*inverse;
+    }
+    return *this;
+  }
+};
+
+template<unsigned int N>
+inline Dual<N> operator-(const Dual<N> &a){
+  Dual<N> out;
+  out.value = -a.value;
+  for(unsigned int i = 0; i < N; ++i){
+    out.d[i] = -a.d[i];
+  }
+  return out;
+}
+
+template<unsigned int N>
+inline Dual<N> operator+(Dual<N> a, const Dual<N> &b){ return a += b; }
+template<unsigned int N>
+inline Dual<N> operator+(Dual<N> a, double b){ a.value += b; return a; }
+template<unsigned int N>
+inline Dual<N> operator+(double a, Dual<N> b){ b.value += a; return b; }
+
+template<unsigned int N>
+inline Dual<N> operator-(Dual<N> a, const Dual<N> &b){ return a -= b; }
+template<unsigned int N>
+inline Dual<N> operator-(Dual<N> a, double b){ a.value -= b; return a; }
+template<unsigned int N>
+inline Dual<N> operator-(double a, const Dual<N> &b){ Dual<N> out = -b; out.value += a; return out; }
+
+template<unsigned int N>
+inline Dual<N> operator*(Dual<N> a, const Dual<N> &b){ return a *= b; }
+template<unsigned int N>
+inline Dual<N> operator*(Dual<N> a, double b){ return a *= b; }
+template<unsigned int N>
+inline Dual<N> operator*(double a, Dual<N> b){ return b *= a; }
+
+template<unsigned int N>
+inline Dual<N> operator/(Dual<N> a, const Dual<N> &b){ return a /= b; }
+template<unsigned int N>
+inline Dual<N> operator/(Dual<N> a, double b){ return a *= 1.0/b; }
+template<unsigned int N>
+inline Dual<N> operator/(double a, const Dual<N> &b){ return Dual<N>(a) /= b; }
+
+#define RSIM_DUAL_COMPARISON(op) \
+  template<unsigned int N> inline bool operator op(const Dual<N> &a, const Dual<N> &b){ return a.value op b.value; } \
+  template<unsigned int N> inline bool operator op(const Dual<N> &a, double b){ return a.value op b; } \
+  template<unsigned int N> inline bool operator op(double a, const Dual<N> &b){ return a op b.value; }
+
+RSIM_DUAL_COMPARISON(<)
+RSIM_DUAL_COMPARISON(>)
+RSIM_DUAL_COMPARISON(<=)
+RSIM_DUAL_COMPARISON(>=)
+
+#undef RSIM_DUAL_COMPARISON
+
+/* apply the chain rule for f(a) with f'(a) = slope */
+template<unsigned int N>
+inline Dual<N> chain(const Dual<N> &a, double value, double slope){
+  Dual<N> out;
+  out.value = value;
+  for(unsigned int i = 0; i < N; ++i){
+    out.d[i] = slope*a.d[i];
+  }
+  return out;
+}
+
+template<unsigned int N>
+inline Dual<N> sqrt(const Dual<N> &a){
+  const double root = std::sqrt(a.value);
+  return chain(a,root,0.5/root);
+}
+
+template<unsigned int N>
+inline Dual<N> sin(const Dual<N> &a){
+  return chain(a,std::sin(a.value),std::cos(a.value));
+}
+
+template<unsigned int N>
+inline Dual<N> cos(const Dual<N> &a){
+  return chain(a,std::cos(a.value),-std::sin(a.value));
+}
+
+/* the plain value of a scalar, for branching and output */
+inline double scalarValue(double x){
+  return x;
+}
+
+template<unsigned int N>
+inline double scalarValue(const Dual<N> &x){
+  return x.value;
+}
+
+#endif
@@ -0,0 +1,413 @@
+#ifndef RSIM_FLIGHTMODEL_HPP
+#define RSIM_FLIGHTMODEL_HPP
+/* the rocket's equations of motion and mass properties written once for any
+ * scalar type, so the same code runs on doubles for the simulation and on
+ * dual numbers when derivatives of the flight are wanted
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "common.hpp"
+#include "earth.hpp"
+#include "vehicle.hpp"
+
+/* layout of the 20 entry rigid body state */
+static const unsigned int STATE_POSITION_START = 0;
+static const unsigned int STATE_POSITION_SIZE = 3;
+static const unsigned int STATE_ROTATION_START = 3;
+static const unsigned int STATE_ROTATION_SIZE = 9;
+static const unsigned int STATE_LINEAR_MOMENTUM_START = 12;
+static const unsigned int STATE_LINEAR_MOMENTUM_SIZE = 3;
+static const unsigned int STATE_ANGULAR_MOMENTUM_START = 15;
+static const unsigned int STATE_ANGULAR_MOMENTUM_SIZE = 3;
+static const unsigned int STATE_MASS = 19;
+static const unsigned int RIGID_BODY_STATE_SIZE = 20;
+
+/* inputs of a flight that derivatives can be taken with respect to */
+enum flight_parameter_t{
+  PARAMETER_PITCH_TIME, /* seconds after launch the thrust tilts over */
+  PARAMETER_KICK_ANGLE, /* tilt of the thrust from vertical in radians */
+  PARAMETER_STAGE1_FUEL, /* fuel burned before staging, kg */
+  PARAMETER_STAGE2_FUEL, /* fuel carried up by the second stage, kg */
+  PARAMETER_ISP_SEA_LEVEL, /* first stage engines at sea level, s */
+  PARAMETER_ISP_VACUUM, /* first stage engines above the karman line, s */
+  PARAMETER_ISP_MERLINVAC, /* second stage engine in vacuum, s */
+  PARAMETER_DRAG, /* linear drag, kg/s of momentum lost per m/s of velocity */
+  FLIGHT_PARAMETER_COUNT
+};
+
+/* the values override the vehicle's first two stages, later stages fly as
+ * the vehicle describes them
+ */
+template<typename T>
+struct FlightParameters{
+  T value[FLIGHT_PARAMETER_COUNT];
+  const Vehicle *vehicle;
+
+  /* the defaults reproduce the vehicle as described, by default the
+   * original falcon 9 flight
+   */
+  explicit FlightParameters(const Vehicle &vehicle = falcon9()):
+    vehicle(&vehicle){
+    const unsigned int second = vehicle.stages > 1 ? 1 : 0;
+    value[PARAMETER_PITCH_TIME] = 20.0;
+    value[PARAMETER_KICK_ANGLE] = M_PI/32;
+    value[PARAMETER_STAGE1_FUEL] = vehicle.mass_fuel[0];
+    value[PARAMETER_STAGE2_FUEL] = vehicle.mass_fuel[second];
+    value[PARAMETER_ISP_SEA_LEVEL] = vehicle.isp_sea_level[0];
+    value[PARAMETER_ISP_VACUUM] = vehicle.isp_vacuum[0];
+    value[PARAMETER_ISP_MERLINVAC] = vehicle.isp_vacuum[second];
+    value[PARAMETER_DRAG] = 0.05;
+  }
+
+  T &operator[](unsigned int i){ return value[i]; }
+  const T &operator[](unsigned int i) const { return value[i]; }
+};
+
+/* the vehicle with the flight parameters applied, flattened once per flight
+ * so the stage logic indexes it by stage instead of branching on it
+ * Index s is the stage Rocket::getStageProgress calls s + 1, index stages is
+ * the payload left on its own with no engine. Heights are measured from the
+ * bottom of the stage that is burning.
+ */
+template<typename T>
+struct StageTable{
+  unsigned int stages;
+  double radius;
+  T launch_mass;
+
+  /* engines */
+  double mass_flow[VEHICLE_MAX_STAGES + 1];
+  T isp_sea_level[VEHICLE_MAX_STAGES + 1];
+  T isp_vacuum[VEHICLE_MAX_STAGES + 1];
+
+  /* masses, the stage drops when the total reaches burnout */
+  T mass_above[VEHICLE_MAX_STAGES + 1]; /* everything on top, tanks full */
+  T burnout[VEHICLE_MAX_STAGES + 1];
+
+  /* the burning stage as a cylinder, inertia per kg */
+  double centre[VEHICLE_MAX_STAGES + 1];
+  double transverse[VEHICLE_MAX_STAGES + 1];
+  double axial;
+
+  /* sums over everything on top: mass times height, times height squared
+   * and the cylinder inertia of each part about its own centre
+   */
+  T moment_above[VEHICLE_MAX_STAGES + 1];
+  T second_moment_above[VEHICLE_MAX_STAGES + 1];
+  T transverse_above[VEHICLE_MAX_STAGES + 1];
+  T axial_above[VEHICLE_MAX_STAGES + 1];
+};
+
+template<typename T>
+void buildStageTable(const FlightParameters<T> &parameters, StageTable<T> *table){
+  const Vehicle &vehicle = *parameters.vehicle;
+  const unsigned int n = vehicle.stages;
+  const double radius = vehicle.radius;
+  table->stages = n;
+  table->radius = radius;
+  table->axial = radius*radius/2.0;
+
+  /* the payload is one more part without fuel or engine */
+  T fuel[VEHICLE_MAX_STAGES + 1];
+  double empty[VEHICLE_MAX_STAGES + 1];
+  double height[VEHICLE_MAX_STAGES + 1];
+  for(unsigned int s = 0; s < n; ++s){
+    fuel[s] = vehicle.mass_fuel[s];
+    empty[s] = vehicle.mass_empty[s];
+    height[s] = vehicle.height[s];
+    table->mass_flow[s] = vehicle.mass_flow[s];
+    table->isp_sea_level[s] = vehicle.isp_sea_level[s];
+    table->isp_vacuum[s] = vehicle.isp_vacuum[s];
+  }
+  fuel[n] = 0.0;
+  empty[n] = vehicle.payload_mass;
+  height[n] = vehicle.payload_height;
+  table->mass_flow[n] = 0.0;
+  table->isp_sea_level[n] = 0.0;
+  table->isp_vacuum[n] = 0.0;
+
+  fuel[0] = parameters[PARAMETER_STAGE1_FUEL];
+  table->isp_sea_level[0] = parameters[PARAMETER_ISP_SEA_LEVEL];
+  table->isp_vacuum[0] = parameters[PARAMETER_ISP_VACUUM];
+  if(n > 1){
+    /* the second stage's curve keeps its shape, moved to the new vacuum end */
+    fuel[1] = parameters[PARAMETER_STAGE2_FUEL];
+    table->isp_sea_level[1] = table->isp_sea_level[1] + (parameters[PARAMETER_ISP_MERLINVAC] - vehicle.isp_vacuum[1]);
+    table->isp_vacuum[1] = parameters[PARAMETER_ISP_MERLINVAC];
+  }
+
+  /* down from the payload, the sums are kept from the bottom of the stack and
+   * moved to the bottom of each stage
+   */
+  T mass = 0.0, moment = 0.0, second_moment = 0.0, transverse = 0.0, axial = 0.0;
+  for(int s = n; s >= 0; --s){
+    const double base = vehicle.base[s];
+    table->mass_above[s] = mass;
+    table->burnout[s] = mass + empty[s];
+    table->moment_above[s] = moment - base*mass;
+    table->second_moment_above[s] = second_moment - 2.0*base*moment + base*base*mass;
+    table->transverse_above[s] = transverse;
+    table->axial_above[s] = axial;
+    table->centre[s] = height[s]/2.0;
+    table->transverse[s] = (3.0*radius*radius + height[s]*height[s])/12.0;
+
+    const T part = empty[s] + fuel[s];
+    const double centre = base + table->centre[s];
+    mass += part;
+    moment += part*centre;
+    second_moment += part*centre*centre;
+    transverse += part*table->transverse[s];
+    axial += part*table->axial;
+  }
+  table->launch_mass = mass;
+}
+
+/* everything besides the state that the derivative depends on */
+template<typename T>
+struct BodyProperties{
+  double mass_flow; /* kg/s, negative while burning */
+  T thrust_direction[3];
+  T centre_of_mass[3];
+  T inertia_tensor[9];
+  T isp_sea_level;
+  T isp_vacuum;
+  T drag; /* the drag force is -drag times the velocity */
+};
+
+/* height of the karman line above sea level, where the isp curves end */
+static const double karman_line = 100000.0;
+
+/* thrust along the thrust direction at a distance dist from the earth's centre */
+template<typename T>
+T thrustMagnitude(const T &dist, const BodyProperties<T> &body){
+  /* specific impulse based on distance from sealevel
+   * the karman line begins at 100km, clamped outside of it
+   */
+  T Isp;
+  const T level = (dist - earth.radius)/karman_line;
+  if(level < 0){
+    Isp = body.isp_sea_level;
+  }else if(level > 1){
+    Isp = body.isp_vacuum;
+  }else{
+    Isp = level*(body.isp_vacuum - body.isp_sea_level) + body.isp_sea_level;
+  }
+  return -9.81*body.mass_flow*Isp;
+}
+
+/* what a stretch of flight needs the derivative to compute, fixed from one
+ * phase change to the next so each variant below is compiled without the
+ * work and the branches the others need
+ */
+enum flight_phase_t{
+  PHASE_ATMOSPHERE, /* engines burning, the isp follows the height */
+  PHASE_VACUUM, /* engines burning above the karman line, vacuum isp */
+  PHASE_COAST /* no fuel flowing, so no thrust or torque */
+};
+
+/* the phase a step of length h from y flies in, vacuum only once nothing
+ * within twice the step's reach can be below the karman line
+ */
+template<typename T>
+flight_phase_t flightPhase(const T y[], const BodyProperties<T> &body, double h){
+  using std::sqrt;
+  if(body.mass_flow == 0.0){
+    return PHASE_COAST;
+  }
+  T dist2 = 0.0, momentum2 = 0.0;
+  for(int i = 0; i < 3; ++i){
+    const T d = y[STATE_POSITION_START+i] - earth.position[i];
+    dist2 += d*d;
+    momentum2 += y[STATE_LINEAR_MOMENTUM_START+i]*y[STATE_LINEAR_MOMENTUM_START+i];
+  }
+  const T reach = 2.0*h*sqrt(momentum2)/y[STATE_MASS];
+  if(sqrt(dist2) - earth.radius - reach > karman_line){
+    return PHASE_VACUUM;
+  }
+  return PHASE_ATMOSPHERE;
+}
+
+/* angular velocity w = R Ibody^-1 R^T L, with the inverse of the body
+ * tensor taken from its diagonal
+ */
+template<typename T>
+void angularVelocity(const T R[9], const T L[3], const T inertia_tensor[9], T w[3]){
+  T D[9];
+  for(int i = 0; i < 9; ++i){
+    D[i] = inertia_tensor[i];
+  }
+  D[0] = 1.0/D[0];
+  D[4] = 1.0/D[4];
+  D[8] = 1.0/D[8];
+  T RtL[3];
+  for(int i = 0; i < 3; ++i){
+    RtL[i] = R[0*3+i]*L[0] + R[1*3+i]*L[1] + R[2*3+i]*L[2];
+  }
+  T A[3];
+  for(int i = 0; i < 3; ++i){
+    A[i] = D[i*3+0]*RtL[0] + D[i*3+1]*RtL[1] + D[i*3+2]*RtL[2];
+  }
+  for(int i = 0; i < 3; ++i){
+    w[i] = R[i*3+0]*A[0] + R[i*3+1]*A[1] + R[i*3+2]*A[2];
+  }
+}
+
+/* compute dydt for the rigid body state y in one phase of the flight, the
+ * conditions on PHASE are constant and fold away
+ */
+template<flight_phase_t PHASE, typename T>
+void phaseDerivative(const T y[], T dydt[], const BodyProperties<T> &body){
+  using std::sqrt;
+  const T *x = &y[STATE_POSITION_START];
+  const T *R = &y[STATE_ROTATION_START];
+  const T *P = &y[STATE_LINEAR_MOMENTUM_START];
+  const T *L = &y[STATE_ANGULAR_MOMENTUM_START];
+  const T &m = y[STATE_MASS];
+
+  /* gravity */
+  T gdir[3];
+  for(int i = 0; i < 3; ++i){
+    gdir[i] = earth.position[i] - x[i];
+  }
+  const T dist = sqrt(gdir[0]*gdir[0] + gdir[1]*gdir[1] + gdir[2]*gdir[2]);
+  const T gforce = gravitiational_constant*m*earth.mass/(dist*dist);
+
+  T force[3] = {0.0, 0.0, 0.0};
+  T torque[3] = {0.0, 0.0, 0.0};
+  if(PHASE != PHASE_COAST){
+    /* thrust */
+    const T thrust = PHASE == PHASE_VACUUM ? -9.81*body.mass_flow*body.isp_vacuum : thrustMagnitude(dist,body);
+    for(int i = 0; i < 3; ++i){
+      force[i] = thrust*body.thrust_direction[i];
+    }
+
+    /* torque from thrust, applied at the base of the rocket straight down
+     * the body from the centre of mass
+     */
+    T lever[3];
+    for(int i = 0; i < 3; ++i){
+      lever[i] = -R[i*3+1]*body.centre_of_mass[1];
+    }
+    torque[0] = lever[1]*force[2] - lever[2]*force[1];
+    torque[1] = lever[2]*force[0] - lever[0]*force[2];
+    torque[2] = lever[0]*force[1] - lever[1]*force[0];
+  }
+
+  /* gravity and drag */
+  for(int i = 0; i < 3; ++i){
+    force[i] += gdir[i]*(gforce/dist) - body.drag*P[i]/m;
+  }
+
+  T w[3];
+  angularVelocity(R,L,body.inertia_tensor,w);
+
+  /* dx/dt = P/m */
+  for(unsigned int i = 0; i < STATE_POSITION_SIZE; ++i){
+    dydt[STATE_POSITION_START+i] = P[i]/m;
+  }
+  /* dR/dt = star(w) R */
+  const T star[9] = {
+    0.0, -w[2], w[1],
+    w[2], 0.0, -w[0],
+    -w[1], w[0], 0.0};
+  for(int i = 0; i < 3; ++i){
+    for(int j = 0; j < 3; ++j){
+      dydt[STATE_ROTATION_START+i*3+j] = star[i*3+0]*R[0*3+j] + star[i*3+1]*R[1*3+j] + star[i*3+2]*R[2*3+j];
+    }
+  }
+  /* dP/dt is force, dL/dt is torque */
+  for(int i = 0; i < 3; ++i){
+    dydt[STATE_LINEAR_MOMENTUM_START+i] = force[i];
+    dydt[STATE_ANGULAR_MOMENTUM_START+i] = torque[i];
+  }
+  dydt[18] = 0.0;
+  dydt[STATE_MASS] = body.mass_flow;
+}
+
+/* compute dydt for the rigid body state y anywhere in the flight */
+template<typename T>
+void rigidBodyDerivative(const T y[], T dydt[], const BodyProperties<T> &body){
+  phaseDerivative<PHASE_ATMOSPHERE>(y,dydt,body);
+}
+
+/* cheaper derivative that treats the rocket as a point mass, rotation and
+ * angular momentum are held still since the thrust direction is world fixed
+ */
+template<typename T>
+void pointMassDerivative(const T y[], T dydt[], const BodyProperties<T> &body){
+  using std::sqrt;
+  const T *x = &y[STATE_POSITION_START];
+  const T *P = &y[STATE_LINEAR_MOMENTUM_START];
+  const T &m = y[STATE_MASS];
+
+  T gdir[3];
+  for(int i = 0; i < 3; ++i){
+    gdir[i] = earth.position[i] - x[i];
+  }
+  const T dist = sqrt(gdir[0]*gdir[0] + gdir[1]*gdir[1] + gdir[2]*gdir[2]);
+  const T gforce = gravitiational_constant*m*earth.mass/(dist*dist);
+  const T thrust = thrustMagnitude(dist,body);
+
+  for(unsigned int i = 0; i < RIGID_BODY_STATE_SIZE; ++i){
+    dydt[i] = 0.0;
+  }
+  for(int i = 0; i < 3; ++i){
+    dydt[STATE_POSITION_START+i] = P[i]/m;
+    dydt[STATE_LINEAR_MOMENTUM_START+i] = thrust*body.thrust_direction[i] + gdir[i]*(gforce/dist) - body.drag*P[i]/m;
+  }
+  dydt[STATE_MASS] = body.mass_flow;
+}
+
+/* engines of a stage, stage counted from 1 */
+template<typename T>
+void stageEngine(unsigned int stage, const StageTable<T> &table, BodyProperties<T> *body){
+  body->mass_flow = table.mass_flow[stage - 1];
+  body->isp_sea_level = table.isp_sea_level[stage - 1];
+  body->isp_vacuum = table.isp_vacuum[stage - 1];
+}
+
+/* centre of mass in the body frame for a stage given the current mass, the
+ * burning stage's fuel is spread evenly through it
+ */
+template<typename T>
+void stageCentreOfMass(unsigned int stage, const T &mass, const StageTable<T> &table, T com[3]){
+  const unsigned int s = stage - 1;
+  const T burning = mass - table.mass_above[s];
+  com[0] = table.radius;
+  com[1] = (burning*table.centre[s] + table.moment_above[s])/mass;
+  com[2] = table.radius;
+}
+
+/* body frame inertia tensor for a stage, about the centre of mass com */
+template<typename T>
+void stageInertiaTensor(unsigned int stage, const T &mass, const T com[3], const StageTable<T> &table, T it[9]){
+  const unsigned int s = stage - 1;
+  const T burning = mass - table.mass_above[s];
+  for(int i = 0; i < 9; ++i){
+    it[i] = 0.0;
+  }
+  const T transverse = burning*table.transverse[s] + table.transverse_above[s];
+  const T axial = burning*table.axial + table.axial_above[s];
+
+  /* parallel axis offsets of every part, m|d|^2 with d along the body */
+  const T d = table.centre[s] - com[1];
+  const T offset = burning*d*d + table.second_moment_above[s] - 2.0*com[1]*table.moment_above[s] + com[1]*com[1]*table.mass_above[s];
+  it[0] = transverse + offset;
+  it[4] = transverse;
+  it[8] = axial + offset;
+}
+
+/* direction of thrust after the pitch over, tilted from straight up about z */
+template<typename T>
+void kickDirection(const FlightParameters<T> &parameters, T direction[3]){
+  using std::sin;
+  using std::cos;
+  const T &angle = parameters[PARAMETER_KICK_ANGLE];
+  direction[0] = sin(angle);
+  direction[1] = cos(angle);
+  direction[2] = 0.0;
+}
+
+#endif
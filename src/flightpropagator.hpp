@@ -0,0 +1,202 @@
+#ifndef RSIM_FLIGHTPROPAGATOR_HPP
+#define RSIM_FLIGHTPROPAGATOR_HPP
+/* fixed step propagation of the flight outside of GSL, for any scalar type
+ *
+ * This follows Rocket::step: mass properties are recomputed after every step,
+ * the thrust tilts over at the pitch time and the stages drop when their fuel
+ * runs out. Unlike Rocket::step the events land exactly on a step boundary.
+ */
+
+#include "flightmodel.hpp"
+
+enum flight_event_t{
+  EVENT_NONE,
+  EVENT_PITCH,
+  EVENT_BURNOUT
+};
+
+/* the continuous state together with the discrete flight phase */
+template<typename T>
+struct FlightState{
+  T time;
+  T y[RIGID_BODY_STATE_SIZE];
+  BodyProperties<T> body;
+  StageTable<T> table;
+  unsigned int stage;
+  bool pitched;
+};
+
+template<typename T>
+struct FlightDerivative{
+  typedef void (*type)(const T y[], T dydt[], const BodyProperties<T> &body);
+};
+
+/* the derivative compiled for a phase of the flight */
+template<typename T>
+typename FlightDerivative<T>::type phaseDerivativeFor(flight_phase_t phase){
+  switch(phase){
+    case PHASE_VACUUM:
+      return &phaseDerivative<PHASE_VACUUM,T>;
+    case PHASE_COAST:
+      return &phaseDerivative<PHASE_COAST,T>;
+    default:
+      return &phaseDerivative<PHASE_ATMOSPHERE,T>;
+  }
+}
+
+/* the mass properties the rocket recomputes after every step */
+template<typename T>
+void updateMassProperties(FlightState<T> *state){
+  stageCentreOfMass(state->stage,state->y[STATE_MASS],state->table,state->body.centre_of_mass);
+  stageInertiaTensor(state->stage,state->y[STATE_MASS],state->body.centre_of_mass,state->table,state->body.inertia_tensor);
+}
+
+/* sitting on the pad */
+template<typename T>
+void launchState(const FlightParameters<T> &parameters, FlightState<T> *state){
+  state->time = 0.0;
+  for(unsigned int i = 0; i < RIGID_BODY_STATE_SIZE; ++i){
+    state->y[i] = 0.0;
+  }
+  for(unsigned int i = 0; i < STATE_ROTATION_SIZE; ++i){
+    state->y[STATE_ROTATION_START+i] = identity[i];
+  }
+  buildStageTable(parameters,&state->table);
+  state->y[STATE_MASS] = state->table.launch_mass;
+
+  for(int i = 0; i < 3; ++i){
+    state->body.thrust_direction[i] = y_up[i];
+  }
+  state->body.drag = parameters[PARAMETER_DRAG];
+
+  state->stage = 1;
+  stageEngine(state->stage,state->table,&state->body);
+  state->pitched = false;
+  updateMassProperties(state);
+}
+
+/* the discontinuities of Rocket::step and Rocket::nextstage */
+template<typename T>
+void applyFlightEvent(FlightState<T> *state, flight_event_t event, const FlightParameters<T> &parameters){
+  if(event == EVENT_PITCH){
+    kickDirection(parameters,state->body.thrust_direction);
+    state->pitched = true;
+  }else if(event == EVENT_BURNOUT){
+    state->y[STATE_MASS] = state->table.mass_above[state->stage - 1];
+    ++state->stage;
+    stageEngine(state->stage,state->table,&state->body);
+  }
+  updateMassProperties(state);
+}
+
+/* fuel left before the current stage drops, matching the checks in Rocket::step */
+template<typename T>
+T stageFuel(const FlightState<T> &state){
+  return state.y[STATE_MASS] - state.table.burnout[state.stage - 1];
+}
+
+/* classic fourth order runge kutta, body properties held over the step */
+template<typename T>
+void rk4Step(T y[], const T &h, const BodyProperties<T> &body, typename FlightDerivative<T>::type derivative){
+  const unsigned int N = RIGID_BODY_STATE_SIZE;
+  T k1[N], k2[N], k3[N], k4[N], tmp[N];
+  const T half = h*0.5;
+
+  derivative(y,k1,body);
+  for(unsigned int i = 0; i < N; ++i){
+    tmp[i] = y[i] + half*k1[i];
+  }
+  derivative(tmp,k2,body);
+  for(unsigned int i = 0; i < N; ++i){
+    tmp[i] = y[i] + half*k2[i];
+  }
+  derivative(tmp,k3,body);
+  for(unsigned int i = 0; i < N; ++i){
+    tmp[i] = y[i] + h*k3[i];
+  }
+  derivative(tmp,k4,body);
+  const T sixth = h/6.0;
+  for(unsigned int i = 0; i < N; ++i){
+    y[i] += sixth*(k1[i] + 2.0*k2[i] + 2.0*k3[i] + k4[i]);
+  }
+}
+
+/* step to end_time without looking for events, the phase stays as it is */
+template<typename T>
+void propagatePhase(FlightState<T> *state, double dt, double end_time,
+    typename FlightDerivative<T>::type derivative){
+  while(state->time < end_time){
+    T h = dt;
+    if(end_time - state->time < h){
+      h = end_time - state->time;
+    }
+    rk4Step(state->y,h,state->body,derivative);
+    state->time += h;
+    updateMassProperties(state);
+  }
+}
+
+/* the next step towards end_time, shortened so that an event that falls in
+ * it lands on its end, the step length then carries the event time's
+ * dependence on the parameters
+ */
+template<typename T>
+flight_event_t nextFlightStep(const FlightState<T> &state, const FlightParameters<T> &parameters, double dt, double end_time, T *step){
+  T h = dt;
+  if(end_time - state.time < h){
+    h = end_time - state.time;
+  }
+
+  flight_event_t event = EVENT_NONE;
+  if(state.stage == 1 && !state.pitched){
+    T until_pitch = parameters[PARAMETER_PITCH_TIME] - state.time;
+    if(until_pitch < 0.0){
+      until_pitch = 0.0;
+    }
+    if(until_pitch <= h){
+      h = until_pitch;
+      event = EVENT_PITCH;
+    }
+  }
+  if(state.stage <= state.table.stages){
+    T until_burnout = stageFuel(state)/(-state.body.mass_flow);
+    if(until_burnout < 0.0){
+      until_burnout = 0.0;
+    }
+    if(until_burnout <= h){
+      h = until_burnout;
+      event = EVENT_BURNOUT;
+    }
+  }
+  *step = h;
+  return event;
+}
+
+/* step to end_time with the events landing on step boundaries, the
+ * derivative only changes when the phase of the flight does
+ */
+template<typename T>
+void propagateFlight(FlightState<T> *state, const FlightParameters<T> &parameters, double dt, double end_time){
+  flight_phase_t phase = PHASE_ATMOSPHERE;
+  typename FlightDerivative<T>::type derivative = phaseDerivativeFor<T>(phase);
+  while(state->time < end_time){
+    T h = dt;
+    const flight_event_t event = nextFlightStep(*state,parameters,dt,end_time,&h);
+
+    const flight_phase_t next = flightPhase(state->y,state->body,dt);
+    if(next != phase){
+      phase = next;
+      derivative = phaseDerivativeFor<T>(phase);
+    }
+    rk4Step(state->y,h,state->body,derivative);
+    state->time += h;
+
+    if(event != EVENT_NONE){
+      applyFlightEvent(state,event,parameters);
+    }else{
+      updateMassProperties(state);
+    }
+  }
+}
+
+#endif
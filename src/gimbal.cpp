@@ -0,0 +1,80 @@
+#include "gimbal.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+GimbalSettings::GimbalSettings():
+  limit(5.0*M_PI/180.0),
+  rate(10.0*M_PI/180.0),
+  lag(0.1),
+  frequency(1.0),
+  damping(0.7){
+  }
+
+static double clamp(double value, double limit){
+  return std::min(std::max(value,-limit),limit);
+}
+
+/* the thrust in the body frame, along +y with no deflection */
+static void bodyThrust(const double angles[GIMBAL_STATE_SIZE], double b[3]){
+  b[0] = sin(angles[0])*cos(angles[1]);
+  b[1] = cos(angles[0])*cos(angles[1]);
+  b[2] = sin(angles[1]);
+}
+
+void gimbalThrust(const double R[9], const double angles[GIMBAL_STATE_SIZE], double direction[3]){
+  double b[3];
+  bodyThrust(angles,b);
+  for(int i = 0; i < 3; ++i){
+    direction[i] = R[i*3+0]*b[0] + R[i*3+1]*b[1] + R[i*3+2]*b[2];
+  }
+}
+
+void gimbalRates(const GimbalSettings &settings, const double y[], const double target[3],
+    const BodyProperties<double> &body, double rates[GIMBAL_STATE_SIZE]){
+  const double *x = &y[STATE_POSITION_START];
+  const double *R = &y[STATE_ROTATION_START];
+  const double *L = &y[STATE_ANGULAR_MOMENTUM_START];
+  const double *angles = &y[GIMBAL_START];
+
+  /* the thrust acts at the base, com[1] below the centre of mass along the
+   * long axis a, so its torque is -com[1] thrust (a x direction) and the most
+   * the gimbal can give grows with both
+   */
+  double dist = 0.0;
+  for(int i = 0; i < 3; ++i){
+    dist += (x[i] - earth.position[i])*(x[i] - earth.position[i]);
+  }
+  const double authority = body.mass_flow == 0.0 ? 0.0 : thrustMagnitude(sqrt(dist),body)*body.centre_of_mass[1];
+
+  double command[GIMBAL_STATE_SIZE] = {0.0, 0.0};
+  if(authority > 0.0){
+    /* the error turns the long axis a towards the target, both in the body
+     * frame where a is y
+     */
+    double t[3], l[3];
+    for(int i = 0; i < 3; ++i){
+      t[i] = R[0*3+i]*target[0] + R[1*3+i]*target[1] + R[2*3+i]*target[2];
+      l[i] = R[0*3+i]*L[0] + R[1*3+i]*L[1] + R[2*3+i]*L[2];
+    }
+    const double error[3] = {t[2], 0.0, -t[0]};
+    const double spring = settings.frequency*settings.frequency;
+    const double damper = 2.0*settings.damping*settings.frequency;
+    double torque[3];
+    for(int i = 0; i < 3; ++i){
+      torque[i] = spring*body.inertia_tensor[i*4]*error[i] - damper*l[i];
+    }
+
+    /* y cross the body thrust b is (b[2], 0, -b[0]), the roll about y is
+     * out of the gimbal's reach
+     */
+    const double out = std::max(std::min(-torque[0]/authority,1.0),-1.0);
+    command[1] = clamp(asin(out),settings.limit);
+    const double in = std::max(std::min(torque[2]/(authority*cos(command[1])),1.0),-1.0);
+    command[0] = clamp(asin(in),settings.limit);
+  }
+
+  for(unsigned int k = 0; k < GIMBAL_STATE_SIZE; ++k){
+    rates[k] = clamp((command[k] - angles[k])/settings.lag,settings.rate);
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef RSIM_GIMBAL_HPP
+#define RSIM_GIMBAL_HPP
+/* thrust vector control, the engine swivels on a gimbal under an attitude
+ * controller instead of the thrust being pointed straight where it is wanted
+ *
+ * Two angles tilt the thrust off the body's long axis, the first within the
+ * body's x-y plane and the second out of it. They follow the controller's
+ * command through a first order lag, no faster than the rate limit, and the
+ * command never passes the angle limit. The angles are carried by the
+ * integrator as two more state variables after the rigid body's, so a new
+ * target only changes how fast they move and the thrust turns smoothly.
+ *
+ * The controller is proportional-derivative on the attitude. The torque it
+ * asks for turns the long axis towards the target like a spring of the loop's
+ * natural frequency, damped through the angular momentum, and the command is
+ * the gimbal angles whose thrust gives that torque about the centre of mass.
+ */
+
+#include "flightmodel.hpp"
+
+/* the angles follow the rigid body state */
+static const unsigned int GIMBAL_START = RIGID_BODY_STATE_SIZE;
+static const unsigned int GIMBAL_STATE_SIZE = 2;
+
+struct GimbalSettings{
+  double limit; /* rad either way of the long axis */
+  double rate; /* rad/s */
+  double lag; /* s, time constant of the actuator */
+  double frequency; /* rad/s, natural frequency of the attitude loop */
+  double damping; /* 1 for critical */
+
+  GimbalSettings();
+};
+
+/* world thrust direction for the rotation R and the gimbal angles */
+void gimbalThrust(const double R[9], const double angles[GIMBAL_STATE_SIZE], double direction[3]);
+
+/* how fast the angles y[GIMBAL_START] on move with the controller pointing
+ * the long axis at target, a unit vector in the world
+ */
+void gimbalRates(const GimbalSettings &settings, const double y[], const double target[3],
+    const BodyProperties<double> &body, double rates[GIMBAL_STATE_SIZE]);
+
+#endif
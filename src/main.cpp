@@ -1,39 +1,1115 @@
 // C Standard Libraries
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
+// STD
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
 // GSL
 #include <gsl/gsl_matrix.h>
+#include <gsl/gsl_odeiv2.h>
 
 // Project
 #include "rocket.hpp"
+#include "columnstore.hpp"
+#include "conjunction.hpp"
+#include "constellation.hpp"
 #include "demorocket.hpp"
+#include "dispersion.hpp"
+#include "mixedprecision.hpp"
+#include "parareal.hpp"
+#include "profile.hpp"
+#include "realtime.hpp"
+#include "scheduler.hpp"
+#include "sensitivity.hpp"
+#include "service.hpp"
+#include "subsetsimulation.hpp"
+#include "trace.hpp"
+#include "trajectory.hpp"
+#include "vehicle.hpp"
+
+// what every flight below flies, 'vehicle <file>' replaces the falcon 9
+static Vehicle flight_vehicle = falcon9();
+
+// integrators that can be driven one fixed step at a time
+static const gsl_odeiv2_step_type* stepperByName(const char* name) {
+  if(strcmp(name, "rkf45") == 0) return gsl_odeiv2_step_rkf45;
+  if(strcmp(name, "rk8pd") == 0) return gsl_odeiv2_step_rk8pd;
+  if(strcmp(name, "rk4") == 0) return gsl_odeiv2_step_rk4;
+  if(strcmp(name, "bsimp") == 0) return gsl_odeiv2_step_bsimp;
+  return NULL;
+}
+
+// ways to fly once the engines are off
+static bool coastByName(const char* name, coast_mode_t* mode) {
+  if(strcmp(name, "integrate") == 0) *mode = COAST_INTEGRATE;
+  else if(strcmp(name, "kepler") == 0) *mode = COAST_KEPLER;
+  else if(strcmp(name, "encke") == 0) *mode = COAST_ENCKE;
+  else return false;
+  return true;
+}
+
+// fly without the view, comparing the analytic jacobian to finite differences
+static int checkJacobian(Rocket& rocket) {
+  double worst = 0.0;
+  // through the stagings, off the pad since sea level is where the isp curve
+  // has its kink
+  for(int i = 1; i <= 70000; ++i) {
+    rocket.step();
+    if(i % 1000 == 0) {
+      const double error = rocket.checkJacobian(true);
+      printf("t=%.2f jacobian error %g\n", rocket.getTime(), error);
+      if(error > worst) {
+        worst = error;
+      }
+    }
+  }
+  printf("worst jacobian error %g\n", worst);
+  return worst < 1e-4 ? 0 : 1;
+}
+
+// gradient of the final state from one dual number pass, checked against
+// central differences that need two more flights per parameter, fails if
+// any relative difference is over GRADIENT_TOLERANCE
+static const double GRADIENT_TOLERANCE = 1e-3;
+static int reportGradient(double end_time) {
+  const double dt = 0.01;
+  const FlightParameters<double> parameters(flight_vehicle);
+  // position, linear momentum and mass
+  const unsigned int outputs[] = {0, 1, 2, 12, 13, 14, 19};
+  const unsigned int output_count = sizeof(outputs)/sizeof(outputs[0]);
+
+  FlightSensitivity sensitivity;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  flightSensitivity(parameters, dt, end_time, &sensitivity);
+  const double dual_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  double worst = 0.0;
+  start = std::chrono::steady_clock::now();
+  double centre[RigidBody::STATE_SIZE];
+  simulateFlight(parameters, dt, end_time, centre);
+  for(unsigned int j = 0; j < FLIGHT_PARAMETER_COUNT; ++j) {
+    FlightParameters<double> shifted = parameters;
+    const double h = 1e-6*(fabs(parameters[j]) > 1.0 ? fabs(parameters[j]) : 1.0);
+    double forward[RigidBody::STATE_SIZE];
+    double backward[RigidBody::STATE_SIZE];
+    shifted[j] = parameters[j] + h;
+    simulateFlight(shifted, dt, end_time, forward);
+    shifted[j] = parameters[j] - h;
+    simulateFlight(shifted, dt, end_time, backward);
+
+    printf("d/d %s:\n", flightParameterName(j));
+    for(unsigned int k = 0; k < output_count; ++k) {
+      const unsigned int i = outputs[k];
+      const double numeric = (forward[i] - backward[i])/(2.0*h);
+      const double exact = sensitivity.gradient[i][j];
+      // differences cannot see a change below the rounding of the output
+      const double noise = 1e-10*fabs(centre[i])/h;
+      const double scale = fmax(fmax(fabs(numeric), fabs(exact)), noise);
+      const double error = scale > 0.0 ? fabs(numeric - exact)/scale : 0.0;
+      printf("  y[%2u] dual %14.6e  differences %14.6e\n", i, exact, numeric);
+      if(error > worst) {
+        worst = error;
+      }
+    }
+  }
+  const double difference_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("final position %f %f %f mass %f\n", sensitivity.state[0], sensitivity.state[1], sensitivity.state[2], sensitivity.state[19]);
+  printf("dual pass %.3fs, finite differences %.3fs (%u flights)\n", dual_seconds, difference_seconds, 2*FLIGHT_PARAMETER_COUNT + 1);
+  printf("worst relative difference %g, tolerance %g\n", worst, GRADIENT_TOLERANCE);
+  return worst < GRADIENT_TOLERANCE ? 0 : 1;
+}
+
+// one long flight of a million fine steps, serially and with parareal
+static int reportParareal(unsigned int slices) {
+  const FlightParameters<double> parameters(flight_vehicle);
+  PararealOptions options;
+  options.slices = slices;
+  options.max_iterations = slices;
+  printf("%.0f fine steps of %gs, coarse steps of %gs, %u threads\n",
+      options.end_time/options.fine_dt, options.fine_dt, options.coarse_dt, options.threads);
+
+  double serial[RigidBody::STATE_SIZE];
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  serialFlight(parameters, options, serial);
+  const double serial_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  PararealResult result;
+  pararealFlight(parameters, options, &result);
+
+  double difference = 0.0;
+  for(unsigned int i = 0; i < RigidBody::STATE_SIZE; ++i) {
+    difference = fmax(difference, fabs(result.state[i] - serial[i])/(1.0 + fabs(serial[i])));
+  }
+  printf("serial %.3fs\n", serial_seconds);
+  printf("parareal %.3fs over %u slices, %u iterations%s\n", result.seconds, result.slices,
+      result.iterations, result.converged ? "" : " (not converged)");
+  printf("speedup %.2fx measured, %.2fx with a core per slice\n",
+      serial_seconds/result.seconds, serial_seconds/result.critical_path_seconds);
+  printf("largest relative difference from the serial run %g\n", difference);
+  return result.converged ? 0 : 1;
+}
+
+// flight i of an ensemble, each with its own pitch over
+static FlightParameters<double> ensembleParameters(unsigned int i) {
+  FlightParameters<double> parameters(flight_vehicle);
+  parameters[PARAMETER_PITCH_TIME] += 0.5*i;
+  parameters[PARAMETER_KICK_ANGLE] *= 1.0 + 0.01*i;
+  return parameters;
+}
+
+// fly an ensemble into a column store from every core, then read one column
+// of every run back and check a re-flown run against the store
+static int reportColumnStore(const char* path, unsigned int runs) {
+  const unsigned int steps = 60000;
+  {
+    ColumnStoreWriter store(path);
+    if(!store.isOpen()) {
+      return 1;
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<unsigned int> next(0);
+    std::vector<std::thread> workers;
+    const unsigned int thread_count = std::max(1u, std::min(runs, std::thread::hardware_concurrency()));
+    for(unsigned int t = 0; t < thread_count; ++t) {
+      workers.push_back(std::thread([&]() {
+        for(unsigned int run = next++; run < runs; run = next++) {
+          Rocket rocket(0.01, ensembleParameters(run));
+          RunWriter writer(store, run);
+          for(unsigned int i = 0; i < steps; ++i) {
+            writer.append(rocket);
+            rocket.step();
+          }
+          writer.finish();
+        }
+      }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t) {
+      workers[t].join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%u runs of %u samples on %u threads in %.3fs\n", runs, steps, thread_count, seconds);
+  }
+
+  ColumnStore store(path);
+  if(!store.isOpen()) {
+    return 1;
+  }
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<double> mass;
+  std::vector<size_t> run_start;
+  if(!store.readColumn(COLUMN_MASS, mass, run_start)) {
+    return 1;
+  }
+  const double read_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("read the mass column of %zu runs (%zu samples) in %.4fs\n", store.runCount(), mass.size(), read_seconds);
+
+  // every column of the first run must come back bit for bit
+  std::vector<double> columns[COLUMN_COUNT];
+  uint64_t samples = 0;
+  uint64_t text_bytes = 0;
+  for(unsigned int c = 0; c < COLUMN_COUNT; ++c) {
+    if(!store.readColumn(0, c, columns[c])) {
+      return 1;
+    }
+  }
+  for(size_t r = 0; r < store.runCount(); ++r) {
+    samples += store.run(r).samples;
+  }
+  unsigned int mismatches = 0;
+  Rocket rocket(0.01, ensembleParameters(store.run(0).run_id));
+  for(unsigned int i = 0; i < steps; ++i) {
+    const double* y = rocket.getState()->data;
+    double expected[COLUMN_COUNT];
+    expected[COLUMN_TIME] = rocket.getTime();
+    memcpy(&expected[COLUMN_SX], y, 18*sizeof(double));
+    expected[COLUMN_MASS] = y[19];
+    expected[COLUMN_STAGE] = rocket.getStageProgress();
+    for(unsigned int c = 0; c < COLUMN_COUNT; ++c) {
+      char text[32];
+      text_bytes += snprintf(text, sizeof(text), "%.17g ", expected[c]);
+      if(i >= columns[c].size() || memcmp(&expected[c], &columns[c][i], sizeof(double)) != 0) {
+        ++mismatches;
+      }
+    }
+    rocket.step();
+  }
+
+  FILE* file = fopen(path, "rb");
+  long file_bytes = 0;
+  if(file != NULL) {
+    fseek(file, 0, SEEK_END);
+    file_bytes = ftell(file);
+    fclose(file);
+  }
+  const double raw_bytes = (double)samples*COLUMN_COUNT*sizeof(double);
+  printf("%ld bytes on disk, %.1f bits per value\n", file_bytes, 8.0*file_bytes/(samples*COLUMN_COUNT));
+  printf("%.2fx smaller than raw doubles, %.2fx smaller than lossless text (run 0: %llu bytes)\n",
+      raw_bytes/file_bytes, (double)text_bytes*store.runCount()/file_bytes, (unsigned long long)text_bytes);
+  printf("%u values of run 0 differ from a fresh flight\n", mismatches);
+  return mismatches == 0 && mass.size() == samples ? 0 : 1;
+}
+
+// float lane ensemble against the same flights in double, before the first
+// staging and well after the second
+static int reportMixedPrecision(unsigned int runs) {
+  const double dt = 0.01;
+  const double end_times[] = {150.0, 600.0};
+  std::vector<FlightParameters<double> > parameters;
+  for(unsigned int i = 0; i < runs; ++i) {
+    parameters.push_back(ensembleParameters(i));
+  }
+  std::vector<double> reference(runs*RigidBody::STATE_SIZE);
+  std::vector<double> mixed(runs*RigidBody::STATE_SIZE);
+
+  for(unsigned int e = 0; e < sizeof(end_times)/sizeof(end_times[0]); ++e) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < runs; ++i) {
+      simulateFlight(parameters[i], dt, end_times[e], &reference[i*RigidBody::STATE_SIZE]);
+    }
+    const double double_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    mixedPrecisionEnsemble(&parameters[0], runs, dt, end_times[e], &mixed[0]);
+    const double mixed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double worst_position = 0.0, mean_position = 0.0;
+    double worst_velocity = 0.0, worst_mass = 0.0;
+    for(unsigned int i = 0; i < runs; ++i) {
+      const double* a = &reference[i*RigidBody::STATE_SIZE];
+      const double* b = &mixed[i*RigidBody::STATE_SIZE];
+      double position = 0.0, velocity = 0.0;
+      for(unsigned int k = 0; k < 3; ++k) {
+        position += (a[k] - b[k])*(a[k] - b[k]);
+        const double dv = a[12+k]/a[19] - b[12+k]/b[19];
+        velocity += dv*dv;
+      }
+      worst_position = fmax(worst_position, sqrt(position));
+      mean_position += sqrt(position)/runs;
+      worst_velocity = fmax(worst_velocity, sqrt(velocity));
+      worst_mass = fmax(worst_mass, fabs(a[19] - b[19]));
+    }
+    printf("%u flights to %.0fs: double %.3fs, float lanes %.3fs, %.2fx\n", runs, end_times[e],
+        double_seconds, mixed_seconds, double_seconds/mixed_seconds);
+    printf("  position error mean %.3g m worst %.3g m, velocity worst %.3g m/s, mass worst %.3g kg\n",
+        mean_position, worst_position, worst_velocity, worst_mass);
+  }
+  return 0;
+}
+
+// the unscented transform against Monte Carlo on the same uncertain inputs:
+// fuel loads, engine isp, drag and the pitch over time, with the first stage's
+// sea level and vacuum isp correlated since they are the same engines
+static int reportDispersion(unsigned int samples) {
+  const FlightParameters<double> mean(flight_vehicle);
+  FlightDispersion inputs(mean);
+  double deviation[FLIGHT_PARAMETER_COUNT] = {0.0};
+  deviation[PARAMETER_PITCH_TIME] = 0.5;
+  deviation[PARAMETER_STAGE1_FUEL] = 0.005*mean[PARAMETER_STAGE1_FUEL];
+  deviation[PARAMETER_STAGE2_FUEL] = 0.005*mean[PARAMETER_STAGE2_FUEL];
+  deviation[PARAMETER_ISP_SEA_LEVEL] = 1.0;
+  deviation[PARAMETER_ISP_VACUUM] = 1.0;
+  deviation[PARAMETER_ISP_MERLINVAC] = 1.0;
+  deviation[PARAMETER_DRAG] = 0.1*mean[PARAMETER_DRAG];
+  for(unsigned int i = 0; i < FLIGHT_PARAMETER_COUNT; ++i) {
+    inputs.covariance[i][i] = deviation[i]*deviation[i];
+  }
+  inputs.covariance[PARAMETER_ISP_SEA_LEVEL][PARAMETER_ISP_VACUUM] = 0.8*deviation[PARAMETER_ISP_SEA_LEVEL]*deviation[PARAMETER_ISP_VACUUM];
+  inputs.covariance[PARAMETER_ISP_VACUUM][PARAMETER_ISP_SEA_LEVEL] = inputs.covariance[PARAMETER_ISP_SEA_LEVEL][PARAMETER_ISP_VACUUM];
+
+  const DispersionOptions options;
+  DispersionStatistics unscented, carlo;
+  if(!unscentedDispersion(inputs, options, &unscented) || !monteCarloDispersion(inputs, samples, 1, options, &carlo)) {
+    printf("Covariance of the inputs is not positive definite.\n");
+    return 1;
+  }
+  printf("unscented: %u flights in %.3fs, monte carlo: %u flights in %.3fs, %.1fx\n", unscented.flights, unscented.seconds,
+      carlo.flights, carlo.seconds, carlo.seconds/unscented.seconds);
+
+  for(unsigned int e = 0; e < DISPERSION_EVENT_COUNT; ++e) {
+    printf("at %s:\n", dispersionEventName(e));
+    printf("  %-18s %14s %14s %10s %12s %12s %8s\n", "", "unscented", "monte carlo", "error/se", "sd unscented", "sd carlo", "sd ratio");
+    for(unsigned int i = 0; i < DISPERSION_OUTPUT_COUNT; ++i) {
+      const double sd_unscented = sqrt(unscented.covariance[e][i][i]);
+      const double sd_carlo = sqrt(carlo.covariance[e][i][i]);
+      // the monte carlo mean is only known to within its standard error
+      const double standard_error = sd_carlo/sqrt((double)samples);
+      printf("  %-18s %14.6g %14.6g %10.2f %12.4g %12.4g %8.3f\n", dispersionOutputName(i),
+          unscented.mean[e][i], carlo.mean[e][i],
+          standard_error > 0.0 ? (unscented.mean[e][i] - carlo.mean[e][i])/standard_error : 0.0,
+          sd_unscented, sd_carlo, sd_carlo > 0.0 ? sd_unscented/sd_carlo : 1.0);
+    }
+    // correlations, where a covariance shows whether the shape is right too
+    double worst = 0.0;
+    for(unsigned int i = 0; i < DISPERSION_OUTPUT_COUNT; ++i) {
+      for(unsigned int j = 0; j < i; ++j) {
+        const double a = unscented.covariance[e][i][j]/sqrt(unscented.covariance[e][i][i]*unscented.covariance[e][j][j]);
+        const double b = carlo.covariance[e][i][j]/sqrt(carlo.covariance[e][i][i]*carlo.covariance[e][j][j]);
+        if(std::isfinite(a) && std::isfinite(b)) {
+          worst = std::max(worst, fabs(a - b));
+        }
+      }
+    }
+    printf("  largest difference of a correlation %.3f\n", worst);
+  }
+  return 0;
+}
+
+// fuel loads, engine isp, drag and the pitch over time each with a
+// distribution of its own
+static FlightDistributions uncertainInputs() {
+  const FlightParameters<double> mean(flight_vehicle);
+  FlightDistributions inputs(mean);
+  const double pitch = mean[PARAMETER_PITCH_TIME];
+  inputs.input[PARAMETER_PITCH_TIME] = InputDistribution(DISTRIBUTION_TRIANGULAR, pitch - 1.0, pitch + 1.0, pitch);
+  inputs.input[PARAMETER_STAGE1_FUEL] = InputDistribution(DISTRIBUTION_NORMAL, mean[PARAMETER_STAGE1_FUEL], 0.005*mean[PARAMETER_STAGE1_FUEL]);
+  inputs.input[PARAMETER_STAGE2_FUEL] = InputDistribution(DISTRIBUTION_NORMAL, mean[PARAMETER_STAGE2_FUEL], 0.005*mean[PARAMETER_STAGE2_FUEL]);
+  inputs.input[PARAMETER_ISP_SEA_LEVEL] = InputDistribution(DISTRIBUTION_NORMAL, mean[PARAMETER_ISP_SEA_LEVEL], 1.0);
+  inputs.input[PARAMETER_ISP_VACUUM] = InputDistribution(DISTRIBUTION_NORMAL, mean[PARAMETER_ISP_VACUUM], 1.0);
+  inputs.input[PARAMETER_ISP_MERLINVAC] = InputDistribution(DISTRIBUTION_UNIFORM, mean[PARAMETER_ISP_MERLINVAC] - 2.0, mean[PARAMETER_ISP_MERLINVAC] + 2.0);
+  inputs.input[PARAMETER_DRAG] = InputDistribution(DISTRIBUTION_LOGNORMAL, mean[PARAMETER_DRAG], 0.1);
+  return inputs;
+}
+
+// the mean at insertion estimated from random, sobol and latin hypercube
+// designs, each flown with several seeds so the spread of the estimates shows
+// the error, at a quarter, half and all of the samples to show how it falls
+static int reportSampling(unsigned int samples) {
+  const unsigned int replicates = 8;
+  const unsigned int sizes = 3;
+  if(samples < 8) {
+    printf("Sampling needs at least 8 samples.\n");
+    return 1;
+  }
+  const FlightDistributions inputs = uncertainInputs();
+
+  const sampler_t kinds[] = {SAMPLER_RANDOM, SAMPLER_SOBOL, SAMPLER_LATIN_HYPERCUBE};
+  const unsigned int kind_count = sizeof(kinds)/sizeof(kinds[0]);
+  size_t size[sizes];
+  for(unsigned int k = 0; k < sizes; ++k) {
+    size[k] = samples >> (sizes - 1 - k);
+  }
+  // estimate[kind][size][replicate] of each output's mean at insertion
+  std::vector<double> estimate(kind_count*sizes*replicates*DISPERSION_OUTPUT_COUNT);
+  const DispersionOptions options;
+  double seconds = 0.0;
+  for(unsigned int k = 0; k < kind_count; ++k) {
+    for(unsigned int r = 0; r < replicates; ++r) {
+      DispersionStatistics total;
+      total.flights = 0;
+      for(unsigned int n = 0; n < sizes; ++n) {
+        DispersionStatistics statistics;
+        if(kinds[k] == SAMPLER_LATIN_HYPERCUBE) {
+          // every size is a design of its own
+          const Sampler sampler(kinds[k], inputs.varying(), size[n], r + 1);
+          sampledDispersion(inputs, sampler, 0, size[n], options, &statistics);
+          seconds += statistics.seconds;
+        } else {
+          // the next shard of the one design, merged into what came before
+          const Sampler sampler(kinds[k], inputs.varying(), samples, r + 1);
+          const size_t first = n == 0 ? 0 : size[n - 1];
+          DispersionStatistics shard;
+          sampledDispersion(inputs, sampler, first, size[n] - first, options, &shard);
+          seconds += shard.seconds;
+          mergeDispersion(shard, &total);
+          statistics = total;
+        }
+        for(unsigned int i = 0; i < DISPERSION_OUTPUT_COUNT; ++i) {
+          estimate[((k*sizes + n)*replicates + r)*DISPERSION_OUTPUT_COUNT + i] = statistics.mean[AT_INSERTION][i];
+        }
+      }
+    }
+  }
+
+  // spread of the replicates' estimates, the error of one of them
+  double spread[kind_count][sizes][DISPERSION_OUTPUT_COUNT];
+  for(unsigned int k = 0; k < kind_count; ++k) {
+    for(unsigned int n = 0; n < sizes; ++n) {
+      for(unsigned int i = 0; i < DISPERSION_OUTPUT_COUNT; ++i) {
+        double sum = 0.0, squares = 0.0;
+        for(unsigned int r = 0; r < replicates; ++r) {
+          const double value = estimate[((k*sizes + n)*replicates + r)*DISPERSION_OUTPUT_COUNT + i];
+          sum += value;
+          squares += value*value;
+        }
+        const double average = sum/replicates;
+        spread[k][n][i] = sqrt(std::max(0.0, (squares - replicates*average*average)/(replicates - 1)));
+      }
+    }
+  }
+
+  printf("mean at insertion from %u seeds each, %.1fs of flights\n", replicates, seconds);
+  printf("  %-18s %6s", "", "n");
+  for(unsigned int k = 0; k < kind_count; ++k) {
+    printf(" %12s", samplerName(kinds[k]));
+  }
+  printf("\n");
+  for(unsigned int i = 0; i < DISPERSION_OUTPUT_COUNT; ++i) {
+    for(unsigned int n = 0; n < sizes; ++n) {
+      printf("  %-18s %6zu", n == 0 ? dispersionOutputName(i) : "", size[n]);
+      for(unsigned int k = 0; k < kind_count; ++k) {
+        printf(" %12.4g", spread[k][n][i]);
+      }
+      printf("\n");
+    }
+    // the error goes as n to this power, and the random runs the same error takes
+    printf("  %-18s %6s", "", "order");
+    // with no spread at all, as for a fixed payload mass, there is nothing to fit
+    const bool spreads = spread[0][sizes - 1][i] > 0.0;
+    for(unsigned int k = 0; k < kind_count; ++k) {
+      if(spreads && spread[k][0][i] > 0.0 && spread[k][sizes - 1][i] > 0.0) {
+        printf(" %12.2f", log(spread[k][0][i]/spread[k][sizes - 1][i])/log((double)size[sizes - 1]/size[0]));
+      } else {
+        printf(" %12s", "-");
+      }
+    }
+    printf("\n  %-18s %6s", "", "runs");
+    for(unsigned int k = 0; k < kind_count; ++k) {
+      if(spreads && spread[k][sizes - 1][i] > 0.0) {
+        const double ratio = spread[0][sizes - 1][i]/spread[k][sizes - 1][i];
+        printf(" %12.0f", samples*ratio*ratio);
+      } else {
+        printf(" %12s", "-");
+      }
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+// how likely the payload is inserted more than km below the nominal
+// altitude, by subset simulation over the same inputs as 'sampling'
+static int reportSubset(unsigned int samples, double km) {
+  const FlightDistributions inputs = uncertainInputs();
+  SubsetOptions options;
+  options.samples = samples;
+  DispersionOutcome nominal;
+  flyToEvents(inputs.base, options.flight, &nominal);
+  const double lowest = nominal.value[AT_INSERTION][OUTPUT_ALTITUDE] - km*1e3;
+  const FailureMargin margin = [lowest](const DispersionOutcome& outcome) {
+    return outcome.value[AT_INSERTION][OUTPUT_ALTITUDE] - lowest;
+  };
+
+  SubsetResult result;
+  if(!subsetSimulation(inputs, margin, options, &result)) {
+    printf("Subset simulation needs more flights per level.\n");
+    return 1;
+  }
+  printf("insertion more than %g km below %.1f km: probability %.3g, coefficient of variation %.2f\n", km,
+      nominal.value[AT_INSERTION][OUTPUT_ALTITUDE]*1e-3, result.probability, result.variation);
+  printf("%u levels, %u flights in %.1fs\n", result.levels, result.flights, result.seconds);
+  for(unsigned int l = 0; l < result.levels; ++l) {
+    printf("  level %u: %9.3f km below nominal", l, km - result.thresholds[l]*1e-3);
+    if(l > 0) {
+      printf(", chains kept %.0f%% of their steps", 100.0*result.acceptance[l - 1]);
+    }
+    printf("\n");
+  }
+  // flights plain monte carlo would need for the same coefficient of variation
+  if(result.probability > 0.0 && result.variation > 0.0) {
+    const double p = result.probability;
+    printf("monte carlo would need about %.3g flights for the same error\n", (1.0 - p)/(p*result.variation*result.variation));
+  }
+  return 0;
+}
+
+// the coast after the last burnout flown four ways from the same insertion:
+// integrated at the flight's step as the reference, Encke at the same step,
+// Encke jumping to the end at once and Kepler ignoring the drag
+static int reportCoast(double seconds) {
+  const double dt = 0.01;
+  const coast_mode_t modes[] = {COAST_INTEGRATE, COAST_ENCKE, COAST_ENCKE, COAST_KEPLER};
+  const bool jump[] = {false, false, true, true};
+  const char* names[] = {"integrated", "encke stepped", "encke jump", "kepler jump"};
+  const unsigned int count = sizeof(modes)/sizeof(modes[0]);
+  double end[count][RigidBody::STATE_SIZE];
+  double insertion = 0.0;
+  for(unsigned int k = 0; k < count; ++k) {
+    Rocket rocket(dt, FlightParameters<double>(flight_vehicle));
+    rocket.setCoast(modes[k]);
+    while(rocket.getStageProgress() <= flight_vehicle.stages) {
+      rocket.step();
+    }
+    insertion = rocket.getTime();
+    const double end_time = insertion + seconds;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if(jump[k]) {
+      if(!rocket.coastTo(end_time)) {
+        printf("%s: could not coast\n", names[k]);
+        return 1;
+      }
+    } else {
+      while(rocket.getTime() < end_time - 0.5*dt) {
+        rocket.step();
+      }
+    }
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    memcpy(end[k], rocket.getState()->data, sizeof(end[k]));
+
+    double position = 0.0, velocity = 0.0;
+    for(unsigned int i = 0; i < 3; ++i) {
+      position += (end[k][i] - end[0][i])*(end[k][i] - end[0][i]);
+      const double dv = end[k][12+i]/end[k][19] - end[0][12+i]/end[0][19];
+      velocity += dv*dv;
+    }
+    printf("%-14s %10.4fs  position off by %10.4g m, velocity by %10.4g m/s\n", names[k], elapsed, sqrt(position), sqrt(velocity));
+  }
+  printf("coast of %gs from insertion at %.2fs\n", seconds, insertion);
+  return 0;
+}
+
+// satellites in walker shells of circular orbits, to stand in for a fleet
+static void addWalkerShells(unsigned int objects, Constellation& constellation) {
+  const double mu = gravitiational_constant*earth.mass;
+  // altitude, inclination in degrees and planes of each shell, the 98.2
+  // degree shell turns its node with the sun
+  const double shells[][3] = {{550e3, 53.0, 72}, {570e3, 70.0, 36}, {700e3, 98.2, 18}, {1200e3, 87.9, 12}};
+  const unsigned int shell_count = sizeof(shells)/sizeof(shells[0]);
+  for(unsigned int k = 0; k < objects; ++k) {
+    const double* shell = shells[k % shell_count];
+    const unsigned int index = k/shell_count;
+    const unsigned int planes = (unsigned int)shell[2];
+    const unsigned int per_plane = std::max(1u, (objects/shell_count + planes - 1)/planes);
+    const double node = 2.0*M_PI*(index % planes)/planes;
+    const double phase = 2.0*M_PI*((index/planes) % per_plane)/per_plane + M_PI*(index % planes)/(planes*per_plane);
+    const double inclination = shell[1]*M_PI/180.0;
+    const double radius = earth.radius + shell[0];
+    const double speed = sqrt(mu/radius);
+    // the ascending node and 90 degrees on in the orbit plane
+    const double N[3] = {cos(node), sin(node), 0.0};
+    const double M[3] = {-sin(node)*cos(inclination), cos(node)*cos(inclination), sin(inclination)};
+    double r[3], v[3];
+    for(unsigned int i = 0; i < 3; ++i) {
+      r[i] = radius*(cos(phase)*N[i] + sin(phase)*M[i]);
+      v[i] = speed*(-sin(phase)*N[i] + cos(phase)*M[i]);
+    }
+    constellation.add(r, v, 0.0);
+  }
+}
+
+// a constellation of walker shells plus the flight's own payload, then where
+// everything is at a few epochs on one thread and on all
+static int reportConstellation(unsigned int objects) {
+  Constellation all, one(1);
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  addWalkerShells(objects, all);
+  addWalkerShells(objects, one);
+
+  Rocket rocket(0.01, FlightParameters<double>(flight_vehicle));
+  while(rocket.getStageProgress() <= flight_vehicle.stages) {
+    rocket.step();
+  }
+  const double* state = rocket.getState()->data;
+  double r[3], v[3];
+  for(unsigned int i = 0; i < 3; ++i) {
+    r[i] = state[i] - earth.position[i];
+    v[i] = state[12+i]/state[19];
+  }
+  if(all.add(r, v, rocket.getTime()) && one.add(r, v, rocket.getTime())) {
+    printf("payload inserted at %.2fs added\n", rocket.getTime());
+  } else {
+    printf("payload inserted at %.2fs is not on a bound orbit, left out\n", rocket.getTime());
+  }
+  printf("%zu objects in %.3fs\n", all.size(),
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+  const size_t count = all.size();
+  std::vector<double> x(count), y(count), z(count), vx(count), vy(count), vz(count);
+  const double epochs[] = {0.0, 3600.0, 86400.0, 30*86400.0, 365*86400.0};
+  for(unsigned int e = 0; e < sizeof(epochs)/sizeof(epochs[0]); ++e) {
+    std::chrono::steady_clock::time_point query = std::chrono::steady_clock::now();
+    one.positionsAt(epochs[e], &x[0], &y[0], &z[0]);
+    const double one_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - query).count();
+    query = std::chrono::steady_clock::now();
+    all.positionsAt(epochs[e], &x[0], &y[0], &z[0]);
+    const double all_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - query).count();
+    query = std::chrono::steady_clock::now();
+    all.statesAt(epochs[e], &x[0], &y[0], &z[0], &vx[0], &vy[0], &vz[0]);
+    const double state_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - query).count();
+    // every satellite should still be at its shell's altitude
+    double lowest = HUGE_VAL, highest = 0.0;
+    for(size_t k = 0; k < objects; ++k) {
+      const double altitude = sqrt(x[k]*x[k] + y[k]*y[k] + z[k]*z[k]) - earth.radius;
+      lowest = std::min(lowest, altitude);
+      highest = std::max(highest, altitude);
+    }
+    printf("at %9.0fs positions in %8.3f ms on one thread, %8.3f ms on %u, with velocities %8.3f ms, altitudes %.0f-%.0f km\n",
+        epochs[e], one_seconds*1e3, all_seconds*1e3, std::max(1u, std::thread::hardware_concurrency()), state_seconds*1e3,
+        lowest*1e-3, highest*1e-3);
+  }
+  return 0;
+}
+
+// the velocities of the walker shells and of a few eccentric orbits against
+// central differences of their positions, over a year of drift
+static int checkConstellation() {
+  Constellation constellation(1);
+  addWalkerShells(400, constellation);
+  const double mu = gravitiational_constant*earth.mass;
+  const double perigees[] = {earth.radius + 300e3, earth.radius + 500e3, earth.radius + 1000e3};
+  const double apogees[] = {earth.radius + 2000e3, earth.radius + 35786e3, earth.radius + 1200e3};
+  const double inclinations[] = {28.5, 63.4, 98.0};
+  for(unsigned int k = 0; k < 3; ++k) {
+    const double a = 0.5*(perigees[k] + apogees[k]);
+    const double speed = sqrt(mu*(2.0/perigees[k] - 1.0/a));
+    const double inclination = inclinations[k]*M_PI/180.0;
+    const double r[3] = {perigees[k], 0.0, 0.0};
+    const double v[3] = {0.0, speed*cos(inclination), speed*sin(inclination)};
+    constellation.add(r, v, 0.0);
+  }
+
+  const size_t count = constellation.size();
+  std::vector<double> x(count), y(count), z(count), vx(count), vy(count), vz(count);
+  std::vector<double> xa(count), ya(count), za(count), xb(count), yb(count), zb(count);
+  const double h = 0.5;
+  const double epochs[] = {0.0, 5400.0, 86400.0, 365*86400.0};
+  double worst = 0.0;
+  for(unsigned int e = 0; e < sizeof(epochs)/sizeof(epochs[0]); ++e) {
+    constellation.statesAt(epochs[e], &x[0], &y[0], &z[0], &vx[0], &vy[0], &vz[0]);
+    constellation.positionsAt(epochs[e] - h, &xa[0], &ya[0], &za[0]);
+    constellation.positionsAt(epochs[e] + h, &xb[0], &yb[0], &zb[0]);
+    double error = 0.0;
+    for(size_t k = 0; k < count; ++k) {
+      const double dx = vx[k] - (xb[k] - xa[k])/(2.0*h);
+      const double dy = vy[k] - (yb[k] - ya[k])/(2.0*h);
+      const double dz = vz[k] - (zb[k] - za[k])/(2.0*h);
+      error = std::max(error, sqrt(dx*dx + dy*dy + dz*dz));
+    }
+    printf("t=%.0fs velocity error %g m/s\n", epochs[e], error);
+    worst = std::max(worst, error);
+  }
+  printf("worst velocity error %g m/s\n", worst);
+  return worst < 1e-2 ? 0 : 1;
+}
+
+// close approaches within the walker shells over a span, checked against
+// every pair at every sample when there are few enough objects for that
+static int reportConjunctions(unsigned int objects, double seconds) {
+  Constellation constellation;
+  addWalkerShells(objects, constellation);
+  ConjunctionOptions options;
+  options.end = seconds;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const std::vector<Conjunction> found = screenConjunctions(constellation, options);
+  const double grid_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%zu approaches within %.1f km among %zu objects over %gs in %.3fs\n", found.size(), options.threshold*1e-3,
+      constellation.size(), seconds, grid_seconds);
+
+  // the closest few
+  std::vector<Conjunction> closest = found;
+  std::sort(closest.begin(), closest.end(), [](const Conjunction& a, const Conjunction& b) { return a.distance < b.distance; });
+  for(size_t k = 0; k < closest.size() && k < 10; ++k) {
+    printf("  %7zu %7zu at %10.3fs  %8.1f m apart at %7.1f m/s\n", closest[k].first, closest[k].second, closest[k].time,
+        closest[k].distance, closest[k].speed);
+  }
+
+  if(objects <= 2000) {
+    start = std::chrono::steady_clock::now();
+    const std::vector<Conjunction> every = screenConjunctionsAllPairs(constellation, options);
+    const double pair_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    bool same = every.size() == found.size();
+    for(size_t k = 0; same && k < every.size(); ++k) {
+      same = every[k].first == found[k].first && every[k].second == found[k].second && every[k].time == found[k].time;
+    }
+    printf("every pair: %zu approaches in %.3fs, %.1fx, %s\n", every.size(), pair_seconds, pair_seconds/grid_seconds,
+        same ? "the same" : "DIFFERENT");
+  }
+  return 0;
+}
+
+// the flight paced to the wall clock, with how well the deadlines were kept
+static int reportRealtime(double rate, const gsl_odeiv2_step_type* stepper, const RealtimeOptions& options) {
+  const double dt = 1.0/rate;
+  Rocket rocket(dt, FlightParameters<double>(flight_vehicle));
+  if(stepper != NULL) {
+    rocket.setStepper(stepper);
+  }
+  RealtimeReport report;
+  if(!runRealtime(rocket, dt, options, &report)) {
+    return 1;
+  }
+  printf("%llu ticks at %g Hz, %llu finished after the next deadline\n",
+      (unsigned long long)report.ticks, rate, (unsigned long long)report.misses);
+  printf("start latency mean %.1f us worst %.1f us, last %.1f us, longest step %.1f us\n",
+      report.mean_latency*1e6, report.worst_latency*1e6, report.behind*1e6, report.worst_step*1e6);
+  for(unsigned int b = 0; b < REALTIME_HISTOGRAM_BINS; ++b) {
+    if(report.histogram[b] == 0) {
+      continue;
+    }
+    if(b + 1 < REALTIME_HISTOGRAM_BINS) {
+      printf("  < %6u us: %llu\n", 1u << b, (unsigned long long)report.histogram[b]);
+    } else {
+      printf(" >= %6u us: %llu\n", 1u << (b - 1), (unsigned long long)report.histogram[b]);
+    }
+  }
+  return 0;
+}
+
+// altitude above the earth's surface and speed of a rocket state
+static void altitudeSpeed(const double* y, double* altitude, double* speed) {
+  double distance = 0.0, momentum = 0.0;
+  for(unsigned int i = 0; i < 3; ++i) {
+    distance += (y[i] - earth.position[i])*(y[i] - earth.position[i]);
+    momentum += y[12+i]*y[12+i];
+  }
+  *altitude = sqrt(distance) - earth.radius;
+  *speed = sqrt(momentum)/y[19];
+}
+
+// the flight with guidance, control and output each on their own rate and
+// adaptive physics between, against the fixed step flight
+static int reportSchedule(double seconds, double guidance_rate, double control_rate, double output_rate,
+    const GimbalSettings* gimbal) {
+  if(!(guidance_rate > 0.0 && control_rate > 0.0 && output_rate > 0.0)) {
+    printf("Rates must be more than 0 Hz.\n");
+    return 1;
+  }
+  const double dt = 0.01;
+  Rocket rocket(dt, FlightParameters<double>(flight_vehicle));
+  rocket.setGimbal(gimbal);
+  Scheduler scheduler([&rocket](double time) { rocket.advanceTo(time); });
+  scheduler.addTask("guidance", 1.0/guidance_rate, [&rocket](double) { rocket.guide(); });
+  scheduler.addTask("control", 1.0/control_rate, [&rocket](double) { rocket.control(); });
+  scheduler.addTask("output", 1.0/output_rate, [&rocket](double time) {
+    double altitude, speed, angles[GIMBAL_STATE_SIZE];
+    altitudeSpeed(rocket.getState()->data, &altitude, &speed);
+    rocket.getGimbalAngles(angles);
+    printf("%10.2fs  altitude %12.1f m  speed %9.2f m/s  stage %u  gimbal %6.2f %6.2f deg\n", time, altitude, speed,
+        rocket.getStageProgress(), angles[0]*180.0/M_PI, angles[1]*180.0/M_PI);
+  });
+  // guidance and control once before the first step, as the fixed step
+  // flight has them from its constructor
+  rocket.control();
+  rocket.guide();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  scheduler.runUntil(seconds);
+  const double scheduled_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  Rocket reference(dt, FlightParameters<double>(flight_vehicle));
+  reference.setGimbal(gimbal);
+  start = std::chrono::steady_clock::now();
+  while(reference.getTime() < seconds - 0.5*dt) {
+    reference.step();
+  }
+  const double fixed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const std::vector<Scheduler::TaskStatistics> tasks = scheduler.statistics();
+  for(size_t k = 0; k < tasks.size(); ++k) {
+    printf("%-9s %8g Hz  %8lu runs  %9.3f ms\n", tasks[k].name.c_str(), tasks[k].period > 0.0 ? 1.0/tasks[k].period : 0.0,
+        tasks[k].runs, tasks[k].seconds*1e3);
+  }
+  const double* y = rocket.getState()->data;
+  const double* z = reference.getState()->data;
+  double position = 0.0;
+  for(unsigned int i = 0; i < 3; ++i) {
+    position += (y[i] - z[i])*(y[i] - z[i]);
+  }
+  double altitude, speed, reference_altitude, reference_speed;
+  altitudeSpeed(y, &altitude, &speed);
+  altitudeSpeed(z, &reference_altitude, &reference_speed);
+  printf("scheduled %lu adaptive steps in %.3fs, fixed %.0f steps of %gs in %.3fs\n", rocket.getAdaptiveSteps(),
+      scheduled_seconds, reference.getTime()/dt, dt, fixed_seconds);
+  printf("at %gs %.1f m apart, altitude %.1f m against %.1f m, speed %.2f m/s against %.2f m/s\n", seconds,
+      sqrt(position), altitude, reference_altitude, speed, reference_speed);
+  return 0;
+}
+
+// the stage tables as loaded, to check a vehicle file against its source
+static void printVehicle(const Vehicle& vehicle) {
+  printf("radius %g m, payload %g kg, %g m\n", vehicle.radius, vehicle.payload_mass, vehicle.payload_height);
+  for(unsigned int s = 0; s < vehicle.stages; ++s) {
+    printf("stage %u: %g m from %g m, %g kg empty, %g kg fuel, %g kg/s, isp %g-%g s\n", s + 1,
+        vehicle.height[s], vehicle.base[s], vehicle.mass_empty[s], vehicle.mass_fuel[s],
+        -vehicle.mass_flow[s], vehicle.isp_sea_level[s], vehicle.isp_vacuum[s]);
+  }
+}
 
 int main(int argc, char** argv) {
   // check for arguments
   bool use_spreadsheet = false;
-  if(argc > 1) {
-    if(strcmp(argv[1], "help") == 0) {
+  const char* record_path = NULL;
+  double simplify_position = 0.0;
+  double simplify_rotation = 0.0;
+  const char* replay_path = NULL;
+  const char* profile_path = "rsim_profile.json";
+  const gsl_odeiv2_step_type* stepper = NULL;
+  bool jacobian_check = false;
+  bool constellation_check = false;
+  double gradient_time = 0.0;
+  unsigned int parareal_slices = 0;
+  unsigned int mixed_precision_runs = 0;
+  const char* columnstore_path = NULL;
+  const char* vehicle_path = NULL;
+  const char* serve_path = NULL;
+  const char* request_path = NULL;
+  const char* request_line = NULL;
+  unsigned int columnstore_runs = 0;
+  unsigned int dispersion_samples = 0;
+  unsigned int sampling_samples = 0;
+  unsigned int subset_samples = 0;
+  double subset_km = 0.0;
+  unsigned int constellation_objects = 0;
+  unsigned int conjunction_objects = 0;
+  double conjunction_seconds = 0.0;
+  double coast_seconds = 0.0;
+  coast_mode_t coast_mode = COAST_ENCKE;
+  bool use_gimbal = false;
+  GimbalSettings gimbal_settings;
+  double realtime_rate = 0.0;
+  RealtimeOptions realtime_options;
+  double schedule_seconds = 0.0;
+  double schedule_rates[3] = {0.0, 0.0, 0.0};
+  for(int i = 1; i < argc; ++i) {
+    if(strcmp(argv[i], "help") == 0) {
       printf("Specify 'spreadsheet' to switch output to an excel-compatible format.\n");
+      printf("Specify 'record <file>' to save the flight for replay.\n");
+      printf("Specify 'simplify <metres> <radians>' to only record what replay needs to stay within those errors.\n");
+      printf("Specify 'replay <file>' to view a recorded flight without simulating it.\n");
+#ifdef RSIM_PROFILE
+      printf("Specify 'profile <file>' to choose where the timing summary is written.\n");
+#endif
+      printf("Specify 'trace <file>' to record a chrome trace of the run.\n");
+      printf("Specify 'stepper <rkf45|rk8pd|rk4|bsimp>' to choose the integrator.\n");
+      printf("Specify 'coast <integrate|kepler|encke>' to choose how the payload flies once its engines stop.\n");
+      printf("Specify 'gimbal' to steer the thrust through a rate and angle limited gimbal under attitude control.\n");
+      printf("Specify 'vehicle <file>' to fly the vehicle described in a file instead of the falcon 9.\n");
+      printf("Specify 'jacobiancheck' to verify the analytic jacobian without the view.\n");
+      printf("Specify 'constellationcheck' to verify constellation velocities against their positions.\n");
+      printf("Specify 'coastcheck <seconds>' to compare the ways to coast over that long after insertion.\n");
+      printf("Specify 'gradient <seconds>' to check derivatives of the flight to its parameters against finite differences.\n");
+      printf("Specify 'parareal <slices>' to compare a parallel in time run against a serial one.\n");
+      printf("Specify 'mixedprecision <runs>' to compare a float lane ensemble against double.\n");
+      printf("Specify 'dispersion <samples>' to compare the unscented transform against a monte carlo of that size.\n");
+      printf("Specify 'sampling <samples>' to compare random, sobol and latin hypercube dispersion of that size.\n");
+      printf("Specify 'subset <flights per level> <km>' to estimate how likely insertion is more than that far below nominal.\n");
+      printf("Specify 'constellation <objects>' to time where that many satellites are at a few epochs.\n");
+      printf("Specify 'conjunctions <objects> <seconds>' to screen that many satellites for close approaches.\n");
+      printf("Specify 'columnstore <file> <runs>' to fly an ensemble into a compressed column store.\n");
+      printf("Specify 'serve <socket>' to run scenarios for clients until a 'shutdown' request.\n");
+      printf("Specify 'request <socket> <request>' to send one request to a running service.\n");
+      printf("Specify 'realtime <hz> <seconds>' to step the flight in time with the wall clock.\n");
+      printf("Specify 'schedule <seconds> <guidance hz> <control hz> <output hz>' to fly with each task on its own rate.\n");
+      printf("Specify 'pin <cpu>' to keep the real time stepping on one core.\n");
+      printf("Specify 'channel <name>' to publish the real time state to shared memory, e.g. '/rsim'.\n");
       return 0;
-    } else if (strcmp(argv[1], "spreadsheet") == 0) {
+    } else if (strcmp(argv[i], "spreadsheet") == 0) {
       use_spreadsheet = true;
-      printf("time sx sy sz lmx lmy lmz amx amy amz mass\n");
+    } else if (strcmp(argv[i], "record") == 0 && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (strcmp(argv[i], "simplify") == 0 && i + 2 < argc) {
+      simplify_position = atof(argv[++i]);
+      simplify_rotation = atof(argv[++i]);
+    } else if (strcmp(argv[i], "replay") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "profile") == 0 && i + 1 < argc) {
+      profile_path = argv[++i];
+#ifndef RSIM_PROFILE
+      fprintf(stderr, "Profiling is not built in, configure with -DRSIM_PROFILE=ON to write %s.\n", profile_path);
+#endif
+    } else if (strcmp(argv[i], "trace") == 0 && i + 1 < argc) {
+      Trace::start(argv[++i]);
+    } else if (strcmp(argv[i], "stepper") == 0 && i + 1 < argc) {
+      stepper = stepperByName(argv[++i]);
+      if(stepper == NULL) {
+        printf("Stepper '%s' not recognized. Try 'help'\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "coast") == 0 && i + 1 < argc) {
+      if(!coastByName(argv[++i], &coast_mode)) {
+        printf("Coast '%s' not recognized. Try 'help'\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "gimbal") == 0) {
+      use_gimbal = true;
+    } else if (strcmp(argv[i], "coastcheck") == 0 && i + 1 < argc) {
+      coast_seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "vehicle") == 0 && i + 1 < argc) {
+      vehicle_path = argv[++i];
+    } else if (strcmp(argv[i], "jacobiancheck") == 0) {
+      jacobian_check = true;
+    } else if (strcmp(argv[i], "constellationcheck") == 0) {
+      constellation_check = true;
+    } else if (strcmp(argv[i], "gradient") == 0 && i + 1 < argc) {
+      gradient_time = atof(argv[++i]);
+    } else if (strcmp(argv[i], "parareal") == 0 && i + 1 < argc) {
+      parareal_slices = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "mixedprecision") == 0 && i + 1 < argc) {
+      mixed_precision_runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "dispersion") == 0 && i + 1 < argc) {
+      dispersion_samples = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "sampling") == 0 && i + 1 < argc) {
+      sampling_samples = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "subset") == 0 && i + 2 < argc) {
+      subset_samples = atoi(argv[++i]);
+      subset_km = atof(argv[++i]);
+    } else if (strcmp(argv[i], "constellation") == 0 && i + 1 < argc) {
+      constellation_objects = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "conjunctions") == 0 && i + 2 < argc) {
+      conjunction_objects = atoi(argv[++i]);
+      conjunction_seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "columnstore") == 0 && i + 2 < argc) {
+      columnstore_path = argv[++i];
+      columnstore_runs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "serve") == 0 && i + 1 < argc) {
+      serve_path = argv[++i];
+    } else if (strcmp(argv[i], "request") == 0 && i + 2 < argc) {
+      request_path = argv[++i];
+      request_line = argv[++i];
+    } else if (strcmp(argv[i], "realtime") == 0 && i + 2 < argc) {
+      realtime_rate = atof(argv[++i]);
+      realtime_options.duration = atof(argv[++i]);
+    } else if (strcmp(argv[i], "schedule") == 0 && i + 4 < argc) {
+      schedule_seconds = atof(argv[++i]);
+      for(unsigned int k = 0; k < 3; ++k) {
+        schedule_rates[k] = atof(argv[++i]);
+      }
+    } else if (strcmp(argv[i], "pin") == 0 && i + 1 < argc) {
+      realtime_options.cpu = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "channel") == 0 && i + 1 < argc) {
+      realtime_options.channel = argv[++i];
     } else {
-      printf("Argument '%s' not recognized. Try 'help'\n", argv[1]);
+      printf("Argument '%s' not recognized. Try 'help'\n", argv[i]);
       return 1;
     }
   }
 
+  // a client only talks to the service, no summary of its own
+  if(request_path != NULL) {
+    return serviceRequest(request_path, request_line);
+  }
 
-  Rocket rocket(0.01);
+  // timing summary of the whole run, written however the run ends
+  RSIM_PROFILE_SUMMARY(profile_path);
+
+  if(vehicle_path != NULL) {
+    std::string error;
+    if(!loadVehicle(vehicle_path, &flight_vehicle, error)) {
+      printf("Vehicle not loaded: %s\n", error.c_str());
+      return 1;
+    }
+    printVehicle(flight_vehicle);
+  }
+
+  if(coast_seconds > 0.0) {
+    return reportCoast(coast_seconds);
+  }
+
+  if(gradient_time > 0.0) {
+    return reportGradient(gradient_time);
+  }
+
+  if(parareal_slices > 0) {
+    return reportParareal(parareal_slices);
+  }
+
+  if(mixed_precision_runs > 0) {
+    return reportMixedPrecision(mixed_precision_runs);
+  }
+
+  if(dispersion_samples > 0) {
+    return reportDispersion(dispersion_samples);
+  }
+
+  if(sampling_samples > 0) {
+    return reportSampling(sampling_samples);
+  }
+
+  if(subset_samples > 0) {
+    return reportSubset(subset_samples, subset_km);
+  }
+
+  if(constellation_check) {
+    return checkConstellation();
+  }
+
+  if(constellation_objects > 0) {
+    return reportConstellation(constellation_objects);
+  }
+
+  if(conjunction_objects > 0) {
+    return reportConjunctions(conjunction_objects, conjunction_seconds);
+  }
+
+  if(realtime_rate > 0.0) {
+    return reportRealtime(realtime_rate, stepper, realtime_options);
+  }
+
+  if(schedule_seconds > 0.0) {
+    return reportSchedule(schedule_seconds, schedule_rates[0], schedule_rates[1], schedule_rates[2],
+        use_gimbal ? &gimbal_settings : NULL);
+  }
+
+  if(serve_path != NULL) {
+    SimulationService service(serve_path, std::thread::hardware_concurrency(), FlightParameters<double>(flight_vehicle));
+    return service.run();
+  }
+
+  if(columnstore_path != NULL && columnstore_runs > 0) {
+    return reportColumnStore(columnstore_path, columnstore_runs);
+  }
+
+  if(replay_path != NULL) {
+    Trajectory trajectory(replay_path);
+    if(!trajectory.isOpen()) {
+      printf("Could not replay '%s'.\n", replay_path);
+      return 1;
+    }
+    return demoReplay(trajectory, &argc, argv);
+  }
+
+  if(use_spreadsheet) {
+    printf("time sx sy sz lmx lmy lmz amx amy amz mass\n");
+  }
+
+  if(flight_vehicle.stages > DEMO_MAX_STAGES) {
+    printf("The viewer draws at most %u stages.\n", DEMO_MAX_STAGES);
+    return 1;
+  }
+
+  TrajectoryWriter* recorder = NULL;
+  if(record_path != NULL) {
+    recorder = new TrajectoryWriter(record_path);
+    if(!recorder->isOpen()) {
+      delete recorder;
+      return 1;
+    }
+    if(simplify_position > 0.0 || simplify_rotation > 0.0) {
+      recorder->simplify(simplify_position, simplify_rotation);
+    }
+  }
+
+  Rocket rocket(0.01, FlightParameters<double>(flight_vehicle));
+  if(stepper != NULL) {
+    rocket.setStepper(stepper);
+  }
+  rocket.setCoast(coast_mode);
+  if(use_gimbal) {
+    rocket.setGimbal(&gimbal_settings);
+  }
+  if(jacobian_check) {
+    delete recorder;
+    return checkJacobian(rocket);
+  }
   rocket.print();
-  int ret = demoRocket(rocket, use_spreadsheet, &argc, argv);
+  int ret = demoRocket(rocket, use_spreadsheet, recorder, &argc, argv);
   if(ret != 0) {
     printf("An error occured.\n");
   } else {
     rocket.print();
   }
 
+  delete recorder;
   return ret;
 }
@@ -17,6 +17,12 @@ namespace RSimView {
   typedef GLuint IndexT;
   typedef GLsizei SizeT;
 
+  /// One vertex as it is laid out in an interleaved GL array buffer.
+  struct InterleavedVertex {
+      FloatT position[3];
+      FloatT normal[3];
+  };
+
   /// Holds onto the points and orderings of a mesh to load into openGL.
   class MeshData {
   public:
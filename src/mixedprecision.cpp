@@ -0,0 +1,245 @@
+#include "mixedprecision.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include "flightpropagator.hpp"
+#include "profile.hpp"
+
+static const unsigned int W = MIXED_PRECISION_LANES;
+static const unsigned int N = RIGID_BODY_STATE_SIZE;
+
+/* the body properties of a group, one float per flight */
+struct LaneBody{
+  float mass_flow[W];
+  float thrust_scale[W]; /* -9.81*mass_flow, times Isp gives the thrust */
+  float isp_sea_level[W];
+  float isp_vacuum[W]; /* from the karman line up */
+  float drag[W];
+  float thrust_direction[3][W];
+  float base[W]; /* thrust point below the centre of mass */
+  float inertia_inverse[9][W]; /* as rigidBodyDerivative takes it */
+};
+
+/* one flight of a group in single precision, relative to the earth's centre */
+struct LaneState{
+  float y[N][W];
+};
+
+static void loadBody(const FlightState<double> flights[], LaneBody *body){
+  for(unsigned int l = 0; l < W; ++l){
+    const BodyProperties<double> &b = flights[l].body;
+    body->mass_flow[l] = b.mass_flow;
+    body->thrust_scale[l] = -9.81*b.mass_flow;
+    body->isp_sea_level[l] = b.isp_sea_level;
+    body->isp_vacuum[l] = b.isp_vacuum;
+    body->drag[l] = b.drag;
+    for(unsigned int i = 0; i < 3; ++i){
+      body->thrust_direction[i][l] = b.thrust_direction[i];
+    }
+    body->base[l] = -b.centre_of_mass[1];
+    for(unsigned int i = 0; i < 9; ++i){
+      body->inertia_inverse[i][l] = b.inertia_tensor[i];
+    }
+    body->inertia_inverse[0][l] = 1.0/b.inertia_tensor[0];
+    body->inertia_inverse[4][l] = 1.0/b.inertia_tensor[4];
+    body->inertia_inverse[8][l] = 1.0/b.inertia_tensor[8];
+  }
+}
+
+/* round a double state to float, positions taken from the earth's centre */
+static void loadState(const double y[N][W], LaneState *state){
+  for(unsigned int i = 0; i < N; ++i){
+    const double offset = i < 3 ? earth.position[i] : 0.0;
+    for(unsigned int l = 0; l < W; ++l){
+      state->y[i][l] = y[i][l] - offset;
+    }
+  }
+}
+
+/* rigidBodyDerivative for every lane at once
+ * The loop has to stay free of branches and of calls such as fmin, and it
+ * writes to a local array so the compiler needs no run time checks that the
+ * output overlaps the input, otherwise it gives up on vectorising.
+ */
+static void laneDerivative(const LaneState &state, const LaneBody &body, float dydt[N][W]){
+  const float GM = gravitiational_constant*earth.mass;
+  const float radius = earth.radius;
+  const float inverse_karman_line = 1.0f/karman_line;
+  const float (*y)[W] = state.y;
+  float out[N][W];
+  for(unsigned int l = 0; l < W; ++l){
+    const float x[3] = {y[0][l], y[1][l], y[2][l]};
+    const float R[9] = {
+      y[3][l], y[4][l], y[5][l],
+      y[6][l], y[7][l], y[8][l],
+      y[9][l], y[10][l], y[11][l]};
+    const float P[3] = {y[12][l], y[13][l], y[14][l]};
+    const float L[3] = {y[15][l], y[16][l], y[17][l]};
+    const float m = y[STATE_MASS][l];
+    /* divides are the slowest lane operations, take each reciprocal once */
+    const float inverse_m = 1.0f/m;
+
+    /* gravity, x is already relative to the earth's centre */
+    const float dist = std::sqrt(x[0]*x[0] + x[1]*x[1] + x[2]*x[2]);
+    const float inverse_dist = 1.0f/dist;
+    const float gravity = GM*m*inverse_dist*inverse_dist*inverse_dist; /* gforce/dist */
+
+    /* thrust, the isp blend clamped to the karman line */
+    float level = (dist - radius)*inverse_karman_line;
+    level = level < 0.0f ? 0.0f : level;
+    level = level > 1.0f ? 1.0f : level;
+    const float thrust = body.thrust_scale[l]*(level*(body.isp_vacuum[l] - body.isp_sea_level[l]) + body.isp_sea_level[l]);
+    float force[3];
+    for(int i = 0; i < 3; ++i){
+      force[i] = thrust*body.thrust_direction[i][l];
+    }
+
+    /* torque from thrust at the base, the base is straight down the body */
+    float lever[3];
+    for(int i = 0; i < 3; ++i){
+      lever[i] = R[i*3+1]*body.base[l];
+    }
+    const float torque[3] = {
+      lever[1]*force[2] - lever[2]*force[1],
+      lever[2]*force[0] - lever[0]*force[2],
+      lever[0]*force[1] - lever[1]*force[0]};
+
+    for(int i = 0; i < 3; ++i){
+      force[i] += -x[i]*gravity - body.drag[l]*P[i]*inverse_m;
+    }
+
+    /* angular velocity w = R Ibody^-1 R^T L */
+    float RtL[3];
+    for(int i = 0; i < 3; ++i){
+      RtL[i] = R[0*3+i]*L[0] + R[1*3+i]*L[1] + R[2*3+i]*L[2];
+    }
+    float A[3];
+    for(int i = 0; i < 3; ++i){
+      A[i] = body.inertia_inverse[i*3+0][l]*RtL[0] + body.inertia_inverse[i*3+1][l]*RtL[1] + body.inertia_inverse[i*3+2][l]*RtL[2];
+    }
+    float w[3];
+    for(int i = 0; i < 3; ++i){
+      w[i] = R[i*3+0]*A[0] + R[i*3+1]*A[1] + R[i*3+2]*A[2];
+    }
+
+    for(int i = 0; i < 3; ++i){
+      out[STATE_POSITION_START+i][l] = P[i]*inverse_m;
+    }
+    const float star[9] = {
+      0.0f, -w[2], w[1],
+      w[2], 0.0f, -w[0],
+      -w[1], w[0], 0.0f};
+    for(int i = 0; i < 3; ++i){
+      for(int j = 0; j < 3; ++j){
+        out[STATE_ROTATION_START+i*3+j][l] = star[i*3+0]*R[0*3+j] + star[i*3+1]*R[1*3+j] + star[i*3+2]*R[2*3+j];
+      }
+    }
+    for(int i = 0; i < 3; ++i){
+      out[STATE_LINEAR_MOMENTUM_START+i][l] = force[i];
+      out[STATE_ANGULAR_MOMENTUM_START+i][l] = torque[i];
+    }
+    out[18][l] = 0.0f;
+    out[STATE_MASS][l] = body.mass_flow[l];
+  }
+  memcpy(dydt,out,sizeof(out));
+}
+
+/* rk4Step with float slopes and double sums, h of 0 leaves a lane alone */
+static void laneStep(double y[N][W], const double h[W], const LaneBody &body){
+  float k1[N][W], k2[N][W], k3[N][W], k4[N][W];
+  double tmp[N][W];
+  LaneState state;
+
+  loadState(y,&state);
+  laneDerivative(state,body,k1);
+  for(unsigned int i = 0; i < N; ++i){
+    for(unsigned int l = 0; l < W; ++l){
+      tmp[i][l] = y[i][l] + 0.5*h[l]*k1[i][l];
+    }
+  }
+  loadState(tmp,&state);
+  laneDerivative(state,body,k2);
+  for(unsigned int i = 0; i < N; ++i){
+    for(unsigned int l = 0; l < W; ++l){
+      tmp[i][l] = y[i][l] + 0.5*h[l]*k2[i][l];
+    }
+  }
+  loadState(tmp,&state);
+  laneDerivative(state,body,k3);
+  for(unsigned int i = 0; i < N; ++i){
+    for(unsigned int l = 0; l < W; ++l){
+      tmp[i][l] = y[i][l] + h[l]*k3[i][l];
+    }
+  }
+  loadState(tmp,&state);
+  laneDerivative(state,body,k4);
+  for(unsigned int i = 0; i < N; ++i){
+    for(unsigned int l = 0; l < W; ++l){
+      y[i][l] += h[l]/6.0*((double) k1[i][l] + 2.0*k2[i][l] + 2.0*k3[i][l] + k4[i][l]);
+    }
+  }
+}
+
+/* one group, lanes past count repeat the last flight and are thrown away */
+static void flyGroup(const FlightParameters<double> parameters[], size_t count, double dt, double end_time, double states[]){
+  FlightState<double> flights[W];
+  const FlightParameters<double> *lane_parameters[W];
+  for(unsigned int l = 0; l < W; ++l){
+    lane_parameters[l] = &parameters[l < count ? l : count - 1];
+    launchState(*lane_parameters[l],&flights[l]);
+  }
+
+  double y[N][W];
+  double h[W];
+  flight_event_t events[W];
+  LaneBody body;
+  bool flying = true;
+  while(flying){
+    flying = false;
+    for(unsigned int l = 0; l < W; ++l){
+      h[l] = 0.0;
+      events[l] = EVENT_NONE;
+      if(flights[l].time < end_time){
+        events[l] = nextFlightStep(flights[l],*lane_parameters[l],dt,end_time,&h[l]);
+        flying = true;
+      }
+      for(unsigned int i = 0; i < N; ++i){
+        y[i][l] = flights[l].y[i];
+      }
+    }
+    if(!flying){
+      break;
+    }
+
+    loadBody(flights,&body);
+    laneStep(y,h,body);
+
+    for(unsigned int l = 0; l < W; ++l){
+      if(h[l] == 0.0 && events[l] == EVENT_NONE){
+        continue;
+      }
+      for(unsigned int i = 0; i < N; ++i){
+        flights[l].y[i] = y[i][l];
+      }
+      flights[l].time += h[l];
+      if(events[l] != EVENT_NONE){
+        applyFlightEvent(&flights[l],events[l],*lane_parameters[l]);
+      }else{
+        updateMassProperties(&flights[l]);
+      }
+    }
+  }
+
+  for(size_t l = 0; l < count && l < W; ++l){
+    memcpy(&states[l*N],flights[l].y,N*sizeof(double));
+  }
+}
+
+void mixedPrecisionEnsemble(const FlightParameters<double> parameters[], size_t count, double dt, double end_time, double states[]){
+  RSIM_PROFILE_SCOPE("mixedPrecisionEnsemble");
+  for(size_t first = 0; first < count; first += W){
+    const size_t group = count - first < W ? count - first : W;
+    flyGroup(&parameters[first],group,dt,end_time,&states[first*N]);
+  }
+}
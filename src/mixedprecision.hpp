@@ -0,0 +1,28 @@
+#ifndef RSIM_MIXEDPRECISION_HPP
+#define RSIM_MIXEDPRECISION_HPP
+/* reduced precision ensembles for rough screening sweeps
+ *
+ * Flights are flown MIXED_PRECISION_LANES at a time in lockstep. The rigid
+ * body derivative of every flight in the group is evaluated at once in single
+ * precision, laid out one float per flight so the compiler turns each line of
+ * the model into vector instructions. Everything that accumulates stays in
+ * double: the state, the runge kutta sums and the time. Positions are turned
+ * into float only relative to the earth's centre and only for the
+ * derivative, so their absolute size near earth.radius never meets float.
+ *
+ * Steps, events and mass properties follow propagateFlight exactly, so the
+ * difference from simulateFlight is the float derivative alone.
+ */
+
+#include <cstddef>
+
+#include "flightmodel.hpp"
+
+static const unsigned int MIXED_PRECISION_LANES = 8;
+
+/* fly count flights from launch to end_time with steps of dt, the final
+ * states are written to count*RIGID_BODY_STATE_SIZE doubles of states
+ */
+void mixedPrecisionEnsemble(const FlightParameters<double> parameters[], size_t count, double dt, double end_time, double states[]);
+
+#endif
@@ -0,0 +1,168 @@
+// Benchmark of LoadObj against LoadObjFast on a generated sphere.
+// usage: objbench [faces in millions] [obj path]
+//        objbench check [obj path], to compare the loaders on a small file
+//        with several materials and groups
+
+// C Standard Libraries
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// STD
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Project
+#include "tiny_obj_loader.h"
+
+// write a uv sphere of quads with normals, roughly 'faces' faces
+static bool writeSphere(const char* path, long faces) {
+  FILE* fid = fopen(path, "w");
+  if(fid == NULL) {
+    return false;
+  }
+  const long rings = (long)sqrt(faces/2.0) + 1;
+  const long segments = 2*rings;
+  const double pi = asin(1.0)*2;
+  fprintf(fid, "# generated by objbench\no Sphere\n");
+  for(long r = 0; r <= rings; ++r) {
+    const double theta = pi*r/rings;
+    for(long s = 0; s < segments; ++s) {
+      const double phi = 2*pi*s/segments;
+      const double x = sin(theta)*cos(phi);
+      const double y = cos(theta);
+      const double z = sin(theta)*sin(phi);
+      fprintf(fid, "v %f %f %f\nvn %f %f %f\n", x, y, z, x, y, z);
+    }
+  }
+  for(long r = 0; r < rings; ++r) {
+    for(long s = 0; s < segments; ++s) {
+      const long a = r*segments + s + 1;
+      const long b = r*segments + (s + 1)%segments + 1;
+      const long c = b + segments;
+      const long d = a + segments;
+      fprintf(fid, "f %ld//%ld %ld//%ld %ld//%ld %ld//%ld\n", a, a, b, b, c, c, d, d);
+    }
+  }
+  fclose(fid);
+  printf("wrote %ld faces to %s\n", rings*segments, path);
+  return true;
+}
+
+// two quads sharing an edge under different materials, then a group and an
+// object of their own, with relative indices
+static bool writeMaterials(const char* path) {
+  FILE* fid = fopen(path, "w");
+  if(fid == NULL) {
+    return false;
+  }
+  fprintf(fid, "# generated by objbench\n"
+      "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 0\nv 2 1 0\n"
+      "vn 0 0 1\nvt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+      "usemtl red\nf 1/1/1 2/2/1 3/3/1 4/4/1\n"
+      "usemtl blue\nf 2/1/1 5/2/1 6/3/1 3/4/1\n"
+      "usemtl red\nf 1/1/1 3/3/1 4/4/1\n"
+      "g side\nf -6/1/1 -5/2/1 -2/3/1\nusemtl blue\nf -5/2/1 -2/3/1 -4/4/1\n"
+      "o lid\nf 3 6 4\nf 4 6 5\n");
+  fclose(fid);
+  return true;
+}
+
+typedef std::string (*load_function)(std::vector<tinyobj::shape_t>&, std::vector<tinyobj::material_t>&, const char*, int);
+
+static std::string loadStream(std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials, const char* path, int) {
+  return tinyobj::LoadObj(shapes, materials, path);
+}
+
+static std::string loadFast(std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials, const char* path, int threads) {
+  return tinyobj::LoadObjFast(shapes, materials, path, NULL, threads);
+}
+
+static double run(const char* label, load_function load, const char* path, int threads, size_t* indices) {
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::string err = load(shapes, materials, path, threads);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if(!err.empty()) {
+    printf("%s failed: %s\n", label, err.c_str());
+    exit(1);
+  }
+  *indices = 0;
+  size_t vertices = 0;
+  for(size_t i = 0; i < shapes.size(); ++i) {
+    *indices += shapes[i].mesh.indices.size();
+    vertices += shapes[i].mesh.positions.size()/3;
+  }
+  printf("%-24s %8.3fs  %zu vertices %zu triangles\n", label, seconds, vertices, *indices/3);
+  return seconds;
+}
+
+// the fast loader is meant to give exactly what LoadObj gives
+static int checkLoaders(const char* path) {
+  if(!writeMaterials(path)) {
+    printf("could not write %s\n", path);
+    return 1;
+  }
+  std::vector<tinyobj::shape_t> expected, shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string err = tinyobj::LoadObj(expected, materials, path);
+  if(err.empty()) {
+    err = tinyobj::LoadObjFast(shapes, materials, path);
+  }
+  if(!err.empty()) {
+    printf("loading failed: %s\n", err.c_str());
+    return 1;
+  }
+  bool same = shapes.size() == expected.size();
+  for(size_t i = 0; same && i < shapes.size(); ++i) {
+    const tinyobj::mesh_t& a = expected[i].mesh;
+    const tinyobj::mesh_t& b = shapes[i].mesh;
+    same = expected[i].name == shapes[i].name && a.positions == b.positions && a.normals == b.normals
+        && a.texcoords == b.texcoords && a.indices == b.indices && a.material_ids == b.material_ids;
+  }
+  for(size_t i = 0; i < expected.size(); ++i) {
+    printf("LoadObj     '%s' %zu vertices %zu triangles\n", expected[i].name.c_str(),
+        expected[i].mesh.positions.size()/3, expected[i].mesh.indices.size()/3);
+  }
+  for(size_t i = 0; i < shapes.size(); ++i) {
+    printf("LoadObjFast '%s' %zu vertices %zu triangles\n", shapes[i].name.c_str(),
+        shapes[i].mesh.positions.size()/3, shapes[i].mesh.indices.size()/3);
+  }
+  printf(same ? "same shapes\n" : "mismatched results\n");
+  return same ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if(argc > 1 && strcmp(argv[1], "check") == 0) {
+    return checkLoaders(argc > 2 ? argv[2] : "objcheck.obj");
+  }
+  const double millions = argc > 1 ? atof(argv[1]) : 2.0;
+  const char* path = argc > 2 ? argv[2] : "objbench.obj";
+  if(!writeSphere(path, (long)(millions*1e6))) {
+    printf("could not write %s\n", path);
+    return 1;
+  }
+
+  int threads = std::thread::hardware_concurrency();
+  if(threads < 1) {
+    threads = 1;
+  }
+
+  size_t stream_indices, fast_indices, parallel_indices;
+  double stream = run("LoadObj", loadStream, path, 1, &stream_indices);
+  double fast = run("LoadObjFast 1 thread", loadFast, path, 1, &fast_indices);
+  char label[64];
+  snprintf(label, sizeof(label), "LoadObjFast %d threads", threads);
+  double parallel = run(label, loadFast, path, threads, &parallel_indices);
+
+  if(stream_indices != fast_indices || stream_indices != parallel_indices) {
+    printf("mismatched results\n");
+    return 1;
+  }
+  printf("speedup %.1fx single threaded, %.1fx with %d threads\n", stream/fast, stream/parallel, threads);
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include "parareal.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "flightpropagator.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+
+PararealOptions::PararealOptions():
+  fine_dt(0.01),
+  coarse_dt(1.0),
+  end_time(10000.0),
+  slices(64),
+  threads(std::max(1u,std::thread::hardware_concurrency())),
+  max_iterations(64),
+  tolerance(1e-9)
+  {}
+
+/* a slice boundary and the event that happens there */
+struct SliceBoundary{
+  double time;
+  flight_event_t event;
+
+  bool operator<(const SliceBoundary &other) const {
+    return time < other.time;
+  }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* uniform boundaries plus one at every event before end_time, events at or
+ * past the end are left out
+ */
+static void sliceBoundaries(const FlightParameters<double> &parameters, const PararealOptions &options, std::vector<SliceBoundary> &boundaries){
+  /* mass flow is constant within a stage, so burnouts are known up front */
+  StageTable<double> table;
+  buildStageTable(parameters,&table);
+  const double pitch_time = std::max(0.0,parameters[PARAMETER_PITCH_TIME]);
+
+  boundaries.clear();
+  for(unsigned int i = 0; i < options.slices; ++i){
+    SliceBoundary boundary = {options.end_time*i/options.slices,EVENT_NONE};
+    boundaries.push_back(boundary);
+  }
+  std::vector<SliceBoundary> events;
+  double burnout = 0.0;
+  double mass = table.launch_mass;
+  for(unsigned int s = 0; s < table.stages; ++s){
+    burnout += (mass - table.burnout[s])/(-table.mass_flow[s]);
+    mass = table.mass_above[s];
+    /* the pitch over only happens while the first stage burns */
+    if(s == 0 && pitch_time < burnout){
+      const SliceBoundary pitch = {pitch_time,EVENT_PITCH};
+      events.push_back(pitch);
+    }
+    const SliceBoundary event = {burnout,EVENT_BURNOUT};
+    events.push_back(event);
+  }
+  for(size_t i = 0; i < events.size(); ++i){
+    if(events[i].time >= options.end_time){
+      continue;
+    }
+    /* move a uniform boundary onto the event if one is very close */
+    bool merged = false;
+    for(size_t b = 1; b < boundaries.size(); ++b){
+      if(fabs(boundaries[b].time - events[i].time) < options.fine_dt){
+        boundaries[b] = events[i];
+        merged = true;
+        break;
+      }
+    }
+    if(!merged){
+      boundaries.push_back(events[i]);
+    }
+  }
+  std::sort(boundaries.begin(),boundaries.end());
+  SliceBoundary end = {options.end_time,EVENT_NONE};
+  boundaries.push_back(end);
+}
+
+/* largest change between two boundary states, relative so positions in
+ * metres and rotations near one are measured alike
+ */
+static double stateChange(const FlightState<double> &a, const FlightState<double> &b){
+  double change = 0.0;
+  for(unsigned int i = 0; i < RIGID_BODY_STATE_SIZE; ++i){
+    change = std::max(change,fabs(a.y[i] - b.y[i])/(1.0 + fabs(b.y[i])));
+  }
+  return change;
+}
+
+static void coarse(FlightState<double> *state, const PararealOptions &options, double end_time){
+  RSIM_PROFILE_SCOPE("parareal coarse");
+  propagatePhase(state,options.coarse_dt,end_time,&pointMassDerivative<double>);
+}
+
+static void fine(FlightState<double> *state, const PararealOptions &options, double end_time){
+  RSIM_PROFILE_SCOPE("parareal fine");
+  RSIM_TRACE_SCOPE("parareal fine");
+  propagatePhase(state,options.fine_dt,end_time,&rigidBodyDerivative<double>);
+}
+
+void pararealFlight(const FlightParameters<double> &parameters, const PararealOptions &options, PararealResult *out){
+  RSIM_PROFILE_SCOPE("pararealFlight");
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<SliceBoundary> boundaries;
+  sliceBoundaries(parameters,options,boundaries);
+  const size_t slices = boundaries.size() - 1;
+
+  /* U[n] is the state at the start of slice n, after its event */
+  std::vector<FlightState<double> > U(slices + 1);
+  std::vector<FlightState<double> > coarse_end(slices);
+  std::vector<FlightState<double> > fine_end(slices);
+  std::vector<double> fine_seconds(slices,0.0);
+
+  /* serial coarse prediction */
+  double critical_path = 0.0;
+  std::chrono::steady_clock::time_point sweep = std::chrono::steady_clock::now();
+  launchState(parameters,&U[0]);
+  applyFlightEvent(&U[0],boundaries[0].event,parameters);
+  for(size_t n = 0; n < slices; ++n){
+    coarse_end[n] = U[n];
+    coarse(&coarse_end[n],options,boundaries[n+1].time);
+    U[n+1] = coarse_end[n];
+    applyFlightEvent(&U[n+1],boundaries[n+1].event,parameters);
+  }
+  critical_path += secondsSince(sweep);
+
+  unsigned int iteration = 0;
+  bool converged = false;
+  while(iteration < options.max_iterations && !converged){
+    /* slices before the iteration count are already exact */
+    const size_t first = iteration;
+    if(first >= slices){
+      converged = true;
+      break;
+    }
+
+    /* refine every slice from the current boundary states at once */
+    std::atomic<size_t> next(first);
+    std::vector<std::thread> workers;
+    const unsigned int thread_count = std::min<size_t>(options.threads,slices - first);
+    for(unsigned int t = 0; t < thread_count; ++t){
+      workers.push_back(std::thread([&](){
+        for(size_t n = next++; n < slices; n = next++){
+          const std::chrono::steady_clock::time_point slice_start = std::chrono::steady_clock::now();
+          fine_end[n] = U[n];
+          fine(&fine_end[n],options,boundaries[n+1].time);
+          fine_seconds[n] = secondsSince(slice_start);
+        }
+      }));
+    }
+    for(size_t t = 0; t < workers.size(); ++t){
+      workers[t].join();
+    }
+    critical_path += *std::max_element(fine_seconds.begin() + first,fine_seconds.end());
+
+    /* serial correction U[n+1] = G(U_new[n]) + F(U_old[n]) - G(U_old[n]) */
+    sweep = std::chrono::steady_clock::now();
+    double change = 0.0;
+    for(size_t n = first; n < slices; ++n){
+      FlightState<double> predicted = U[n];
+      coarse(&predicted,options,boundaries[n+1].time);
+
+      FlightState<double> corrected = predicted;
+      for(unsigned int i = 0; i < RIGID_BODY_STATE_SIZE; ++i){
+        corrected.y[i] += fine_end[n].y[i] - coarse_end[n].y[i];
+      }
+      coarse_end[n] = predicted;
+      applyFlightEvent(&corrected,boundaries[n+1].event,parameters);
+
+      change = std::max(change,stateChange(corrected,U[n+1]));
+      U[n+1] = corrected;
+    }
+    critical_path += secondsSince(sweep);
+    ++iteration;
+    RSIM_PROFILE_COUNT("parareal iterations",1);
+    converged = change < options.tolerance;
+  }
+
+  memcpy(out->state,U[slices].y,RigidBody::STATE_SIZE*sizeof(double));
+  out->iterations = iteration;
+  out->slices = slices;
+  out->converged = converged;
+  out->seconds = secondsSince(start);
+  out->critical_path_seconds = critical_path;
+}
+
+void serialFlight(const FlightParameters<double> &parameters, const PararealOptions &options, double state[]){
+  RSIM_PROFILE_SCOPE("serialFlight");
+  FlightState<double> flight;
+  launchState(parameters,&flight);
+  propagateFlight(&flight,parameters,options.fine_dt,options.end_time);
+  memcpy(state,flight.y,RigidBody::STATE_SIZE*sizeof(double));
+}
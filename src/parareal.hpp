@@ -0,0 +1,49 @@
+#ifndef RSIM_PARAREAL_HPP
+#define RSIM_PARAREAL_HPP
+/* parallel in time integration of one long flight
+ *
+ * The horizon is cut into slices. A cheap coarse propagator (point mass, long
+ * steps) predicts the state at every slice boundary serially, then the full
+ * rigid body propagator refines every slice at once from those predictions
+ * and the difference is fed back through the coarse propagator. After k
+ * iterations the first k slices match the serial run exactly, in practice it
+ * converges in far fewer iterations than there are slices.
+ *
+ * The pitch over and both burnouts happen at times known before the flight,
+ * so they are made into slice boundaries and applied there, which keeps every
+ * slice free of discontinuities.
+ */
+
+#include "flightmodel.hpp"
+#include "rigidbody.hpp"
+
+struct PararealOptions{
+  double fine_dt;
+  double coarse_dt;
+  double end_time;
+  unsigned int slices; /* before the event boundaries are added */
+  unsigned int threads;
+  unsigned int max_iterations;
+  double tolerance; /* largest change of a boundary state, relative to 1 + |y| */
+
+  PararealOptions();
+};
+
+struct PararealResult{
+  double state[RigidBody::STATE_SIZE];
+  unsigned int iterations;
+  unsigned int slices;
+  bool converged;
+  double seconds;
+  /* time the run would take with one core per slice: the coarse sweeps plus
+   * the slowest fine slice of each iteration
+   */
+  double critical_path_seconds;
+};
+
+void pararealFlight(const FlightParameters<double> &parameters, const PararealOptions &options, PararealResult *out);
+
+/* the reference: the whole horizon with the fine propagator on one thread */
+void serialFlight(const FlightParameters<double> &parameters, const PararealOptions &options, double state[]);
+
+#endif
@@ -0,0 +1,243 @@
+#include "planetmesh.hpp"
+
+// C standard library
+#include <cmath>
+
+// STD
+#include <algorithm>
+
+namespace RSimView {
+  /// split a patch when the camera is closer than this many edge lengths
+  static const double SPLIT_DISTANCE = 3.0;
+  /// skirts hang below patch edges to hide cracks between levels
+  static const double SKIRT_DEPTH = 0.05;
+  static const double QUARTER_PI = 0.78539816339744830962;
+  /// deepest level a patch key holds, x and y get 28 bits and depth 5
+  static const int KEY_MAX_DEPTH = 27;
+
+  struct PatchDistance {
+      double distance;
+      size_t index;
+      bool operator<(const PatchDistance& other) const {
+          return distance < other.distance;
+      }
+  };
+
+  PlanetMesh::PlanetMesh(double radius, int patch_resolution, int max_patches, int max_depth)
+      : radius(radius), resolution(patch_resolution), max_patches(max_patches)
+      , max_depth(std::min(std::max(max_depth, 0), KEY_MAX_DEPTH))
+  {
+      buildIndices();
+  }
+
+  const std::vector<uint64_t>& PlanetMesh::selected() const {
+      return selection;
+  }
+
+  const std::vector<IndexT>& PlanetMesh::indices() const {
+      return index_data;
+  }
+
+  SizeT PlanetMesh::patchCount() const {
+      return selection.size();
+  }
+
+  int PlanetMesh::maxPatches() const {
+      return max_patches;
+  }
+
+  uint64_t PlanetMesh::key(const Patch& patch) {
+      return ((uint64_t)patch.face << 61) | ((uint64_t)patch.depth << 56)
+          | ((uint64_t)patch.x << 28) | (uint64_t)patch.y;
+  }
+
+  PlanetMesh::Patch PlanetMesh::patchOf(uint64_t patch_key) {
+      const uint64_t mask = (1ull << 28) - 1;
+      Patch patch = {(int)(patch_key >> 61), (int)((patch_key >> 56) & 31)
+          , (uint32_t)((patch_key >> 28) & mask), (uint32_t)(patch_key & mask)};
+      return patch;
+  }
+
+  void PlanetMesh::direction(const Patch& patch, double s, double t, double out[3]) const {
+      // position on the cube face in [-1,1], warped so patches cover similar areas
+      const double size = 2.0/(double)(1u << patch.depth);
+      const double u = tan((-1.0 + (patch.x + s)*size)*QUARTER_PI);
+      const double v = tan((-1.0 + (patch.y + t)*size)*QUARTER_PI);
+      double p[3];
+      switch(patch.face) {
+      case 0: p[0] =  1; p[1] = v; p[2] = -u; break;
+      case 1: p[0] = -1; p[1] = v; p[2] =  u; break;
+      case 2: p[0] =  u; p[1] =  1; p[2] = -v; break;
+      case 3: p[0] =  u; p[1] = -1; p[2] =  v; break;
+      case 4: p[0] =  u; p[1] = v; p[2] =  1; break;
+      default: p[0] = -u; p[1] = v; p[2] = -1; break;
+      }
+      const double length = sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+      out[0] = p[0]/length;
+      out[1] = p[1]/length;
+      out[2] = p[2]/length;
+  }
+
+  double PlanetMesh::edgeLength(const Patch& patch) const {
+      // each cube face spans a quarter turn of the sphere
+      return radius*2.0*QUARTER_PI/(double)(1u << patch.depth);
+  }
+
+  void PlanetMesh::select(const double camera[3], std::vector<Patch>& leaves) const {
+      const double camera_distance = sqrt(camera[0]*camera[0] + camera[1]*camera[1] + camera[2]*camera[2]);
+      const bool above = camera_distance > radius;
+      const double horizon = above ? acos(radius/camera_distance) : 0.0;
+
+      std::vector<Patch> level;
+      for(int face = 0; face < 6; ++face) {
+          Patch root = {face, 0, 0, 0};
+          level.push_back(root);
+      }
+
+      // refine breadth first, nearest patches first, until out of budget
+      leaves.clear();
+      size_t patch_total = level.size();
+      std::vector<PatchDistance> order;
+      std::vector<Patch> next;
+      while(!level.empty()) {
+          order.clear();
+          for(size_t i = 0; i < level.size(); ++i) {
+              double centre[3];
+              direction(level[i], 0.5, 0.5, centre);
+              const double edge = edgeLength(level[i]);
+
+              // whole patch behind the horizon
+              if(above && level[i].depth > 0) {
+                  const double cosine = (centre[0]*camera[0] + centre[1]*camera[1] + centre[2]*camera[2])/camera_distance;
+                  const double angle = acos(fmax(-1.0, fmin(1.0, cosine)));
+                  if(angle - edge/radius > horizon) {
+                      --patch_total;
+                      continue;
+                  }
+              }
+
+              double offset[3];
+              for(int k = 0; k < 3; ++k) {
+                  offset[k] = centre[k]*radius - camera[k];
+              }
+              PatchDistance entry;
+              entry.distance = sqrt(offset[0]*offset[0] + offset[1]*offset[1] + offset[2]*offset[2])/edge;
+              entry.index = i;
+              order.push_back(entry);
+          }
+          std::sort(order.begin(), order.end());
+
+          next.clear();
+          for(size_t i = 0; i < order.size(); ++i) {
+              const Patch& patch = level[order[i].index];
+              if(order[i].distance < SPLIT_DISTANCE && patch.depth < max_depth
+                      && patch_total + 3 <= (size_t)max_patches) {
+                  for(uint32_t child = 0; child < 4; ++child) {
+                      Patch quarter = {patch.face, patch.depth + 1, patch.x*2 + (child & 1), patch.y*2 + (child >> 1)};
+                      next.push_back(quarter);
+                  }
+                  patch_total += 3;
+              } else {
+                  leaves.push_back(patch);
+              }
+          }
+          level.swap(next);
+      }
+  }
+
+  void PlanetMesh::buildPatch(uint64_t patch_key, std::vector<InterleavedVertex>& vertices, double centre[3]) const {
+      const Patch patch = patchOf(patch_key);
+      const int n = resolution;
+      const double skirt_radius = radius - SKIRT_DEPTH*edgeLength(patch);
+      direction(patch, 0.5, 0.5, centre);
+      for(int k = 0; k < 3; ++k) {
+          centre[k] *= radius;
+      }
+
+      // surface grid, then a skirt along each edge walked as (i,j) grid
+      // coordinates in the order buildIndices expects
+      vertices.clear();
+      for(int j = 0; j <= n; ++j) {
+          for(int i = 0; i <= n; ++i) {
+              double d[3];
+              direction(patch, (double)i/n, (double)j/n, d);
+              InterleavedVertex vertex;
+              for(int k = 0; k < 3; ++k) {
+                  vertex.position[k] = d[k]*radius - centre[k];
+                  vertex.normal[k] = d[k];
+              }
+              vertices.push_back(vertex);
+          }
+      }
+      const int edge_start[4][2] = {{0,0}, {n,0}, {n,n}, {0,n}};
+      const int edge_step[4][2] = {{1,0}, {0,1}, {-1,0}, {0,-1}};
+      for(int e = 0; e < 4; ++e) {
+          for(int k = 0; k <= n; ++k) {
+              const int i = edge_start[e][0] + k*edge_step[e][0];
+              const int j = edge_start[e][1] + k*edge_step[e][1];
+              InterleavedVertex vertex = vertices[j*(n+1) + i];
+              for(int c = 0; c < 3; ++c) {
+                  vertex.position[c] = vertex.normal[c]*skirt_radius - centre[c];
+              }
+              vertices.push_back(vertex);
+          }
+      }
+  }
+
+  void PlanetMesh::buildIndices() {
+      const int n = resolution;
+      for(int j = 0; j < n; ++j) {
+          for(int i = 0; i < n; ++i) {
+              const IndexT a = j*(n+1) + i;
+              const IndexT b = a + 1;
+              const IndexT c = a + (n+1);
+              const IndexT d = c + 1;
+              index_data.push_back(a);
+              index_data.push_back(b);
+              index_data.push_back(d);
+              index_data.push_back(a);
+              index_data.push_back(d);
+              index_data.push_back(c);
+          }
+      }
+
+      // skirts along the four edges, each edge's vertices follow the grid
+      const int edge_start[4][2] = {{0,0}, {n,0}, {n,n}, {0,n}};
+      const int edge_step[4][2] = {{1,0}, {0,1}, {-1,0}, {0,-1}};
+      for(int e = 0; e < 4; ++e) {
+          const IndexT skirt = (n+1)*(n+1) + e*(n+1);
+          for(int k = 0; k < n; ++k) {
+              const int i0 = edge_start[e][0] + k*edge_step[e][0];
+              const int j0 = edge_start[e][1] + k*edge_step[e][1];
+              const int i1 = i0 + edge_step[e][0];
+              const int j1 = j0 + edge_step[e][1];
+              const IndexT top0 = j0*(n+1) + i0;
+              const IndexT top1 = j1*(n+1) + i1;
+              index_data.push_back(top0);
+              index_data.push_back(skirt + k);
+              index_data.push_back(top1);
+              index_data.push_back(top1);
+              index_data.push_back(skirt + k);
+              index_data.push_back(skirt + k + 1);
+          }
+      }
+  }
+
+  bool PlanetMesh::update(double camera_x, double camera_y, double camera_z) {
+      const double camera[3] = {camera_x, camera_y, camera_z};
+      std::vector<Patch> leaves;
+      select(camera, leaves);
+
+      std::vector<uint64_t> keys(leaves.size());
+      for(size_t i = 0; i < leaves.size(); ++i) {
+          keys[i] = key(leaves[i]);
+      }
+      std::sort(keys.begin(), keys.end());
+      if(keys == selection) {
+          return false;
+      }
+      selection.swap(keys);
+      return true;
+  }
+
+} // namespace RSimView
@@ -0,0 +1,73 @@
+#ifndef RSIM_PLANETMESH_HPP
+#define RSIM_PLANETMESH_HPP
+/** Procedural planet surface, a cube-sphere quadtree refined around the camera **/
+
+// C standard library
+#include <stdint.h>
+
+// STD
+#include <vector>
+
+// project
+#include "meshdata.hpp"
+
+namespace RSimView {
+  /// Builds the planet out of square patches on the six faces of a cube
+  /// pushed out onto the sphere. Patches close to the camera (relative to
+  /// their size) are split into four, so the surface next to the rocket stays
+  /// smooth while the far side stays a handful of coarse patches.
+  ///
+  /// Only the selection is redone as the camera moves. Each patch is built on
+  /// its own, so a viewer can keep the patches it has and build just the ones
+  /// newly picked. A patch's vertices are in metres from its own centre, which
+  /// keeps them small enough for floats at any distance from the planet.
+  class PlanetMesh {
+  public:
+      /// max_depth is clamped to the 27 levels a patch key can hold
+      PlanetMesh(double radius, int patch_resolution = 16, int max_patches = 384, int max_depth = 20);
+
+      /// Select patches for a camera position relative to the planet centre.
+      /// Returns true if the selection changed.
+      bool update(double camera_x, double camera_y, double camera_z);
+
+      /// keys of the selected patches, sorted
+      const std::vector<uint64_t>& selected() const;
+
+      /// vertices of the patch with this key, relative to centre which is in
+      /// metres from the planet centre
+      void buildPatch(uint64_t patch_key, std::vector<InterleavedVertex>& vertices, double centre[3]) const;
+
+      /// triangles of a patch, the same for every patch
+      const std::vector<IndexT>& indices() const;
+
+      SizeT patchCount() const;
+      int maxPatches() const;
+
+  private:
+      /// a square of the quadtree on one cube face
+      struct Patch {
+          int face;
+          int depth;
+          uint32_t x;
+          uint32_t y;
+      };
+
+      double radius;
+      int resolution;
+      int max_patches;
+      int max_depth;
+      std::vector<uint64_t> selection;
+      std::vector<IndexT> index_data;
+
+      void select(const double camera[3], std::vector<Patch>& leaves) const;
+      void direction(const Patch& patch, double s, double t, double out[3]) const;
+      double edgeLength(const Patch& patch) const;
+      void buildIndices();
+
+      static uint64_t key(const Patch& patch);
+      static Patch patchOf(uint64_t patch_key);
+  };
+
+} // namespace RSimView
+
+#endif // RSIM_PLANETMESH_HPP
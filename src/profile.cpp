@@ -0,0 +1,234 @@
+#include "profile.hpp"
+
+#ifdef RSIM_PROFILE
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Profile{
+  struct Slot{
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+  };
+
+  static void clearSlot(Slot *slot){
+    slot->count = 0;
+    slot->total = 0;
+    slot->min = UINT64_MAX;
+    slot->max = 0;
+  }
+
+  static void mergeSlot(Slot *into, const Slot &from){
+    into->count += from.count;
+    into->total += from.total;
+    if(from.min < into->min){
+      into->min = from.min;
+    }
+    if(from.max > into->max){
+      into->max = from.max;
+    }
+  }
+
+  /* a running thread's slot. Only its own thread writes it, so relaxed
+   * loads and stores are enough to let the summary read it while the thread
+   * keeps going, and cost nothing over plain ones
+   */
+  struct LiveSlot{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+  };
+
+  static void clearSlot(LiveSlot *slot){
+    slot->count.store(0,std::memory_order_relaxed);
+    slot->total.store(0,std::memory_order_relaxed);
+    slot->min.store(UINT64_MAX,std::memory_order_relaxed);
+    slot->max.store(0,std::memory_order_relaxed);
+  }
+
+  /* the owner's own update, no read-modify-write needed with one writer */
+  static void add(std::atomic<uint64_t> &field, uint64_t amount){
+    field.store(field.load(std::memory_order_relaxed) + amount,std::memory_order_relaxed);
+  }
+
+  static Slot snapshot(const LiveSlot &live){
+    Slot slot;
+    slot.count = live.count.load(std::memory_order_relaxed);
+    slot.total = live.total.load(std::memory_order_relaxed);
+    slot.min = live.min.load(std::memory_order_relaxed);
+    slot.max = live.max.load(std::memory_order_relaxed);
+    return slot;
+  }
+
+  struct ThreadSlots;
+
+  /* everything shared between threads, guarded by mutex */
+  struct State{
+    std::mutex mutex;
+    const char *names[MAX_ENTRIES];
+    kind_t kinds[MAX_ENTRIES];
+    int entry_count;
+    std::vector<ThreadSlots*> live;
+    Slot retired[MAX_ENTRIES]; /* totals of threads that already ended */
+    unsigned int thread_count;
+    std::string summary_path;
+
+    State():
+      entry_count(0),
+      thread_count(0){
+        for(int i = 0; i < MAX_ENTRIES; ++i){
+          clearSlot(&retired[i]);
+        }
+      }
+  };
+
+  /* constructed on first use so it outlives the exit handler */
+  static State &state(){
+    static State instance;
+    return instance;
+  }
+
+  /* per thread accumulators, merged into the retired totals on thread exit */
+  struct ThreadSlots{
+    LiveSlot slots[MAX_ENTRIES];
+
+    ThreadSlots(){
+      for(int i = 0; i < MAX_ENTRIES; ++i){
+        clearSlot(&slots[i]);
+      }
+      State &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      s.live.push_back(this);
+      ++s.thread_count;
+    }
+
+    ~ThreadSlots(){
+      State &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      for(int i = 0; i < MAX_ENTRIES; ++i){
+        mergeSlot(&s.retired[i],snapshot(slots[i]));
+      }
+      for(size_t i = 0; i < s.live.size(); ++i){
+        if(s.live[i] == this){
+          s.live.erase(s.live.begin() + i);
+          break;
+        }
+      }
+    }
+  };
+
+  static ThreadSlots &threadSlots(){
+    static thread_local ThreadSlots slots;
+    return slots;
+  }
+
+  int registerEntry(const char *name, kind_t kind){
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    /* call sites in different places may share a name */
+    for(int i = 0; i < s.entry_count; ++i){
+      if(std::string(s.names[i]) == name){
+        return i;
+      }
+    }
+    if(s.entry_count >= MAX_ENTRIES){
+      fprintf(stderr,"profile: too many entries, ignoring '%s'\n",name);
+      return -1;
+    }
+    s.names[s.entry_count] = name;
+    s.kinds[s.entry_count] = kind;
+    return s.entry_count++;
+  }
+
+  void record(int id, uint64_t nanoseconds){
+    if(id < 0){
+      return;
+    }
+    LiveSlot &slot = threadSlots().slots[id];
+    add(slot.count,1);
+    add(slot.total,nanoseconds);
+    if(nanoseconds < slot.min.load(std::memory_order_relaxed)){
+      slot.min.store(nanoseconds,std::memory_order_relaxed);
+    }
+    if(nanoseconds > slot.max.load(std::memory_order_relaxed)){
+      slot.max.store(nanoseconds,std::memory_order_relaxed);
+    }
+  }
+
+  void count(int id, uint64_t amount){
+    if(id < 0){
+      return;
+    }
+    LiveSlot &slot = threadSlots().slots[id];
+    add(slot.count,1);
+    add(slot.total,amount);
+  }
+
+  static void writeSummary(){
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    /* threads still running (including this one if it never exited), as
+     * far as they had got
+     */
+    Slot merged[MAX_ENTRIES];
+    for(int i = 0; i < s.entry_count; ++i){
+      merged[i] = s.retired[i];
+      for(size_t t = 0; t < s.live.size(); ++t){
+        mergeSlot(&merged[i],snapshot(s.live[t]->slots[i]));
+      }
+    }
+
+    FILE *file = fopen(s.summary_path.c_str(),"w");
+    if(file == NULL){
+      fprintf(stderr,"profile: could not write %s\n",s.summary_path.c_str());
+      return;
+    }
+    fprintf(file,"{\n  \"threads\": %u,\n  \"timers\": {",s.thread_count);
+    bool first = true;
+    for(int i = 0; i < s.entry_count; ++i){
+      if(s.kinds[i] != KIND_TIMER){
+        continue;
+      }
+      const Slot &slot = merged[i];
+      const double mean = slot.count > 0 ? (double)slot.total/slot.count : 0.0;
+      fprintf(file,"%s\n    \"%s\": {\"count\": %llu, \"total_s\": %.9f, \"mean_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f}",
+        first ? "" : ",",s.names[i],(unsigned long long)slot.count,slot.total*1e-9,mean*1e-3,
+        slot.count > 0 ? slot.min*1e-3 : 0.0,slot.max*1e-3);
+      first = false;
+    }
+    fprintf(file,"\n  },\n  \"counters\": {");
+    first = true;
+    for(int i = 0; i < s.entry_count; ++i){
+      if(s.kinds[i] != KIND_COUNTER){
+        continue;
+      }
+      fprintf(file,"%s\n    \"%s\": %llu",first ? "" : ",",s.names[i],(unsigned long long)merged[i].total);
+      first = false;
+    }
+    fprintf(file,"\n  }\n}\n");
+    fclose(file);
+  }
+
+  void writeSummaryAtExit(const char *path){
+    State &s = state();
+    {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      const bool registered = !s.summary_path.empty();
+      s.summary_path = path;
+      if(registered){
+        return;
+      }
+    }
+    atexit(writeSummary);
+  }
+}
+
+#endif /* RSIM_PROFILE */
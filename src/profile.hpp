@@ -0,0 +1,76 @@
+#ifndef RSIM_PROFILE_HPP
+#define RSIM_PROFILE_HPP
+/* named scoped timers and counters for finding where a run spends its time
+ *
+ * RSIM_PROFILE_SCOPE("name") times the rest of the enclosing block and
+ * RSIM_PROFILE_COUNT("name", n) adds n to a counter. Each thread accumulates
+ * into its own slots, which are merged when the thread ends and written out
+ * as a JSON summary when the process exits. Building without RSIM_PROFILE,
+ * as is the default, turns all of it into nothing.
+ */
+
+#ifdef RSIM_PROFILE
+
+#include <chrono>
+#include <stdint.h>
+
+namespace Profile{
+  enum kind_t{
+    KIND_TIMER,
+    KIND_COUNTER
+  };
+
+  /* maximum number of distinct timers and counters */
+  static const int MAX_ENTRIES = 64;
+
+  /* get a stable id for a name, done once per call site */
+  int registerEntry(const char *name, kind_t kind);
+
+  /* add to the calling thread's slot */
+  void record(int id, uint64_t nanoseconds);
+  void count(int id, uint64_t amount);
+
+  /* write the merged summary to path when the process exits */
+  void writeSummaryAtExit(const char *path);
+
+  class ScopedTimer{
+  public:
+    ScopedTimer(int id):
+      id(id),
+      start(std::chrono::steady_clock::now()){}
+
+    ~ScopedTimer(){
+      const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+      record(id,std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+  private:
+    const int id;
+    const std::chrono::steady_clock::time_point start;
+  };
+}
+
+#define RSIM_PROFILE_JOIN2(a,b) a##b
+#define RSIM_PROFILE_JOIN(a,b) RSIM_PROFILE_JOIN2(a,b)
+
+#define RSIM_PROFILE_SCOPE(name) \
+  static const int RSIM_PROFILE_JOIN(rsim_profile_id_,__LINE__) = Profile::registerEntry(name,Profile::KIND_TIMER); \
+  Profile::ScopedTimer RSIM_PROFILE_JOIN(rsim_profile_timer_,__LINE__)(RSIM_PROFILE_JOIN(rsim_profile_id_,__LINE__))
+
+#define RSIM_PROFILE_COUNT(name,amount) \
+  do{ \
+    static const int rsim_profile_counter_id = Profile::registerEntry(name,Profile::KIND_COUNTER); \
+    Profile::count(rsim_profile_counter_id,amount); \
+  }while(0)
+
+#define RSIM_PROFILE_SUMMARY(path) Profile::writeSummaryAtExit(path)
+
+#else
+
+#define RSIM_PROFILE_SCOPE(name) do{}while(0)
+#define RSIM_PROFILE_COUNT(name,amount) do{}while(0)
+#define RSIM_PROFILE_SUMMARY(path) do{ (void)(path); }while(0)
+
+#endif /* RSIM_PROFILE */
+
+#endif
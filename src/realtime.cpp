@@ -0,0 +1,211 @@
+#include "realtime.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "profile.hpp"
+#include "rocket.hpp"
+#include "trace.hpp"
+
+/* "RSRT", tells a reader the object is a state channel */
+static const uint32_t CHANNEL_MAGIC = 0x54525352;
+
+StateChannelWriter::StateChannelWriter(const char *name):
+  name(name),
+  data(NULL){
+    const int fd = shm_open(name,O_CREAT|O_RDWR|O_TRUNC,0644);
+    if(fd < 0){
+      std::cerr << "Error creating state channel: " << name << std::endl;
+      return;
+    }
+    void *mapping = MAP_FAILED;
+    if(ftruncate(fd,sizeof(RealtimeChannelData)) == 0){
+      mapping = mmap(NULL,sizeof(RealtimeChannelData),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    }
+    close(fd);
+    if(mapping == MAP_FAILED){
+      std::cerr << "Error mapping state channel: " << name << std::endl;
+      shm_unlink(name);
+      return;
+    }
+    this->data = new (mapping) RealtimeChannelData;
+    this->data->sample_size = sizeof(RealtimeSample);
+    this->data->sequence.store(0);
+    this->data->magic = CHANNEL_MAGIC;
+  }
+
+StateChannelWriter::~StateChannelWriter(){
+  if(this->data != NULL){
+    munmap(this->data,sizeof(RealtimeChannelData));
+    shm_unlink(this->name.c_str());
+  }
+}
+
+bool StateChannelWriter::isOpen() const {
+  return this->data != NULL;
+}
+
+void StateChannelWriter::publish(const RealtimeSample &sample){
+  const uint64_t sequence = this->data->sequence.load(std::memory_order_relaxed);
+  this->data->sequence.store(sequence + 1,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  this->data->sample = sample;
+  this->data->sequence.store(sequence + 2,std::memory_order_release);
+}
+
+StateChannel::StateChannel(const char *name):
+  data(NULL){
+    const int fd = shm_open(name,O_RDONLY,0);
+    if(fd < 0){
+      std::cerr << "Error opening state channel: " << name << std::endl;
+      return;
+    }
+    void *mapping = mmap(NULL,sizeof(RealtimeChannelData),PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if(mapping == MAP_FAILED){
+      std::cerr << "Error mapping state channel: " << name << std::endl;
+      return;
+    }
+    const RealtimeChannelData *data = (const RealtimeChannelData *) mapping;
+    if(data->magic != CHANNEL_MAGIC || data->sample_size != sizeof(RealtimeSample)){
+      std::cerr << "Not a state channel of this version: " << name << std::endl;
+      munmap(mapping,sizeof(RealtimeChannelData));
+      return;
+    }
+    this->data = data;
+  }
+
+StateChannel::~StateChannel(){
+  if(this->data != NULL){
+    munmap((void *) this->data,sizeof(RealtimeChannelData));
+  }
+}
+
+bool StateChannel::isOpen() const {
+  return this->data != NULL;
+}
+
+bool StateChannel::read(RealtimeSample *sample) const {
+  for(;;){
+    const uint64_t before = this->data->sequence.load(std::memory_order_acquire);
+    if(before == 0){
+      return false;
+    }
+    if(before & 1){
+      continue;
+    }
+    *sample = this->data->sample;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(this->data->sequence.load(std::memory_order_relaxed) == before){
+      return true;
+    }
+  }
+}
+
+RealtimeOptions::RealtimeOptions():
+  duration(10.0),
+  spin(200e-6),
+  cpu(-1),
+  channel(NULL)
+  {}
+
+/* nanoseconds on the monotonic clock */
+static int64_t monotonicNow(){
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (int64_t) now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+/* sleep until spin before the deadline and spin the rest of the way, returns
+ * the time it woke up at
+ */
+static int64_t waitUntil(int64_t deadline, int64_t spin){
+  int64_t now = monotonicNow();
+  if(deadline - now > spin){
+    timespec wake;
+    wake.tv_sec = (deadline - spin)/1000000000;
+    wake.tv_nsec = (deadline - spin)%1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&wake,NULL) == EINTR){}
+  }
+  while((now = monotonicNow()) < deadline){}
+  return now;
+}
+
+static bool pinToCpu(int cpu){
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu,&set);
+  return pthread_setaffinity_np(pthread_self(),sizeof(set),&set) == 0;
+}
+
+bool runRealtime(Rocket &rocket, double dt, const RealtimeOptions &options, RealtimeReport *report){
+  memset(report,0,sizeof(*report));
+  StateChannelWriter *channel = NULL;
+  if(options.channel != NULL){
+    channel = new StateChannelWriter(options.channel);
+    if(!channel->isOpen()){
+      delete channel;
+      return false;
+    }
+  }
+  if(options.cpu >= 0 && !pinToCpu(options.cpu)){
+    std::cerr << "Could not pin to cpu " << options.cpu << ", running unpinned" << std::endl;
+  }
+
+  const int64_t period = llround(dt*1e9);
+  const int64_t spin = llround(options.spin*1e9);
+  const uint64_t ticks = (uint64_t) (options.duration/dt);
+  /* one period to settle before the first deadline */
+  const int64_t start = monotonicNow() + period;
+  double latency_sum = 0.0;
+  RealtimeSample sample;
+  for(uint64_t k = 0; k < ticks; ++k){
+    const int64_t deadline = start + (int64_t) k*period;
+    const int64_t woke = waitUntil(deadline,spin);
+    {
+      RSIM_TRACE_SCOPE("realtime tick");
+      rocket.step();
+      if(channel != NULL){
+        sample.tick = k;
+        sample.time = rocket.getTime();
+        sample.wall_time = (woke - start)*1e-9;
+        sample.stage = rocket.getStageProgress();
+        memcpy(sample.state,rocket.getState()->data,sizeof(sample.state));
+        channel->publish(sample);
+      }
+    }
+    const int64_t done = monotonicNow();
+
+    if(done > deadline + period){
+      ++report->misses;
+      RSIM_PROFILE_COUNT("deadline misses",1);
+    }
+    const double latency = (woke - deadline)*1e-9;
+    latency_sum += latency;
+    report->worst_latency = std::max(report->worst_latency,latency);
+    report->worst_step = std::max(report->worst_step,(done - woke)*1e-9);
+    report->behind = latency;
+    unsigned int bin = 0;
+    for(int64_t us = (woke - deadline)/1000; us > 0 && bin < REALTIME_HISTOGRAM_BINS - 1; us >>= 1){
+      ++bin;
+    }
+    ++report->histogram[bin];
+    ++report->ticks;
+  }
+  report->mean_latency = report->ticks > 0 ? latency_sum/report->ticks : 0.0;
+
+  delete channel;
+  return true;
+}
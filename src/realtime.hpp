@@ -0,0 +1,109 @@
+#ifndef RSIM_REALTIME_HPP
+#define RSIM_REALTIME_HPP
+/* stepping the rocket at wall clock speed, for flight software running
+ * against it in another process
+ *
+ * Every tick has a deadline on the monotonic clock, tick k at start + k*dt.
+ * The scheduler sleeps until shortly before a deadline and spins the rest of
+ * the way, since a sleep alone wakes up late by however long the kernel
+ * takes. The rocket then takes one step of dt and the state is published.
+ * A tick that starts late is still taken, without skipping, so simulated
+ * time catches up with the wall clock as soon as the steps allow it.
+ *
+ * The state goes to a POSIX shared memory object under a sequence lock: the
+ * sequence is odd while a tick is being written, so a reader copies the
+ * sample and retries if the sequence changed or was odd. The writer never
+ * waits for readers.
+ */
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include "flightmodel.hpp"
+
+class Rocket;
+
+/* what one tick publishes */
+struct RealtimeSample{
+  uint64_t tick;
+  double time; /* simulated seconds */
+  double wall_time; /* seconds since the first deadline */
+  uint32_t stage;
+  double state[RIGID_BODY_STATE_SIZE];
+};
+
+/* the layout of the shared memory object */
+struct RealtimeChannelData{
+  uint32_t magic;
+  uint32_t sample_size;
+  std::atomic<uint64_t> sequence; /* odd while a sample is written */
+  RealtimeSample sample;
+};
+
+/* creates the shared memory object, unlinked again when destroyed */
+class StateChannelWriter{
+public:
+  /* name as for shm_open, starting with a '/' */
+  StateChannelWriter(const char *name);
+  ~StateChannelWriter();
+
+  bool isOpen() const;
+
+  void publish(const RealtimeSample &sample);
+
+private:
+  std::string name;
+  RealtimeChannelData *data;
+
+  StateChannelWriter(const StateChannelWriter&);
+  StateChannelWriter &operator=(const StateChannelWriter&);
+};
+
+/* a reader of a channel another process writes */
+class StateChannel{
+public:
+  StateChannel(const char *name);
+  ~StateChannel();
+
+  bool isOpen() const;
+
+  /* the latest sample, false if nothing was published yet */
+  bool read(RealtimeSample *sample) const;
+
+private:
+  const RealtimeChannelData *data;
+
+  StateChannel(const StateChannel&);
+  StateChannel &operator=(const StateChannel&);
+};
+
+struct RealtimeOptions{
+  double duration; /* wall clock seconds to run for */
+  double spin; /* seconds before a deadline to stop sleeping and spin */
+  int cpu; /* core to pin the stepping thread to, -1 to leave it */
+  const char *channel; /* shared memory name, NULL to publish nothing */
+
+  RealtimeOptions();
+};
+
+/* latencies are binned by powers of two microseconds, bin b holds latencies
+ * below 2^b us and the last bin everything longer
+ */
+static const unsigned int REALTIME_HISTOGRAM_BINS = 18;
+
+struct RealtimeReport{
+  uint64_t ticks;
+  uint64_t misses; /* ticks whose step finished after the next deadline */
+  double worst_latency; /* seconds a tick started after its deadline */
+  double mean_latency;
+  double worst_step; /* seconds of the longest step and publish */
+  double behind; /* seconds the last tick was late by */
+  uint64_t histogram[REALTIME_HISTOGRAM_BINS];
+};
+
+/* step rocket once per its dt for options.duration seconds, false if the
+ * channel could not be made
+ */
+bool runRealtime(Rocket &rocket, double dt, const RealtimeOptions &options, RealtimeReport *report);
+
+#endif
@@ -1,179 +1,289 @@
 #include "rigidbody.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <cstdio>
 #include <iostream>
 
+#include <gsl/gsl_errno.h>
 #include <gsl/gsl_linalg.h>
 #include <gsl/gsl_blas.h>
 
 #include "common.hpp"
 #include "earth.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
 
-static const size_t STATE_POSITION_START = 0;
-static const size_t STATE_POSITION_SIZE = 3;
-static const size_t STATE_ROTATION_START = 3;
-static const size_t STATE_ROTATION_SIZE = 9;
-static const size_t STATE_LINEAR_MOMENTUM_START = 12;
-static const size_t STATE_LINEAR_MOMENTUM_SIZE = 3;
-static const size_t STATE_ANGULAR_MOMENTUM_START = 15;
-static const size_t STATE_ANGULAR_MOMENTUM_SIZE = 3;
-static const size_t STATE_MASS = 19;
-
+/* one system function per phase of the flight, RigidBody::update swaps them
+ * when the phase changes
+ */
+template<flight_phase_t PHASE>
 static int rigid_body_ode(double t, const double y[], double dydt[], void *params){
+  RSIM_PROFILE_SCOPE("rhs");
   RigidBody const *rigidbody = (RigidBody *) params;
-  double dm = rigidbody->getMassFlow(); /* loss of mass due to fuel */
-  const double origin[3] = {0,0,0};
-  gsl_vector_const_view origin_view = gsl_vector_const_view_array(origin,3);
-  gsl_vector *thrust_direction = gsl_vector_alloc(3);
-  gsl_vector *force = gsl_vector_calloc(3);
-  gsl_vector *torque = gsl_vector_calloc(3);
-  gsl_vector *body_orientation = gsl_vector_calloc(3);
-
-  memset(dydt,0,20*sizeof(double));
+  const BodyProperties<double> body = rigidbody->getBodyProperties();
+  phaseDerivative<PHASE>(y,dydt,body);
+  return GSL_SUCCESS;
+}
 
-  /* compute force from the combination of gravity, drag, lift, thrust */
-  /* gravity */
-  gsl_vector *gdir = gsl_vector_calloc(3); /* gravity direction */
-  gsl_vector_const_view earthpos = gsl_vector_const_view_array(earth.position,3);
-  gsl_vector_const_view rocketpos = gsl_vector_const_view_array(y,3);
+/* the same with the thrust turned through the gimbal, whose angles move on
+ * after the rigid body state
+ */
+template<flight_phase_t PHASE>
+static int rigid_body_gimbal_ode(double t, const double y[], double dydt[], void *params){
+  RSIM_PROFILE_SCOPE("rhs");
+  RigidBody const *rigidbody = (RigidBody *) params;
+  BodyProperties<double> body = rigidbody->getBodyProperties();
+  gimbalThrust(&y[STATE_ROTATION_START],&y[GIMBAL_START],body.thrust_direction);
+  phaseDerivative<PHASE>(y,dydt,body);
+  gimbalRates(*rigidbody->getGimbal(),y,rigidbody->getAttitudeTarget(),body,&dydt[GIMBAL_START]);
+  return GSL_SUCCESS;
+}
 
-  gsl_vector_add(gdir,&earthpos.vector);
-  gsl_vector_sub(gdir,&rocketpos.vector);
-  const double dist = gsl_blas_dnrm2(gdir);
+static int (*phaseFunction(flight_phase_t phase, bool gimbal))(double, const double [], double [], void *){
+  switch(phase){
+    case PHASE_VACUUM:
+      return gimbal ? &rigid_body_gimbal_ode<PHASE_VACUUM> : &rigid_body_ode<PHASE_VACUUM>;
+    case PHASE_COAST:
+      return gimbal ? &rigid_body_gimbal_ode<PHASE_COAST> : &rigid_body_ode<PHASE_COAST>;
+    default:
+      return gimbal ? &rigid_body_gimbal_ode<PHASE_ATMOSPHERE> : &rigid_body_ode<PHASE_ATMOSPHERE>;
+  }
+}
 
-  const double gforce = gravitiational_constant*y[STATE_MASS]*earth.mass/(dist*dist);
-  gsl_vector_scale(gdir,gforce/dist);
+/* RigidBody::star on the stack, out = v x */
+static void skew(const double v[3], double out[3][3]){
+  out[0][0] = 0.0;
+  out[0][1] = -v[2];
+  out[0][2] = v[1];
+  out[1][0] = v[2];
+  out[1][1] = 0.0;
+  out[1][2] = -v[0];
+  out[2][0] = -v[1];
+  out[2][1] = v[0];
+  out[2][2] = 0.0;
+}
 
-  /* add force of gravity after torque */
+/* exact jacobian of rigid_body_ode, dfdy is row major with
+ * dfdy[i*STATE_SIZE + j] = d(dydt[i])/d(y[j])
+ */
+static int rigid_body_jacobian(double t, const double y[], double *dfdy, double dfdt[], void *params){
+  RSIM_PROFILE_SCOPE("jacobian");
+  RigidBody const *rigidbody = (RigidBody *) params;
+  const BodyProperties<double> body = rigidbody->getBodyProperties();
+  const unsigned int N = RigidBody::STATE_SIZE;
+  const double dm = body.mass_flow;
+  const double m = y[STATE_MASS];
+  const double *x = &y[STATE_POSITION_START];
+  const double *R = &y[STATE_ROTATION_START];
+  const double *P = &y[STATE_LINEAR_MOMENTUM_START];
+  const double *L = &y[STATE_ANGULAR_MOMENTUM_START];
+  const double *u = body.thrust_direction;
+  const double *com = body.centre_of_mass;
+  const double drag = body.drag;
+
+  memset(dfdy,0,N*N*sizeof(double));
+  memset(dfdt,0,N*sizeof(double)); /* no explicit time dependence */
+
+  /* gravity g = G m M r/|r|^3 with r = earth - x */
+  double r[3];
+  for(int i = 0; i < 3; ++i){
+    r[i] = earth.position[i] - x[i];
+  }
+  const double dist = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+  const double k = gravitiational_constant*m*earth.mass;
+  const double d3 = dist*dist*dist;
+  const double d5 = d3*dist*dist;
 
-  /* thrust */
+  /* thrust magnitude and its gradient along x through the specific impulse */
   double Isp;
-  gsl_vector_memcpy(thrust_direction,rigidbody->getThrustDirection());
-  if(rigidbody->vac_thruster){
-    /* specific impulse based on distance from sealevel
-     * the karman line begins at 100km
-     */
-    Isp = normalize(dist - earth.radius,0.0,100000.0);
-    /* clamp range */
-    if(Isp < 0){
-      Isp = 0;
-    }else if(Isp > 1){
-      Isp = 1;
-    }
-    Isp = Isp*(max_ISP-min_ISP)+min_ISP;
+  double dIsp_dd = 0.0;
+  const double level = normalize(dist - earth.radius,0.0,karman_line);
+  if(level <= 0){
+    Isp = body.isp_sea_level;
+  }else if(level >= 1){
+    Isp = body.isp_vacuum;
   }else{
-    /* constant specific impulse of stage 2 thruster */
-    Isp = merlinvac_isp;
+    Isp = level*(body.isp_vacuum-body.isp_sea_level)+body.isp_sea_level;
+    dIsp_dd = (body.isp_vacuum-body.isp_sea_level)/karman_line;
+  }
+  const double thrust = -9.81*dm*Isp;
+  double dthrust_dx[3];
+  for(int i = 0; i < 3; ++i){
+    /* d(dist)/dx = -r/dist */
+    dthrust_dx[i] = -9.81*dm*dIsp_dd*(-r[i]/dist);
   }
-  const double thrust = -9.81*dm*Isp; // todo: add more sig digs to gravity? [@Kathryn]
-  gsl_vector_scale(thrust_direction,thrust);
-  gsl_vector_add(force,thrust_direction);
-  gsl_vector_free(thrust_direction);
 
-  /* compute torque from thrust */
+  /* lever arm from the centre of mass to the base, body frame then world */
+  const double body_lever[3] = {0.0,-com[1],0.0};
   double lever[3];
-  double orientation[3];
-  gsl_vector_const_view com = gsl_vector_const_view_array(rigidbody->getCentreOfMass(),3);
-  gsl_vector_view ori_view = gsl_vector_view_array(orientation,3);
-  gsl_vector_view lev_view = gsl_vector_view_array(lever,3);
-  gsl_matrix_const_view r_view = gsl_matrix_const_view_array(&y[STATE_ROTATION_START],3,3);
-
-  /* at this point orientation is just the base of the rocket */
-  orientation[0] = com.vector.data[0];
-  orientation[2] = com.vector.data[2];
-
-  /* get orientation of rocket */
-  gsl_vector_sub(&ori_view.vector,&com.vector);
-  gsl_blas_dgemv(CblasNoTrans,1.0,&r_view.matrix,&ori_view.vector,0.0,&lev_view.vector);
-  cross_product(&lev_view.vector,force,torque);
-
-  /* get orientation vector of rocket, scoping the variables */
-  {
-    gsl_vector_sub(body_orientation,&lev_view.vector);
-    const double bonrm = gsl_blas_dnrm2(body_orientation);
-    gsl_vector_scale(body_orientation,1.0/bonrm);
+  for(int i = 0; i < 3; ++i){
+    lever[i] = R[i*3+0]*body_lever[0] + R[i*3+1]*body_lever[1] + R[i*3+2]*body_lever[2];
   }
 
-  /* add force of gravity after torque */
-  gsl_vector_add(force,gdir);
-  gsl_vector_free(gdir);
-
-  /* TODO: drag */
-  const double drag_coefficient = -0.05;
-  gsl_vector *drag = gsl_vector_alloc(3);
-  memcpy(drag->data,&y[12],3*sizeof(double));
-  gsl_vector_scale(drag,drag_coefficient/y[19]);
-  gsl_vector_add(force,drag);
-
-  /* TODO: lift */
-
-  /* compute dr/dt TODO: turn these into matrix views on stack arrays */
-  const gsl_matrix *rotation = &r_view.matrix;
-  gsl_matrix *product = gsl_matrix_alloc(3,3);
-  gsl_matrix *Ibody = gsl_matrix_calloc(3,3);
-  gsl_matrix *Iinv = gsl_matrix_alloc(3,3);
-  gsl_vector *w = gsl_vector_alloc(3);
+  /* D is the body inverse inertia as rigid_body_ode builds it */
+  double D[9];
+  memcpy(D,body.inertia_tensor,9*sizeof(double));
+  D[0] = 1.0/D[0];
+  D[4] = 1.0/D[4];
+  D[8] = 1.0/D[8];
+
+  /* RD = R D, Iinv = R D R^T, A = D R^T L, w = R A */
+  double RD[9], Iinv[9], RtL[3], A[3], w[3];
+  for(int i = 0; i < 3; ++i){
+    for(int j = 0; j < 3; ++j){
+      RD[i*3+j] = R[i*3+0]*D[0*3+j] + R[i*3+1]*D[1*3+j] + R[i*3+2]*D[2*3+j];
+    }
+  }
+  for(int i = 0; i < 3; ++i){
+    for(int j = 0; j < 3; ++j){
+      Iinv[i*3+j] = RD[i*3+0]*R[j*3+0] + RD[i*3+1]*R[j*3+1] + RD[i*3+2]*R[j*3+2];
+    }
+    RtL[i] = R[0*3+i]*L[0] + R[1*3+i]*L[1] + R[2*3+i]*L[2];
+  }
+  for(int i = 0; i < 3; ++i){
+    A[i] = D[i*3+0]*RtL[0] + D[i*3+1]*RtL[1] + D[i*3+2]*RtL[2];
+  }
+  for(int i = 0; i < 3; ++i){
+    w[i] = R[i*3+0]*A[0] + R[i*3+1]*A[1] + R[i*3+2]*A[2];
+  }
 
-  gsl_matrix_memcpy(Ibody,rigidbody->getInertiaTensor());
-  gsl_matrix_set(Ibody,0,0,1.0/Ibody->data[0]);
-  gsl_matrix_set(Ibody,1,1,1.0/Ibody->data[4]);
-  gsl_matrix_set(Ibody,2,2,1.0/Ibody->data[8]);
+  #define J(row,col) dfdy[(row)*N + (col)]
 
-  gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, Ibody, rotation, 0.0, product);
-  gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, rotation, product, 0.0, Iinv);
+  /* dx/dt = P/m */
+  for(int i = 0; i < 3; ++i){
+    J(STATE_POSITION_START+i,STATE_LINEAR_MOMENTUM_START+i) = 1.0/m;
+    J(STATE_POSITION_START+i,STATE_MASS) = -P[i]/(m*m);
+  }
 
-    /*
-  printf("Iinv: [");
-  for(int i = 0; i < 9; ++i){
-    if(i % 3 == 0){
-        printf("\n");
+  /* dR/dt = star(w) R */
+  double sw[3][3];
+  skew(w,sw);
+  for(int a = 0; a < 3; ++a){
+    for(int b = 0; b < 3; ++b){
+      /* dw/dR_ab = e_a A_b + L_a (R D)[:,b] */
+      double dw[3];
+      for(int i = 0; i < 3; ++i){
+        dw[i] = (i == a ? A[b] : 0.0) + L[a]*RD[i*3+b];
+      }
+      double sdw[3][3];
+      skew(dw,sdw);
+      for(int i = 0; i < 3; ++i){
+        for(int j = 0; j < 3; ++j){
+          /* star(dw) R + star(w) E_ab */
+          double value = sdw[i][0]*R[0*3+j] + sdw[i][1]*R[1*3+j] + sdw[i][2]*R[2*3+j];
+          if(j == b){
+            value += sw[i][a];
+          }
+          J(STATE_ROTATION_START+i*3+j,STATE_ROTATION_START+a*3+b) = value;
+        }
+      }
+    }
+  }
+  for(int c = 0; c < 3; ++c){
+    /* dw/dL_c is column c of Iinv */
+    const double column[3] = {Iinv[0*3+c],Iinv[1*3+c],Iinv[2*3+c]};
+    double star_column[3][3];
+    skew(column,star_column);
+    for(int i = 0; i < 3; ++i){
+      for(int j = 0; j < 3; ++j){
+        double value = 0.0;
+        for(int l = 0; l < 3; ++l){
+          value += star_column[i][l]*R[l*3+j];
+        }
+        J(STATE_ROTATION_START+i*3+j,STATE_ANGULAR_MOMENTUM_START+c) = value;
+      }
     }
-    printf("%lf ",rigidbody->getInertiaTensor()->data[i]);
   }
-  printf("] \n");
-    */
-
-  gsl_vector_const_view angular_momentum = gsl_vector_const_view_array(&y[STATE_ANGULAR_MOMENTUM_START],STATE_ANGULAR_MOMENTUM_SIZE);
 
-  gsl_blas_dgemv(CblasNoTrans,1.0,Iinv,&angular_momentum.vector,0.0,w);
+  /* dP/dt = thrust u + gravity + drag P/m */
+  for(int i = 0; i < 3; ++i){
+    for(int j = 0; j < 3; ++j){
+      const double dgravity = -k*((i == j ? 1.0 : 0.0)/d3 - 3.0*r[i]*r[j]/d5);
+      J(STATE_LINEAR_MOMENTUM_START+i,STATE_POSITION_START+j) = dgravity + u[i]*dthrust_dx[j];
+    }
+    J(STATE_LINEAR_MOMENTUM_START+i,STATE_LINEAR_MOMENTUM_START+i) = -drag/m;
+    J(STATE_LINEAR_MOMENTUM_START+i,STATE_MASS) = k*r[i]/d3/m + drag*P[i]/(m*m);
+  }
 
-  gsl_matrix *w_star = RigidBody::star(w);
+  /* dL/dt = lever x (thrust u) */
+  const double F[3] = {thrust*u[0],thrust*u[1],thrust*u[2]};
+  for(int a = 0; a < 3; ++a){
+    for(int b = 0; b < 3; ++b){
+      /* dlever/dR_ab = e_a body_lever_b */
+      const double dl[3] = {a == 0 ? body_lever[b] : 0.0,a == 1 ? body_lever[b] : 0.0,a == 2 ? body_lever[b] : 0.0};
+      J(STATE_ANGULAR_MOMENTUM_START+0,STATE_ROTATION_START+a*3+b) = dl[1]*F[2] - dl[2]*F[1];
+      J(STATE_ANGULAR_MOMENTUM_START+1,STATE_ROTATION_START+a*3+b) = dl[2]*F[0] - dl[0]*F[2];
+      J(STATE_ANGULAR_MOMENTUM_START+2,STATE_ROTATION_START+a*3+b) = dl[0]*F[1] - dl[1]*F[0];
+    }
+  }
+  for(int j = 0; j < 3; ++j){
+    const double dF[3] = {u[0]*dthrust_dx[j],u[1]*dthrust_dx[j],u[2]*dthrust_dx[j]};
+    J(STATE_ANGULAR_MOMENTUM_START+0,STATE_POSITION_START+j) = lever[1]*dF[2] - lever[2]*dF[1];
+    J(STATE_ANGULAR_MOMENTUM_START+1,STATE_POSITION_START+j) = lever[2]*dF[0] - lever[0]*dF[2];
+    J(STATE_ANGULAR_MOMENTUM_START+2,STATE_POSITION_START+j) = lever[0]*dF[1] - lever[1]*dF[0];
+  }
 
-  gsl_blas_dgemm(CblasNoTrans,CblasNoTrans,1.0,w_star,rotation,0.0,product);
+  #undef J
 
-  gsl_vector_free(w);
-  gsl_matrix_free(Iinv);
-  gsl_matrix_free(Ibody);
-  gsl_matrix_free(w_star);
+  return GSL_SUCCESS;
+}
 
-  /* set dx/dt as velocity (P/m) */
-  for(int i = 0; i < STATE_LINEAR_MOMENTUM_SIZE; ++i){
-    dydt[i] = y[STATE_LINEAR_MOMENTUM_START+i]/y[STATE_MASS];
+/* jacobian of rigid_body_gimbal_ode by central differences, the
+ * controller's limits and inverse sines are not worth writing out
+ */
+static int rigid_body_gimbal_jacobian(double t, const double y[], double *dfdy, double dfdt[], void *params){
+  RSIM_PROFILE_SCOPE("jacobian");
+  const unsigned int N = RigidBody::STATE_SIZE + GIMBAL_STATE_SIZE;
+  double x[N];
+  double forward[N];
+  double backward[N];
+  memcpy(x,y,N*sizeof(double));
+  for(unsigned int j = 0; j < N; ++j){
+    const double h = 1e-7*fmax(fabs(y[j]),1.0);
+    x[j] = y[j] + h;
+    rigid_body_gimbal_ode<PHASE_ATMOSPHERE>(t,x,forward,params);
+    x[j] = y[j] - h;
+    rigid_body_gimbal_ode<PHASE_ATMOSPHERE>(t,x,backward,params);
+    x[j] = y[j];
+    for(unsigned int i = 0; i < N; ++i){
+      dfdy[i*N + j] = (forward[i] - backward[i])/(2.0*h);
+    }
   }
-  memcpy(&dydt[STATE_ROTATION_START],product->data,STATE_ROTATION_SIZE*sizeof(double));
-  memcpy(&dydt[STATE_LINEAR_MOMENTUM_START],force->data,STATE_LINEAR_MOMENTUM_SIZE*sizeof(double)); /* set dP/dt as force */
-  memcpy(&dydt[STATE_ANGULAR_MOMENTUM_START],torque->data,STATE_ANGULAR_MOMENTUM_SIZE*sizeof(double)); /* set dL/dt as torque */
-  dydt[STATE_MASS] = dm;
-
-  gsl_matrix_free(product);
-  gsl_vector_free(force);
-  gsl_vector_free(torque);
-  gsl_vector_free(body_orientation);
-
+  memset(dfdt,0,N*sizeof(double));
   return GSL_SUCCESS;
 }
 
+/* error allowed per adaptive step, relative to each state variable's size
+ * with an absolute floor for those near 0 such as the rotation's entries
+ */
+static const double ADAPTIVE_ABSOLUTE = 1e-6;
+static const double ADAPTIVE_RELATIVE = 1e-9;
+static const double ADAPTIVE_FIRST_STEP = 1e-3;
 
 RigidBody::RigidBody(const double mass, const double time):
   time(time),
-  mass_flow(merlin1d_fuel),
-  max_flow(merlin1d_fuel),
-  state(gsl_vector_calloc(STATE_SIZE)),
+  mass_flow(0.0),
+  max_flow(0.0),
+  isp_sea_level(0.0),
+  isp_vacuum(0.0),
+  drag(0.0),
+  phase(PHASE_ATMOSPHERE),
+  coast_mode(COAST_ENCKE),
+  coast(NULL),
+  coast_start(0.0),
+  adaptive_step(ADAPTIVE_FIRST_STEP),
+  adaptive_steps(0),
+  gimbal_on(false),
+  ode_state(gsl_vector_calloc(STATE_SIZE + GIMBAL_STATE_SIZE)),
   thrust_direction(gsl_vector_calloc(3)),
   inertia_tensor(gsl_matrix_calloc(3,3))
   {
+    this->state_view = gsl_vector_subvector(this->ode_state,0,STATE_SIZE);
+    this->state = &this->state_view.vector;
+
     /* rotation matrix starts as identity matrix */
     memcpy(&this->state->data[3],identity,9*sizeof(double));
 
@@ -182,24 +292,30 @@ RigidBody::RigidBody(const double mass, const double time):
 
     /* set thrust direction to be straight up at launch */
     gsl_vector_set(this->thrust_direction,1,1.0);
+    memcpy(this->attitude_target,this->thrust_direction->data,3*sizeof(double));
 
     this->ode_system = new gsl_odeiv2_system;
-    ode_system->function = rigid_body_ode;
-    ode_system->jacobian = NULL;
+    ode_system->function = phaseFunction(this->phase,false);
+    ode_system->jacobian = rigid_body_jacobian;
     ode_system->dimension = STATE_SIZE;
     ode_system->params = this;
 
     this->ode_step = gsl_odeiv2_step_alloc(gsl_odeiv2_step_rkf45, STATE_SIZE);
     //gsl_odeiv2_driver_set_hmax(this->ode_driver,10);
+    this->ode_control = gsl_odeiv2_control_y_new(ADAPTIVE_ABSOLUTE, ADAPTIVE_RELATIVE);
+    this->ode_evolve = gsl_odeiv2_evolve_alloc(STATE_SIZE);
   }
 
 RigidBody::~RigidBody(){
-  gsl_vector_free(this->state);
+  gsl_vector_free(this->ode_state);
   gsl_vector_free(this->thrust_direction);
   gsl_matrix_free(this->inertia_tensor);
 
   gsl_odeiv2_step_free(this->ode_step);
+  gsl_odeiv2_control_free(this->ode_control);
+  gsl_odeiv2_evolve_free(this->ode_evolve);
   delete this->ode_system;
+  delete this->coast;
 }
 
 gsl_matrix *RigidBody::star(gsl_vector *vector){
@@ -218,11 +334,25 @@ gsl_matrix *RigidBody::star(gsl_vector *vector){
   return out;
 }
 
-void RigidBody::update(const double dt){
+int RigidBody::update(const double dt){
+  RSIM_PROFILE_SCOPE("RigidBody::update");
+  RSIM_TRACE_SCOPE("RigidBody::update");
+  // the system function changes only when the phase does
+  const flight_phase_t phase = flightPhase(this->state->data,this->getBodyProperties(),dt);
+  if(phase != this->phase){
+    this->phase = phase;
+    this->ode_system->function = phaseFunction(phase,this->gimbal_on);
+    gsl_odeiv2_step_reset(this->ode_step);
+  }
+  if(phase == PHASE_COAST && this->coastTo(this->time + dt)){
+    return GSL_SUCCESS;
+  }
+
   // ODE
-  double error[STATE_SIZE];
+  double error[STATE_SIZE + GIMBAL_STATE_SIZE];
   const int code = gsl_odeiv2_step_apply(this->ode_step,this->time,dt,this->state->data, error, NULL, NULL, this->ode_system);
   this->time += dt;
+  this->followGimbal();
 
     /*
   printf("Error: ");
@@ -251,12 +381,54 @@ void RigidBody::update(const double dt){
       break;
 
     default:
-      assert(false);
+      std::cerr << "rigidbody update: " << gsl_strerror(code) << std::endl;
       break;
   }
 
   //this->state->data = result;
   nop();
+  return code;
+}
+
+int RigidBody::advanceTo(double time){
+  RSIM_PROFILE_SCOPE("RigidBody::advanceTo");
+  RSIM_TRACE_SCOPE("RigidBody::advanceTo");
+  if(!(time > this->time)){
+    return GSL_SUCCESS;
+  }
+  const flight_phase_t phase = flightPhase(this->state->data,this->getBodyProperties(),time - this->time);
+  if(phase != this->phase){
+    this->phase = phase;
+    this->ode_system->function = phaseFunction(phase,this->gimbal_on);
+    gsl_odeiv2_step_reset(this->ode_step);
+  }
+  if(phase == PHASE_COAST && this->coastTo(time)){
+    return GSL_SUCCESS;
+  }
+
+  int status = GSL_SUCCESS;
+  while(this->time < time){
+    const double step = this->adaptive_step;
+    const int code = gsl_odeiv2_evolve_apply(this->ode_evolve,this->ode_control,this->ode_step,this->ode_system,
+        &this->time,time,&this->adaptive_step,this->state->data);
+    if(code != GSL_SUCCESS){
+      std::cerr << "rigidbody advance: " << gsl_strerror(code) << std::endl;
+      this->time = time;
+      status = code;
+      break;
+    }
+    /* a step cut short to land on time says nothing of the size the error
+     * allows, start the next call from the size before it
+     */
+    if(this->time >= time){
+      this->adaptive_step = std::max(this->adaptive_step,step);
+    }
+  }
+  this->followGimbal();
+  RSIM_PROFILE_COUNT("adaptive steps",this->ode_evolve->count);
+  this->adaptive_steps += this->ode_evolve->count;
+  gsl_odeiv2_evolve_reset(this->ode_evolve);
+  return status;
 }
 
 gsl_matrix const*RigidBody::getInertiaTensor() const {
@@ -268,13 +440,61 @@ gsl_vector const *RigidBody::getThrustDirection() const {
 }
 
 void RigidBody::setThrustDirection(double direction[]){
+  if(this->gimbal_on){
+    /* only the gimbal's rates see this, the thrust stays continuous */
+    memcpy(this->attitude_target,direction,3*sizeof(double));
+    return;
+  }
   memcpy(this->thrust_direction->data,direction,3*sizeof(double));
   gsl_odeiv2_step_reset(this->ode_step);
 }
 
+void RigidBody::setGimbal(const GimbalSettings *settings){
+  const bool on = settings != NULL;
+  if(on){
+    this->gimbal = *settings;
+  }
+  if(on != this->gimbal_on){
+    /* the integrator carries the angles only while the gimbal is on */
+    this->gimbal_on = on;
+    this->ode_system->dimension = STATE_SIZE + (on ? GIMBAL_STATE_SIZE : 0);
+    this->ode_system->function = phaseFunction(this->phase,on);
+    this->ode_system->jacobian = on ? rigid_body_gimbal_jacobian : rigid_body_jacobian;
+    this->setStepper(this->ode_step->type);
+    gsl_odeiv2_evolve_free(this->ode_evolve);
+    this->ode_evolve = gsl_odeiv2_evolve_alloc(this->ode_system->dimension);
+    /* centred, aiming the long axis where the thrust pointed */
+    for(unsigned int k = 0; k < GIMBAL_STATE_SIZE; ++k){
+      this->ode_state->data[GIMBAL_START+k] = 0.0;
+    }
+    memcpy(this->attitude_target,this->thrust_direction->data,3*sizeof(double));
+    this->followGimbal();
+  }
+  this->endCoast();
+}
+
+GimbalSettings const *RigidBody::getGimbal() const {
+  return this->gimbal_on ? &this->gimbal : NULL;
+}
+
+double const *RigidBody::getAttitudeTarget() const {
+  return this->attitude_target;
+}
+
+void RigidBody::getGimbalAngles(double angles[GIMBAL_STATE_SIZE]) const {
+  memcpy(angles,&this->ode_state->data[GIMBAL_START],GIMBAL_STATE_SIZE*sizeof(double));
+}
+
+void RigidBody::followGimbal(){
+  if(this->gimbal_on){
+    gimbalThrust(&this->state->data[STATE_ROTATION_START],&this->ode_state->data[GIMBAL_START],this->thrust_direction->data);
+  }
+}
+
 void RigidBody::updateInertiaTensor(double inertia_tensor[]){
   memcpy(this->inertia_tensor->data,inertia_tensor,9*sizeof(double));
   gsl_odeiv2_step_reset(this->ode_step);
+  this->endCoast();
 }
 
 double RigidBody::getMass(){
@@ -283,6 +503,8 @@ double RigidBody::getMass(){
 
 
 void RigidBody::print(bool use_spreadsheet) {
+  RSIM_PROFILE_SCOPE("print");
+  RSIM_TRACE_SCOPE("print");
   if(use_spreadsheet) {
     printSpreadsheetStyle();
   } else {
@@ -356,18 +578,172 @@ void RigidBody::throttle(double throttle){
   }
   mass_flow = throttle*max_flow;
   gsl_odeiv2_step_reset(this->ode_step);
+  this->endCoast();
 }
 
 double RigidBody::getMassFlow() const {
   return this->mass_flow;
 }
 
+void RigidBody::setEngine(double mass_flow, double sea_level, double vacuum){
+  this->mass_flow = mass_flow;
+  this->max_flow = mass_flow;
+  this->isp_sea_level = sea_level;
+  this->isp_vacuum = vacuum;
+  gsl_odeiv2_step_reset(this->ode_step);
+  this->endCoast();
+}
+
+void RigidBody::setDrag(double drag){
+  this->drag = drag;
+  gsl_odeiv2_step_reset(this->ode_step);
+  this->endCoast();
+}
+
+BodyProperties<double> RigidBody::getBodyProperties() const {
+  BodyProperties<double> body;
+  body.mass_flow = this->mass_flow;
+  memcpy(body.thrust_direction,this->thrust_direction->data,3*sizeof(double));
+  memcpy(body.centre_of_mass,this->centre_of_mass,3*sizeof(double));
+  memcpy(body.inertia_tensor,this->inertia_tensor->data,9*sizeof(double));
+  body.isp_sea_level = this->isp_sea_level;
+  body.isp_vacuum = this->isp_vacuum;
+  body.drag = this->drag;
+  return body;
+}
+
 void RigidBody::nextstage(double newmass){
-  vac_thruster = true;
-  mass_flow = merlinvac_fuel;
-  max_flow = mass_flow;
   gsl_vector_set(this->state,19,newmass);
   gsl_odeiv2_step_reset(this->ode_step);
+  this->endCoast();
+}
+
+void RigidBody::setStepper(const gsl_odeiv2_step_type *type){
+  gsl_odeiv2_step_free(this->ode_step);
+  this->ode_step = gsl_odeiv2_step_alloc(type, this->ode_system->dimension);
+}
+
+void RigidBody::setCoast(coast_mode_t mode){
+  this->coast_mode = mode;
+  this->endCoast();
+}
+
+bool RigidBody::coastTo(double time){
+  if(this->coast_mode == COAST_INTEGRATE || this->mass_flow != 0.0 || time < this->time){
+    return false;
+  }
+  RSIM_PROFILE_SCOPE("RigidBody::coastTo");
+  double *y = this->state->data;
+  const double m = y[STATE_MASS];
+  if(this->coast == NULL){
+    /* no torque without thrust, so L stays put and the body keeps the
+     * angular velocity it had when the engines stopped
+     */
+    double r[3], v[3];
+    for(int i = 0; i < 3; ++i){
+      r[i] = y[STATE_POSITION_START+i] - earth.position[i];
+      v[i] = y[STATE_LINEAR_MOMENTUM_START+i]/m;
+    }
+    this->coast = new CoastOrbit(r,v,this->coast_mode == COAST_ENCKE ? this->drag/m : 0.0);
+    this->coast_start = this->time;
+    memcpy(this->coast_rotation,&y[STATE_ROTATION_START],9*sizeof(double));
+    angularVelocity(this->coast_rotation,&y[STATE_ANGULAR_MOMENTUM_START],this->inertia_tensor->data,this->coast_spin);
+  }
+
+  double r[3], v[3];
+  if(!this->coast->advance(time - this->coast_start,r,v)){
+    this->endCoast();
+    return false;
+  }
+  for(int i = 0; i < 3; ++i){
+    y[STATE_POSITION_START+i] = earth.position[i] + r[i];
+    y[STATE_LINEAR_MOMENTUM_START+i] = m*v[i];
+  }
+  coastRotation(this->coast_rotation,this->coast_spin,time - this->coast_start,&y[STATE_ROTATION_START]);
+  this->time = time;
+  this->followGimbal();
+  return true;
+}
+
+void RigidBody::endCoast(){
+  delete this->coast;
+  this->coast = NULL;
+}
+
+double RigidBody::checkJacobian(bool verbose) const {
+  const unsigned int N = STATE_SIZE;
+  double analytic[N*N];
+  double dfdt[N];
+  double y[N];
+  double f[N];
+  double forward[N];
+  double backward[N];
+  memcpy(y,this->state->data,N*sizeof(double));
+  rigid_body_jacobian(this->time,y,analytic,dfdt,(void *) this);
+  rigid_body_ode<PHASE_ATMOSPHERE>(this->time,y,f,(void *) this);
+
+  /* step sizes follow the size of each block, a position near the launch
+   * site is small but gravity varies on the scale of the distance to earth
+   */
+  double block_scale[N];
+  for(unsigned int j = 0; j < N; ++j){
+    block_scale[j] = 1.0;
+  }
+  const double earth_offset[3] = {y[0] - earth.position[0],y[1] - earth.position[1],y[2] - earth.position[2]};
+  const double earth_distance = sqrt(earth_offset[0]*earth_offset[0] + earth_offset[1]*earth_offset[1] + earth_offset[2]*earth_offset[2]);
+  const double momentum = sqrt(y[12]*y[12] + y[13]*y[13] + y[14]*y[14]);
+  const double angular_momentum = sqrt(y[15]*y[15] + y[16]*y[16] + y[17]*y[17]);
+  for(unsigned int j = 0; j < 3; ++j){
+    block_scale[STATE_POSITION_START+j] = earth_distance;
+    block_scale[STATE_LINEAR_MOMENTUM_START+j] = fmax(momentum,1.0);
+    block_scale[STATE_ANGULAR_MOMENTUM_START+j] = fmax(angular_momentum,1.0);
+  }
+  block_scale[STATE_MASS] = y[STATE_MASS];
+
+  /* entries are compared against the size of their row, since a small entry
+   * can come out of terms that cancel and differences cannot resolve it
+   */
+  double row_scale[N];
+  for(unsigned int i = 0; i < N; ++i){
+    row_scale[i] = 0.0;
+    for(unsigned int j = 0; j < N; ++j){
+      row_scale[i] = fmax(row_scale[i],fabs(analytic[i*N + j])*block_scale[j]);
+    }
+  }
+
+  /* central differences, one column at a time */
+  double worst = 0.0;
+  for(unsigned int j = 0; j < N; ++j){
+    const double original = y[j];
+    const double h = 1e-5*block_scale[j];
+    y[j] = original + h;
+    rigid_body_ode<PHASE_ATMOSPHERE>(this->time,y,forward,(void *) this);
+    y[j] = original - h;
+    rigid_body_ode<PHASE_ATMOSPHERE>(this->time,y,backward,(void *) this);
+    y[j] = original;
+
+    for(unsigned int i = 0; i < N; ++i){
+      const double numeric = (forward[i] - backward[i])/(2.0*h);
+      const double exact = analytic[i*N + j];
+      const double noise = 1e-6*(row_scale[i] + fabs(f[i]))/block_scale[j];
+      const double scale = fmax(fmax(fabs(numeric),fabs(exact)),noise);
+      if(scale < 1e-12){
+        continue;
+      }
+      const double error = fabs(numeric - exact)/scale;
+      if(verbose && error > 1e-4){
+        printf("jacobian (%u,%u): analytic %g numeric %g\n",i,j,exact,numeric);
+      }
+      if(error > worst){
+        worst = error;
+      }
+    }
+  }
+  return worst;
+}
+
+unsigned long RigidBody::getAdaptiveSteps() const {
+  return this->adaptive_steps;
 }
 
 double RigidBody::getTime(){
@@ -6,6 +6,10 @@
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_odeiv2.h>
 
+#include "coast.hpp"
+#include "flightmodel.hpp"
+#include "gimbal.hpp"
+
 
 
 
@@ -15,7 +19,17 @@ public:
 
   ~RigidBody();
 
-  void update(const double dt);
+  /* one step of dt, GSL_SUCCESS or the status GSL failed it with */
+  int update(const double dt);
+
+  /* integrate to exactly time in as many steps as the error allows, each
+   * call starts from the step size the last one ended on. GSL_SUCCESS or the
+   * status GSL failed with, the time is then moved on to time regardless
+   */
+  int advanceTo(double time);
+
+  /* steps advanceTo has taken, not counting those the error rejected */
+  unsigned long getAdaptiveSteps() const;
 
   /* compute the star of angular velocity given as a vector
    * this matrix should be freed using gsl_matrix_free()
@@ -29,8 +43,22 @@ public:
 
   gsl_vector const *getThrustDirection() const;
 
+  /* with the gimbal on this is where the controller points the long axis,
+   * the thrust follows through the gimbal
+   */
   void setThrustDirection(double direction[]);
 
+  /* steer the thrust through a gimbal, NULL points it directly again */
+  void setGimbal(const GimbalSettings *settings);
+
+  /* the gimbal settings, NULL while it is off */
+  GimbalSettings const *getGimbal() const;
+
+  double const *getAttitudeTarget() const;
+
+  /* the gimbal's angles, 0 while it is off */
+  void getGimbalAngles(double angles[GIMBAL_STATE_SIZE]) const;
+
   void updateInertiaTensor(double inertia_tensor[]);
 
   double getMass();
@@ -42,10 +70,35 @@ public:
 
   double getMassFlow() const;
 
-  /* make changes for stage 2 */
+  /* engines at full throttle: fuel flow in kg/s and specific impulse at sea
+   * level and above the karman line
+   */
+  void setEngine(double mass_flow, double sea_level, double vacuum);
+
+  /* linear drag in kg/s, the force is -drag times the velocity */
+  void setDrag(double drag);
+
+  /* snapshot of what the derivative depends on besides the state */
+  BodyProperties<double> getBodyProperties() const;
+
+  /* drop everything but newmass, setEngine gives the next stage's engines */
   void nextstage(double newmass);
 
-  bool vac_thruster = false;
+  /* switch integration method, implicit steppers use the analytic jacobian */
+  void setStepper(const gsl_odeiv2_step_type *type);
+
+  /* how update flies while the engines are off, COAST_ENCKE by default */
+  void setCoast(coast_mode_t mode);
+
+  /* jump straight to a later time while the engines are off, false if they
+   * are not or the coast mode integrates
+   */
+  bool coastTo(double time);
+
+  /* largest relative difference between the analytic jacobian and central
+   * differences of the derivative at the current state
+   */
+  double checkJacobian(bool verbose=false) const;
 
   double getTime();
 
@@ -59,13 +112,37 @@ private:
   double time;
   double mass_flow; /* consumption of fuel in kg/s */
   double max_flow;
+  double isp_sea_level;
+  double isp_vacuum;
+  double drag;
+  flight_phase_t phase; /* the derivative ode_system runs */
+  coast_mode_t coast_mode;
+  CoastOrbit *coast; /* the coast under way, NULL while integrating */
+  double coast_start;
+  double coast_rotation[9]; /* R and angular velocity as the coast started */
+  double coast_spin[3];
+  double adaptive_step; /* where the next advanceTo starts */
+  unsigned long adaptive_steps;
+  bool gimbal_on;
+  GimbalSettings gimbal;
+  double attitude_target[3];
   double centre_of_mass[3];
+  gsl_vector *ode_state; /* the state with the gimbal angles after it */
+  gsl_vector_view state_view;
   gsl_vector *state;
   gsl_vector *thrust_direction;
   gsl_matrix *inertia_tensor;
 
   gsl_odeiv2_system *ode_system;
   gsl_odeiv2_step *ode_step;
+  gsl_odeiv2_control *ode_control;
+  gsl_odeiv2_evolve *ode_evolve;
+
+  /* forget the coast after anything that changes the forces */
+  void endCoast();
+
+  /* the thrust direction from the rotation and the gimbal angles */
+  void followGimbal();
 
   // default printing style
   void printDefaultStyle();
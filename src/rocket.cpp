@@ -11,38 +11,27 @@
 
 #include "common.hpp"
 #include "earth.hpp"
+#include "flightmodel.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+
+static StageTable<double> stageTable(const FlightParameters<double> &parameters){
+  StageTable<double> table;
+  buildStageTable(parameters,&table);
+  return table;
+}
 
-/* dimensions of each stage, stage 0 represents when all stages are part of the
- * rocket (ie. the total), stage n is the value of that stage itself
- */
-
-/* heights in metres of each stage */
-static const double stage_heights[] = {70,47,12.6};
-
-/* masses of each stage, with total in 0
- * the fuel mass for a stage is the total fuel that can be burned for it
- * ie. a stage can not use more than that much fuel
- */
-static const double stage_mass_empty[] = {26200,22200,4000};
-static const double stage_mass_fuel[] = {507500,398887,108185};
-
-/* payload of launch from video (dragon spacecraft) */
-static const double payload_mass = 6000;
-static const double payload_height = 6.1;
-
-Rocket::Rocket(const double dt):
+Rocket::Rocket(const double dt, const FlightParameters<double> &parameters):
   stage(1),
   dt(dt),
-  rigid_body(stage_mass_empty[0] + stage_mass_fuel[0] + payload_mass,0.0),
-  radius(3.66/2),
+  parameters(parameters),
+  table(stageTable(parameters)),
+  rigid_body(table.launch_mass,0.0),
+  log(stdout),
   stage_progress(S1LAUNCH){
+    rigid_body.setEngine(table.mass_flow[0],table.isp_sea_level[0],table.isp_vacuum[0]);
+    rigid_body.setDrag(parameters[PARAMETER_DRAG]);
     recomputeCentreMass();
-    /* compute second stage inertia tensor */
-    memset(inertia_tensor_s2,0,9*sizeof(double));
-    double m2 = stage_mass_empty[2] + stage_mass_fuel[2];
-    inertia_tensor_s2[0] = m2*(radius*radius*3.0 + stage_heights[2]*stage_heights[2])/12.0;
-    inertia_tensor_s2[4] = inertia_tensor_s2[0];
-    inertia_tensor_s2[8] = m2*radius*radius/2;
     recomputeInertiaTensor();
 
     target_orbital_velocity = orbital_velocity(earth.mass,earth.radius+LEO);
@@ -52,38 +41,43 @@ Rocket::~Rocket(){
 
 }
 
-void Rocket::step(){
+int Rocket::step(){
+  RSIM_PROFILE_SCOPE("Rocket::step");
+  RSIM_TRACE_SCOPE("Rocket::step");
   /* debug breakline */
   if(this->rigid_body.getTime() > 20.0){
     nop();
   }
-  this->rigid_body.update(this->dt);
-  double fuel_in_stage = 0;
-  if(stage == 1){
-    fuel_in_stage = this->rigid_body.getMass() - stage_mass_empty[0] - stage_mass_fuel[2];
-    if(fuel_in_stage <= 0.0){
-      this->nextstage();
-    }
-    if(this->rigid_body.getTime() > 20.0 && stage_progress == S1LAUNCH){
-      //stage_progress = S1ASCENT;
-      /* start thrusting towards orbit line to prepare rocket orientation in stage 2 */
-      double orientation[3];
-      gsl_matrix *rotation = gsl_matrix_alloc(3,3);
-      gsl_vector_view o_view = gsl_vector_view_array(orientation,3);
-      gsl_vector_const_view yupview = gsl_vector_const_view_array(y_up,3);
-      create_rotation_matrix(rotation,-M_PI/32,ROTATION_AXIS_Z);
-      gsl_blas_dgemv(CblasNoTrans,1.0,rotation,&yupview.vector,0.0,&o_view.vector);
-
-      rigid_body.setThrustDirection(orientation);
-      gsl_matrix_free(rotation);
-    }
-  }else if (stage == 2){
-    fuel_in_stage = this->rigid_body.getMass() - stage_mass_empty[2];
+  const int status = this->rigid_body.update(this->dt);
+  this->control();
+  this->guide();
+  return status;
+}
+
+int Rocket::advanceTo(double time){
+  return this->rigid_body.advanceTo(time);
+}
+
+void Rocket::guide(){
+  RSIM_PROFILE_SCOPE("Rocket::guide");
+  if(stage == 1 && this->rigid_body.getTime() > parameters[PARAMETER_PITCH_TIME] && stage_progress == S1LAUNCH){
+    //stage_progress = S1ASCENT;
+    /* start thrusting towards orbit line to prepare rocket orientation in stage 2 */
+    double orientation[3];
+    kickDirection(parameters,orientation);
+    rigid_body.setThrustDirection(orientation);
+  }
+}
+
+void Rocket::control(){
+  RSIM_PROFILE_SCOPE("Rocket::control");
+  if(stage <= table.stages){
+    const double fuel_in_stage = this->rigid_body.getMass() - table.burnout[stage-1];
     if(fuel_in_stage <= 0.0){
       this->nextstage();
     }
   }
-  if(stage < 3){
+  if(stage <= table.stages){
     this->recomputeCentreMass();
     this->recomputeInertiaTensor();
   }
@@ -126,144 +120,76 @@ glm::mat4 Rocket::getRotationMatrix(){
 
 }
 
+void Rocket::setLog(FILE *log){
+  this->log = log;
+}
+
 unsigned int Rocket::getStageProgress() {
   return stage;
 }
 
-void Rocket::recomputeInertiaTensor(){
-  double it[9];
-
-  memset(it,0,9*sizeof(double)); /* zero out inertia tensor */
-
-  /* first stage inertia tensor changes, second stage remains same */
-  if(stage == 1){
-    memset(inertia_tensor_s1,0,9*sizeof(double));
-    const double m2 = stage_mass_empty[2] + stage_mass_fuel[2];
-    const double m1 = this->rigid_body.getMass() - m2;
-    const double h1 = stage_heights[1];
-    inertia_tensor_s1[0] = m1*(3.0*radius*radius + h1*h1)/12.0;
-    inertia_tensor_s1[4] = inertia_tensor_s1[0];
-    inertia_tensor_s1[8] = m1*radius*radius/2.0;
-
-    double stage1_empty_centre[3] = {radius,stage_heights[1]/2.0,radius};
-    double stage2_centre[3] = {radius,stage_heights[0] - (stage_heights[2]/2.0),radius};
+double Rocket::getTime(){
+  return this->rigid_body.getTime();
+}
 
-    gsl_matrix_view itview = gsl_matrix_view_array(it,3,3);
-    gsl_matrix_view its1 = gsl_matrix_view_array(inertia_tensor_s1,3,3);
-    gsl_matrix_view its2 = gsl_matrix_view_array(inertia_tensor_s2,3,3);
+gsl_vector const *Rocket::getState() const {
+  return this->rigid_body.getState();
+}
 
-    gsl_matrix_add(&itview.matrix,&its1.matrix);
-    gsl_matrix_add(&itview.matrix,&its2.matrix);
+void Rocket::setStepper(const gsl_odeiv2_step_type *type){
+  this->rigid_body.setStepper(type);
+}
 
-    gsl_matrix_view coms1 = gsl_matrix_view_array(stage1_empty_centre,3,1);
-    gsl_matrix_view coms2 = gsl_matrix_view_array(stage2_centre,3,1);
-    gsl_matrix_const_view comview = gsl_matrix_const_view_array(centre_of_mass,3,1);
+void Rocket::setCoast(coast_mode_t mode){
+  this->rigid_body.setCoast(mode);
+}
 
-    /* compute dyads of centre of mass offsets */
-    gsl_matrix_sub(&coms1.matrix,&comview.matrix);
-    gsl_matrix_sub(&coms2.matrix,&comview.matrix);
+void Rocket::setGimbal(const GimbalSettings *settings){
+  this->rigid_body.setGimbal(settings);
+}
 
-    gsl_matrix *s1dyad = gsl_matrix_alloc(3,3);
-    gsl_matrix *s2dyad = gsl_matrix_alloc(3,3);
+void Rocket::getGimbalAngles(double angles[GIMBAL_STATE_SIZE]) const {
+  this->rigid_body.getGimbalAngles(angles);
+}
 
-    gsl_blas_dgemm(CblasNoTrans,CblasTrans,1.0,&coms1.matrix,&coms1.matrix,0.0,s1dyad);
-    gsl_blas_dgemm(CblasNoTrans,CblasTrans,1.0,&coms2.matrix,&coms2.matrix,0.0,s2dyad);
+bool Rocket::coastTo(double time){
+  return this->rigid_body.coastTo(time);
+}
 
-    double dots1 = 0.0;
-    double dots2 = 0.0;
-    for(unsigned int i = 0; i < 3; ++i){
-      dots1 += stage1_empty_centre[i]*stage1_empty_centre[i];
-      dots2 += stage2_centre[i]*stage2_centre[i];
-    }
+double Rocket::checkJacobian(bool verbose) const {
+  return this->rigid_body.checkJacobian(verbose);
+}
 
-    /* compute inertia tensor COM offsets */
-    gsl_matrix *s1sum = gsl_matrix_alloc(3,3);
-    gsl_matrix *s2sum = gsl_matrix_alloc(3,3);
-    gsl_matrix_const_view iview = gsl_matrix_const_view_array(identity,3,3);
-
-    memcpy(s1sum->data,&iview.matrix.data,9*sizeof(double));
-    memcpy(s2sum->data,&iview.matrix.data,9*sizeof(double));
-
-    /* finally sum up the mass contribution of each body into the inertia tensor */
-    gsl_matrix_scale(s1sum,dots1);
-    gsl_matrix_sub(s1sum,s1dyad);
-    gsl_matrix_scale(s1sum,m1);
-    gsl_matrix_add(&itview.matrix,s1sum);
-
-    gsl_matrix_scale(s2sum,dots2);
-    gsl_matrix_sub(s2sum,s2dyad);
-    gsl_matrix_scale(s2sum,m2);
-    gsl_matrix_add(&itview.matrix,s2sum);
-
-    gsl_matrix_free(s2sum);
-    gsl_matrix_free(s1sum);
-    gsl_matrix_free(s2dyad);
-    gsl_matrix_free(s1dyad);
-  }
-  /* no first stage anymore, second stage tensor changes */
-  else if(stage == 2){
-    const double h2 = stage_heights[2];
-    const double m2 = this->rigid_body.getMass();
-    it[0] = m2*(3.0*radius*radius+h2*h2)/12.0;
-    it[4] = it[0];
-    it[8] = m2*radius*radius/2.0;
-  }else if(stage == 3){
-    it[0] = payload_mass*(3.0*radius*radius+payload_height*payload_height)/12.0;
-    it[4] = it[0];
-    it[8] = payload_mass*radius*radius/2.0;
-  }
+unsigned long Rocket::getAdaptiveSteps() const {
+  return this->rigid_body.getAdaptiveSteps();
+}
 
+void Rocket::recomputeInertiaTensor(){
+  RSIM_PROFILE_SCOPE("Rocket::recomputeInertiaTensor");
+  double it[9];
+  stageInertiaTensor(stage,this->rigid_body.getMass(),this->centre_of_mass,table,it);
   this->rigid_body.updateInertiaTensor(it);
 }
 
 void Rocket::recomputeCentreMass(){
-  if(stage == 1){
-    /* stage2 is uniformly distributed mass of rocket and fuel during stage 1,
-     * so the centre is right where the physical centre of stage 2
-     */
-    double stage2_centre[3] = {radius,stage_heights[0] - (stage_heights[2]/2),radius};
-    const double stage2_mass = stage_mass_empty[2] + stage_mass_fuel[2];
-
-    /* stage 1 contains empty portion and fuel, so TODO: centre of mass will
-     * be between these 2 quantities
-     */
-    double stage1_empty_centre[3] = {radius,stage_heights[1]/2.0,radius};
-    const double stage1_mass = this->rigid_body.getMass() - stage2_mass;
-
-    memset(this->centre_of_mass,0,3*sizeof(double));
-    gsl_vector_view COMview = gsl_vector_view_array(this->centre_of_mass,3);
-    gsl_vector_view s2_com = gsl_vector_view_array(stage2_centre,3);
-    gsl_vector_view s1_com = gsl_vector_view_array(stage1_empty_centre,3);
-
-    gsl_vector_scale(&s2_com.vector,stage2_mass);
-    gsl_vector_scale(&s1_com.vector,stage1_mass);
-
-    gsl_vector_add(&COMview.vector,&s2_com.vector);
-    gsl_vector_add(&COMview.vector,&s1_com.vector);
-
-    gsl_vector_scale(&COMview.vector,1.0/(stage1_mass+stage2_mass));
-  }else if(stage == 2){
-    double stage2_empty_centre[3] = {radius,stage_heights[2]/2,radius};
-    const double stage2_mass = this->rigid_body.getMass();
-    memcpy(this->centre_of_mass,stage2_empty_centre,3*sizeof(double));
-  }else if(stage == 3){
-    this->centre_of_mass[0] = radius;
-    this->centre_of_mass[1] = payload_height/2.0;
-    this->centre_of_mass[2] = radius;
-  }
+  RSIM_PROFILE_SCOPE("Rocket::recomputeCentreMass");
+  stageCentreOfMass(stage,this->rigid_body.getMass(),table,this->centre_of_mass);
   rigid_body.setCentreOfMass(this->centre_of_mass);
 }
 
 void Rocket::nextstage(){
-  printf("Fuel in %d ran out, staging\n",stage);
-  if(stage == 1){
-    rigid_body.nextstage(stage_mass_fuel[2]+stage_mass_empty[2]+payload_mass);
-    ++stage;
-  }else if(stage == 2){
-    rigid_body.nextstage(payload_mass);
-    rigid_body.throttle(0.0);
-    ++stage;
-    recomputeCentreMass();
-    recomputeInertiaTensor();
+  static const char *const stagings[VEHICLE_MAX_STAGES] = {
+    "staging 1", "staging 2", "staging 3", "staging 4",
+    "staging 5", "staging 6", "staging 7", "staging 8"};
+  RSIM_PROFILE_COUNT("stagings",1);
+  RSIM_TRACE_INSTANT(stagings[stage-1]);
+  if(this->log != NULL){
+    fprintf(this->log,"Fuel in %d ran out, staging\n",stage);
   }
+  /* the last stage leaves the payload with an engine of no flow */
+  rigid_body.nextstage(table.mass_above[stage-1]);
+  rigid_body.setEngine(table.mass_flow[stage],table.isp_sea_level[stage],table.isp_vacuum[stage]);
+  ++stage;
+  recomputeCentreMass();
+  recomputeInertiaTensor();
 }
@@ -1,12 +1,15 @@
 #ifndef RSIM_ROCKET_HPP
 #define RSIM_ROCKET_HPP
-/* rocket class based on the SpaceX Falcon 9 */
+/* rocket class, by default the SpaceX Falcon 9 */
+#include <cstdio>
+
 #include "rigidbody.hpp"
+#include "flightmodel.hpp"
 #include <glm/glm.hpp>
 
 class Rocket{
 public:
-  Rocket(const double dt);
+  Rocket(const double dt, const FlightParameters<double> &parameters = FlightParameters<double>());
   ~Rocket();
 
   enum stage_progress{
@@ -18,7 +21,21 @@ public:
       NUMBER_OF_STAGES // keep track of stage progress size
     } stage_progress;
 
-  void step();
+  /* one fixed step of dt, then control and guidance. GSL_SUCCESS or the
+   * status the integrator failed with, the state is not to be trusted then
+   */
+  int step();
+
+  /* integrate to exactly time with adaptive steps, with no control or
+   * guidance on the way, GSL_SUCCESS or the integrator's failure
+   */
+  int advanceTo(double time);
+
+  /* point the thrust where the flight plan wants it now */
+  void guide();
+
+  /* stage when the fuel runs out and follow the shrinking mass */
+  void control();
 
   void print(bool use_spreadsheet=false);
 
@@ -30,15 +47,39 @@ public:
 
   unsigned int getStageProgress();
 
+  double getTime();
+
+  gsl_vector const *getState() const;
+
+  void setStepper(const gsl_odeiv2_step_type *type);
+
+  void setCoast(coast_mode_t mode);
+
+  /* steer through a thrust vector control gimbal, NULL to point the thrust
+   * directly
+   */
+  void setGimbal(const GimbalSettings *settings);
+
+  void getGimbalAngles(double angles[GIMBAL_STATE_SIZE]) const;
+
+  /* where staging is announced, stdout unless set, NULL for nowhere */
+  void setLog(FILE *log);
+
+  /* jump to a later time while the engines are off, false while they burn */
+  bool coastTo(double time);
+
+  double checkJacobian(bool verbose=false) const;
+
+  unsigned long getAdaptiveSteps() const;
+
 private:
   unsigned int stage; /* stage rocket is on */
   const double dt;
+  const FlightParameters<double> parameters;
+  StageTable<double> table;
   double centre_of_mass[3];
-  double inertia_tensor_s2[9];
-  double inertia_tensor_s1[9];
   RigidBody rigid_body;
-
-  const double radius;
+  FILE *log;
 
   double target_orbital_velocity;
 
@@ -0,0 +1,279 @@
+#include "rsim_c.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <gsl/gsl_errno.h>
+
+#include "flightmodel.hpp"
+#include "rocket.hpp"
+
+/* the C enums mirror the C++ ones, keep them in step */
+static_assert(RSIM_STATE_SIZE == RIGID_BODY_STATE_SIZE, "state size differs from flightmodel.hpp");
+static_assert(RSIM_STATE_MASS == STATE_MASS, "state layout differs from flightmodel.hpp");
+static_assert((int) RSIM_PARAMETER_COUNT == (int) FLIGHT_PARAMETER_COUNT, "parameter count differs from flightmodel.hpp");
+static_assert((int) RSIM_PARAMETER_DRAG == (int) PARAMETER_DRAG, "parameter order differs from flightmodel.hpp");
+
+struct rsim_rocket{
+  const FlightParameters<double> parameters;
+  Rocket rocket;
+
+  rsim_rocket(double dt, const FlightParameters<double> &parameters):
+    parameters(parameters),
+    rocket(dt,parameters){
+      rocket.setLog(NULL);
+    }
+};
+
+static FlightParameters<double> toParameters(const double *values){
+  FlightParameters<double> parameters;
+  if(values != NULL){
+    for(unsigned int i = 0; i < FLIGHT_PARAMETER_COUNT; ++i){
+      parameters[i] = values[i];
+    }
+  }
+  return parameters;
+}
+
+unsigned int rsim_api_version(void){
+  return RSIM_API_VERSION;
+}
+
+void rsim_init(void){
+  gsl_set_error_handler_off();
+}
+
+void rsim_default_parameters(double parameters[RSIM_PARAMETER_COUNT]){
+  const FlightParameters<double> defaults;
+  for(unsigned int i = 0; i < FLIGHT_PARAMETER_COUNT; ++i){
+    parameters[i] = defaults[i];
+  }
+}
+
+rsim_rocket *rsim_create(double dt, const double *parameters){
+  if(!(dt > 0.0)){
+    return NULL;
+  }
+  try{
+    return new rsim_rocket(dt,toParameters(parameters));
+  }catch(...){
+    return NULL;
+  }
+}
+
+void rsim_destroy(rsim_rocket *rocket){
+  delete rocket;
+}
+
+rsim_status rsim_step(rsim_rocket *rocket, unsigned long steps){
+  if(rocket == NULL){
+    return RSIM_ERROR_ARGUMENT;
+  }
+  try{
+    for(unsigned long i = 0; i < steps; ++i){
+      if(rocket->rocket.step() != GSL_SUCCESS){
+        return RSIM_ERROR_INTEGRATION;
+      }
+    }
+  }catch(const std::bad_alloc &){
+    return RSIM_ERROR_MEMORY;
+  }catch(...){
+    return RSIM_ERROR_INTERNAL;
+  }
+  return RSIM_OK;
+}
+
+rsim_status rsim_run_to_event(rsim_rocket *rocket, int mask, double max_time, rsim_event *event){
+  if(rocket == NULL || (mask & RSIM_EVENT_ANY) == 0){
+    return RSIM_ERROR_ARGUMENT;
+  }
+  Rocket &flight = rocket->rocket;
+  const double pitch_time = rocket->parameters[PARAMETER_PITCH_TIME];
+  rsim_event happened = RSIM_EVENT_NONE;
+  try{
+    while(happened == RSIM_EVENT_NONE && flight.getTime() < max_time){
+      const unsigned int stage = flight.getStageProgress();
+      /* the rocket turns on the first step that starts past the pitch time */
+      const bool before_pitch = stage == 1 && flight.getTime() <= pitch_time;
+      if(flight.step() != GSL_SUCCESS){
+        return RSIM_ERROR_INTEGRATION;
+      }
+      if((mask & RSIM_EVENT_STAGING) && flight.getStageProgress() != stage){
+        happened = RSIM_EVENT_STAGING;
+      }else if((mask & RSIM_EVENT_PITCH) && before_pitch && flight.getTime() > pitch_time){
+        happened = RSIM_EVENT_PITCH;
+      }
+    }
+  }catch(const std::bad_alloc &){
+    return RSIM_ERROR_MEMORY;
+  }catch(...){
+    return RSIM_ERROR_INTERNAL;
+  }
+  if(event != NULL){
+    *event = happened;
+  }
+  return RSIM_OK;
+}
+
+double rsim_time(const rsim_rocket *rocket){
+  return rocket != NULL ? const_cast<Rocket&>(rocket->rocket).getTime() : 0.0;
+}
+
+unsigned int rsim_stage(const rsim_rocket *rocket){
+  return rocket != NULL ? const_cast<Rocket&>(rocket->rocket).getStageProgress() : 0;
+}
+
+const double *rsim_state(const rsim_rocket *rocket){
+  return rocket != NULL ? rocket->rocket.getState()->data : NULL;
+}
+
+rsim_status rsim_trajectory_init(rsim_trajectory *trajectory, double *data, size_t capacity,
+    size_t sample_stride, size_t field_stride){
+  if(trajectory == NULL){
+    return RSIM_ERROR_ARGUMENT;
+  }
+  if(field_stride == 0){
+    sample_stride = RSIM_FIELD_COUNT;
+    field_stride = 1;
+  }
+  /* the last field of the last sample has to land inside the buffer without
+   * two fields of different samples sharing a slot
+   */
+  if(sample_stride == 0 || (sample_stride < (size_t) RSIM_FIELD_COUNT*field_stride && field_stride < capacity*sample_stride)){
+    return RSIM_ERROR_ARGUMENT;
+  }
+  trajectory->data = data;
+  trajectory->capacity = capacity;
+  trajectory->count = 0;
+  trajectory->sample_stride = sample_stride;
+  trajectory->field_stride = field_stride;
+  trajectory->owned = 0;
+  if(data == NULL && capacity > 0){
+    const size_t size = (capacity - 1)*sample_stride + (RSIM_FIELD_COUNT - 1)*field_stride + 1;
+    trajectory->data = (double *) calloc(size,sizeof(double));
+    if(trajectory->data == NULL){
+      return RSIM_ERROR_MEMORY;
+    }
+    trajectory->owned = 1;
+  }
+  return RSIM_OK;
+}
+
+void rsim_trajectory_free(rsim_trajectory *trajectory){
+  if(trajectory != NULL && trajectory->owned){
+    free(trajectory->data);
+    trajectory->data = NULL;
+    trajectory->capacity = 0;
+    trajectory->count = 0;
+    trajectory->owned = 0;
+  }
+}
+
+/* the current sample at the end of the trajectory, false when it is full */
+static bool appendSample(Rocket &rocket, rsim_trajectory *trajectory){
+  if(trajectory->count >= trajectory->capacity){
+    return false;
+  }
+  double *sample = trajectory->data + trajectory->count*trajectory->sample_stride;
+  const size_t stride = trajectory->field_stride;
+  const double *state = rocket.getState()->data;
+  sample[RSIM_FIELD_TIME*stride] = rocket.getTime();
+  for(unsigned int i = 0; i < RSIM_STATE_SIZE; ++i){
+    sample[(RSIM_FIELD_STATE + i)*stride] = state[i];
+  }
+  sample[RSIM_FIELD_STAGE*stride] = rocket.getStageProgress();
+  ++trajectory->count;
+  return true;
+}
+
+rsim_status rsim_record(rsim_rocket *rocket, rsim_trajectory *trajectory, unsigned long steps,
+    unsigned int decimation){
+  if(rocket == NULL || trajectory == NULL || trajectory->data == NULL || decimation == 0){
+    return RSIM_ERROR_ARGUMENT;
+  }
+  if(trajectory->count == 0 && !appendSample(rocket->rocket,trajectory)){
+    return RSIM_ERROR_FULL;
+  }
+  try{
+    for(unsigned long i = 1; i <= steps; ++i){
+      if(rocket->rocket.step() != GSL_SUCCESS){
+        return RSIM_ERROR_INTEGRATION;
+      }
+      if(i % decimation == 0 && !appendSample(rocket->rocket,trajectory)){
+        return RSIM_ERROR_FULL;
+      }
+    }
+  }catch(const std::bad_alloc &){
+    return RSIM_ERROR_MEMORY;
+  }catch(...){
+    return RSIM_ERROR_INTERNAL;
+  }
+  return RSIM_OK;
+}
+
+rsim_status rsim_run_ensemble(const double *parameters, size_t count, double dt, double end_time,
+    unsigned int threads, double *states){
+  if(parameters == NULL || states == NULL || !(dt > 0.0)){
+    return RSIM_ERROR_ARGUMENT;
+  }
+  if(threads == 0){
+    threads = std::max(1u,std::thread::hardware_concurrency());
+  }
+  threads = std::min<size_t>(threads,std::max<size_t>(count,1));
+
+  std::atomic<size_t> next(0);
+  /* the first failure, a worker that hits one stops everyone taking more */
+  std::atomic<int> failed(RSIM_OK);
+  const std::function<void()> work = [&](){
+    int status = RSIM_OK;
+    try{
+      for(size_t i = next++; i < count && failed == RSIM_OK; i = next++){
+        Rocket rocket(dt,toParameters(&parameters[i*RSIM_PARAMETER_COUNT]));
+        rocket.setLog(NULL);
+        while(rocket.getTime() < end_time){
+          if(rocket.step() != GSL_SUCCESS){
+            status = RSIM_ERROR_INTEGRATION;
+            break;
+          }
+        }
+        if(status != RSIM_OK){
+          break;
+        }
+        memcpy(&states[i*RSIM_STATE_SIZE],rocket.getState()->data,RSIM_STATE_SIZE*sizeof(double));
+      }
+    }catch(const std::bad_alloc &){
+      status = RSIM_ERROR_MEMORY;
+    }catch(...){
+      status = RSIM_ERROR_INTERNAL;
+    }
+    if(status != RSIM_OK){
+      int expected = RSIM_OK;
+      failed.compare_exchange_strong(expected,status);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  try{
+    workers.reserve(threads);
+    for(unsigned int t = 0; t < threads; ++t){
+      workers.push_back(std::thread(work));
+    }
+  }catch(...){
+    /* std::system_error or std::bad_alloc, the threads that did start share
+     * out every rocket, none at all and the caller's thread flies them
+     */
+    if(workers.empty()){
+      work();
+    }
+  }
+  for(size_t t = 0; t < workers.size(); ++t){
+    workers[t].join();
+  }
+  return (rsim_status) failed.load();
+}
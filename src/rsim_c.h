@@ -0,0 +1,151 @@
+#ifndef RSIM_C_H
+#define RSIM_C_H
+/* C interface to the flight simulation, for tools that would otherwise parse
+ * the text output of the rocketsim executable
+ *
+ * Only plain C types cross this interface and nothing throws. Functions that
+ * can fail return an rsim_status: RSIM_ERROR_MEMORY when memory runs out
+ * partway, RSIM_ERROR_INTEGRATION when GSL fails a step and
+ * RSIM_ERROR_INTERNAL for anything else, such as a thread that cannot be
+ * started. GSL aborts the process on an error unless its handler is off,
+ * which rsim_init does for hosts that want the status instead. The library
+ * never writes to stdout. State is read straight out of the
+ * simulation and trajectories are written into flat double buffers whose
+ * layout is described by two strides, so a host language can wrap either
+ * one as an array without copying or parsing anything.
+ */
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped whenever a declaration below changes incompatibly */
+#define RSIM_API_VERSION 3
+
+/* layout of the rigid body state, see flightmodel.hpp */
+enum{
+  RSIM_STATE_POSITION = 0,  /* 3 doubles, metres */
+  RSIM_STATE_ROTATION = 3,  /* 9 doubles, row major */
+  RSIM_STATE_MOMENTUM = 12, /* 3 doubles, linear */
+  RSIM_STATE_ANGULAR_MOMENTUM = 15, /* 3 doubles */
+  RSIM_STATE_MASS = 19,
+  RSIM_STATE_SIZE = 20
+};
+
+/* flight parameters, in the order of flight_parameter_t */
+enum{
+  RSIM_PARAMETER_PITCH_TIME,
+  RSIM_PARAMETER_KICK_ANGLE,
+  RSIM_PARAMETER_STAGE1_FUEL,
+  RSIM_PARAMETER_STAGE2_FUEL,
+  RSIM_PARAMETER_ISP_SEA_LEVEL,
+  RSIM_PARAMETER_ISP_VACUUM,
+  RSIM_PARAMETER_ISP_MERLINVAC,
+  RSIM_PARAMETER_DRAG,
+  RSIM_PARAMETER_COUNT
+};
+
+/* the fields of one trajectory sample */
+enum{
+  RSIM_FIELD_TIME = 0,
+  RSIM_FIELD_STATE = 1, /* RSIM_STATE_SIZE doubles */
+  RSIM_FIELD_STAGE = RSIM_FIELD_STATE + RSIM_STATE_SIZE,
+  RSIM_FIELD_COUNT
+};
+
+typedef enum rsim_status{
+  RSIM_OK = 0,
+  RSIM_ERROR_ARGUMENT = -1, /* a NULL handle or a value out of range */
+  RSIM_ERROR_MEMORY = -2,
+  RSIM_ERROR_FULL = -3, /* the trajectory buffer ran out of samples */
+  RSIM_ERROR_INTEGRATION = -4, /* GSL failed a step, the state is not to be trusted */
+  RSIM_ERROR_INTERNAL = -5
+} rsim_status;
+
+typedef enum rsim_event{
+  RSIM_EVENT_NONE = 0,  /* the time limit was reached first */
+  RSIM_EVENT_PITCH = 1, /* the pitch over began */
+  RSIM_EVENT_STAGING = 2, /* a stage ran out of fuel and was dropped */
+  RSIM_EVENT_ANY = 3
+} rsim_event;
+
+typedef struct rsim_rocket rsim_rocket;
+
+/* samples laid out by strides: field f of sample i is at
+ * data[i*sample_stride + f*field_stride]
+ * sample_stride = RSIM_FIELD_COUNT, field_stride = 1 stores samples as rows,
+ * sample_stride = 1, field_stride = capacity stores every field as a column
+ */
+typedef struct rsim_trajectory{
+  double *data;
+  size_t capacity; /* samples that fit */
+  size_t count; /* samples written so far */
+  size_t sample_stride;
+  size_t field_stride;
+  int owned; /* data was allocated by the library */
+} rsim_trajectory;
+
+unsigned int rsim_api_version(void);
+
+/* turn GSL's error handler off for the whole process, so GSL errors come
+ * back as RSIM_ERROR_INTEGRATION rather than aborting. The handler is
+ * global, so this is the host's call, made once before any other
+ */
+void rsim_init(void);
+
+void rsim_default_parameters(double parameters[RSIM_PARAMETER_COUNT]);
+
+/* a rocket on the pad, parameters may be NULL for the defaults
+ * returns NULL if dt is not positive
+ */
+rsim_rocket *rsim_create(double dt, const double *parameters);
+
+void rsim_destroy(rsim_rocket *rocket);
+
+rsim_status rsim_step(rsim_rocket *rocket, unsigned long steps);
+
+/* step until one of the events in mask (or RSIM_EVENT_ANY) happens or the
+ * flight time reaches max_time, the event that stopped it is stored in
+ * event if that is not NULL
+ */
+rsim_status rsim_run_to_event(rsim_rocket *rocket, int mask, double max_time, rsim_event *event);
+
+double rsim_time(const rsim_rocket *rocket);
+
+unsigned int rsim_stage(const rsim_rocket *rocket);
+
+/* the state owned by the rocket, RSIM_STATE_SIZE doubles that stay valid
+ * and change in place until rsim_destroy
+ */
+const double *rsim_state(const rsim_rocket *rocket);
+
+/* describe a trajectory buffer, data NULL lets the library allocate one
+ * (released by rsim_trajectory_free), otherwise the caller keeps owning it
+ * and it must hold capacity samples at the given strides
+ * a field_stride of 0 selects rows, RSIM_FIELD_COUNT doubles per sample
+ */
+rsim_status rsim_trajectory_init(rsim_trajectory *trajectory, double *data, size_t capacity,
+    size_t sample_stride, size_t field_stride);
+
+void rsim_trajectory_free(rsim_trajectory *trajectory);
+
+/* take steps, appending the current sample every decimation steps (and once
+ * before the first step if the trajectory is empty)
+ * stops with RSIM_ERROR_FULL as soon as a sample does not fit
+ */
+rsim_status rsim_record(rsim_rocket *rocket, rsim_trajectory *trajectory, unsigned long steps,
+    unsigned int decimation);
+
+/* fly count rockets to end_time on up to threads threads (0 for one per core)
+ * parameters holds count*RSIM_PARAMETER_COUNT doubles, the final states are
+ * written to count*RSIM_STATE_SIZE doubles of states
+ */
+rsim_status rsim_run_ensemble(const double *parameters, size_t count, double dt, double end_time,
+    unsigned int threads, double *states);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+#include "sampling.hpp"
+
+#include <cassert>
+#include <cmath>
+
+#include <gsl/gsl_cdf.h>
+
+/* primitive polynomials and starting direction numbers for dimensions 2 on,
+ * from Joe and Kuo's new-joe-kuo-6.21201: degree s, the polynomial's inner
+ * coefficients a and the first s of m
+ */
+struct SobolPolynomial{
+  unsigned int s;
+  unsigned int a;
+  uint32_t m[6];
+};
+
+static const SobolPolynomial sobol_polynomials[SAMPLER_MAX_DIMENSIONS - 1] = {
+  {1, 0, {1}},
+  {2, 1, {1, 3}},
+  {3, 1, {1, 3, 1}},
+  {3, 2, {1, 1, 1}},
+  {4, 1, {1, 1, 3, 3}},
+  {4, 4, {1, 3, 5, 13}},
+  {5, 2, {1, 1, 5, 5, 17}},
+  {5, 4, {1, 1, 5, 5, 5}},
+  {5, 7, {1, 1, 7, 11, 19}},
+  {5, 11, {1, 1, 5, 1, 1}},
+  {5, 13, {1, 1, 1, 3, 11}},
+  {5, 14, {1, 3, 5, 5, 31}},
+  {6, 1, {1, 3, 3, 9, 7, 49}},
+  {6, 13, {1, 1, 1, 15, 21, 21}},
+  {6, 16, {1, 3, 1, 13, 27, 49}}
+};
+
+static const double TWO_TO_MINUS_32 = 1.0/4294967296.0;
+static const double TWO_TO_MINUS_53 = 1.0/9007199254740992.0;
+
+/* splitmix64's finaliser, every bit of the input moves every bit out */
+static uint64_t mix(uint64_t x){
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+/* strictly inside (0, 1) from the top 53 bits */
+static double unitFromHash(uint64_t h){
+  return ((double)(h >> 11) + 0.5)*TWO_TO_MINUS_53;
+}
+
+static uint32_t reverseBits(uint32_t x){
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+/* Owen scrambling with a hash in place of the tree of random flips (Laine
+ * and Karras, with Burley's constants): on the reversed bits each multiply
+ * and xor only lets a bit change the ones above it, which are the fraction's
+ * lower bits, so every bit is flipped by a function of the bits before it
+ */
+static uint32_t owenScramble(uint32_t x, uint32_t seed){
+  x = reverseBits(x);
+  x += seed;
+  x ^= x*0x6c50b47cu;
+  x ^= x*0xb82f1e52u;
+  x ^= x*0xc7afe638u;
+  x ^= x*0x8d22f6e6u;
+  return reverseBits(x);
+}
+
+/* a bijection of [0, length) chosen by p, Kensler's hash walked in cycles
+ * until it lands inside
+ */
+static uint32_t permute(uint32_t i, uint32_t length, uint32_t p){
+  uint32_t w = length - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  do{
+    i ^= p;
+    i *= 0xe170893du;
+    i ^= p >> 16;
+    i ^= (i & w) >> 4;
+    i ^= p >> 8;
+    i *= 0x0929eb3fu;
+    i ^= p >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | p >> 27;
+    i *= 0x6935fa69u;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303u;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3u;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3dfu;
+    i &= w;
+    i ^= i >> 5;
+  }while(i >= length);
+  return (i + p) % length;
+}
+
+Sampler::Sampler(sampler_t kind, unsigned int dimensions, size_t samples, uint64_t seed):
+  kind(kind),
+  dimensions(dimensions),
+  samples(samples),
+  seed(seed){
+    assert(dimensions <= SAMPLER_MAX_DIMENSIONS);
+    /* the first dimension is the van der corput sequence in base 2 */
+    for(unsigned int k = 0; k < 32; ++k){
+      this->direction[0][k] = 1u << (31 - k);
+    }
+    for(unsigned int d = 1; d < SAMPLER_MAX_DIMENSIONS; ++d){
+      const SobolPolynomial &polynomial = sobol_polynomials[d - 1];
+      const unsigned int s = polynomial.s;
+      uint32_t *v = this->direction[d];
+      for(unsigned int k = 0; k < s; ++k){
+        v[k] = polynomial.m[k] << (31 - k);
+      }
+      for(unsigned int k = s; k < 32; ++k){
+        v[k] = v[k - s] ^ (v[k - s] >> s);
+        for(unsigned int j = 1; j < s; ++j){
+          if((polynomial.a >> (s - 1 - j)) & 1){
+            v[k] ^= v[k - j];
+          }
+        }
+      }
+    }
+    for(unsigned int d = 0; d < SAMPLER_MAX_DIMENSIONS; ++d){
+      this->scramble[d] = (uint32_t)mix(seed ^ mix(d));
+    }
+  }
+
+void Sampler::point(size_t index, double u[]) const {
+  switch(this->kind){
+    case SAMPLER_SOBOL:{
+      assert(index <= 0xffffffffu);
+      for(unsigned int d = 0; d < this->dimensions; ++d){
+        uint32_t x = 0;
+        uint32_t bits = (uint32_t)index;
+        for(unsigned int k = 0; bits != 0; ++k, bits >>= 1){
+          if(bits & 1){
+            x ^= this->direction[d][k];
+          }
+        }
+        u[d] = ((double)owenScramble(x,this->scramble[d]) + 0.5)*TWO_TO_MINUS_32;
+      }
+      break;
+    }
+    case SAMPLER_LATIN_HYPERCUBE:{
+      assert(index < this->samples && this->samples <= 0xffffffffu);
+      for(unsigned int d = 0; d < this->dimensions; ++d){
+        const uint32_t slice = permute((uint32_t)index,(uint32_t)this->samples,this->scramble[d]);
+        const double jitter = unitFromHash(mix(this->seed + mix(index*SAMPLER_MAX_DIMENSIONS + d)));
+        u[d] = (slice + jitter)/this->samples;
+      }
+      break;
+    }
+    default:
+      for(unsigned int d = 0; d < this->dimensions; ++d){
+        u[d] = unitFromHash(mix(this->seed + mix(index*SAMPLER_MAX_DIMENSIONS + d)));
+      }
+      break;
+  }
+}
+
+sampler_t Sampler::getKind() const {
+  return this->kind;
+}
+
+unsigned int Sampler::getDimensions() const {
+  return this->dimensions;
+}
+
+InputDistribution::InputDistribution(distribution_t type, double a, double b, double c):
+  type(type),
+  a(a),
+  b(b),
+  c(c){
+  }
+
+double inverseDistribution(const InputDistribution &distribution, double u){
+  const double a = distribution.a;
+  const double b = distribution.b;
+  switch(distribution.type){
+    case DISTRIBUTION_UNIFORM:
+      return a + u*(b - a);
+    case DISTRIBUTION_NORMAL:
+      return a + b*gsl_cdf_ugaussian_Pinv(u);
+    case DISTRIBUTION_LOGNORMAL:
+      return a*exp(b*gsl_cdf_ugaussian_Pinv(u));
+    case DISTRIBUTION_TRIANGULAR:{
+      /* an empty range is the point a, a mode outside it sits on its nearer end */
+      if(!(b > a)){
+        return a;
+      }
+      const double c = fmin(b,fmax(a,distribution.c));
+      const double split = (c - a)/(b - a);
+      if(u < split){
+        return a + sqrt(u*(b - a)*(c - a));
+      }
+      return b - sqrt((1.0 - u)*(b - a)*(b - c));
+    }
+    default:
+      return a;
+  }
+}
+
+const char *samplerName(sampler_t kind){
+  switch(kind){
+    case SAMPLER_SOBOL:
+      return "sobol";
+    case SAMPLER_LATIN_HYPERCUBE:
+      return "lhs";
+    default:
+      return "random";
+  }
+}
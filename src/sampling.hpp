@@ -0,0 +1,82 @@
+#ifndef RSIM_SAMPLING_HPP
+#define RSIM_SAMPLING_HPP
+/* points spread over the unit cube for sampling uncertain inputs, and the
+ * distributions that map them onto the inputs
+ *
+ * Pseudo random points clump and leave gaps, so the error of an average over
+ * N of them falls only as 1/sqrt(N). A Sobol sequence fills the cube evenly
+ * by construction: each coordinate is a binary fraction whose bits come from
+ * the index's bits through direction numbers chosen per dimension, so every
+ * power of two run of points puts one point in each of many equal boxes. For
+ * smooth integrands the error then falls close to 1/N. The points are
+ * scrambled the way Owen describes, with a hashed permutation per dimension
+ * applied to the fraction's bits from the top down. That keeps the boxes
+ * filled, makes every average unbiased and lets independent seeds give
+ * independent estimates of the error.
+ *
+ * A Latin hypercube cuts each axis into as many slices as there are samples
+ * and puts one sample in each slice of each axis. The slices are dealt out
+ * by a hashed permutation of the index, so it does better than random for
+ * inputs that act on their own, whatever the sample count.
+ *
+ * Every point is a function of its index, the seed and nothing else, so any
+ * range of indices can be drawn on its own by any thread or machine and the
+ * ranges put together are the same as drawing them all in one place.
+ */
+
+#include <cstddef>
+#include <stdint.h>
+
+enum sampler_t{
+  SAMPLER_RANDOM, /* independent uniform points */
+  SAMPLER_SOBOL, /* scrambled Sobol, best with a power of two of samples */
+  SAMPLER_LATIN_HYPERCUBE /* the sample count fixes the slices */
+};
+
+/* dimensions Sobol has direction numbers for */
+static const unsigned int SAMPLER_MAX_DIMENSIONS = 16;
+
+class Sampler{
+public:
+  /* samples is the size of the design, only the latin hypercube uses it */
+  Sampler(sampler_t kind, unsigned int dimensions, size_t samples, uint64_t seed);
+
+  /* point index of the design, every coordinate strictly between 0 and 1 */
+  void point(size_t index, double u[]) const;
+
+  sampler_t getKind() const;
+
+  unsigned int getDimensions() const;
+
+private:
+  sampler_t kind;
+  unsigned int dimensions;
+  size_t samples;
+  uint64_t seed;
+  uint32_t direction[SAMPLER_MAX_DIMENSIONS][32];
+  uint32_t scramble[SAMPLER_MAX_DIMENSIONS];
+};
+
+enum distribution_t{
+  DISTRIBUTION_FIXED, /* always a */
+  DISTRIBUTION_UNIFORM, /* between a and b */
+  DISTRIBUTION_NORMAL, /* mean a, standard deviation b */
+  DISTRIBUTION_LOGNORMAL, /* median a, standard deviation of the log b */
+  DISTRIBUTION_TRIANGULAR /* from a to b, most likely at c, a when b <= a */
+};
+
+struct InputDistribution{
+  distribution_t type;
+  double a;
+  double b;
+  double c;
+
+  InputDistribution(distribution_t type = DISTRIBUTION_FIXED, double a = 0.0, double b = 0.0, double c = 0.0);
+};
+
+/* the value with cumulative probability u, which is strictly between 0 and 1 */
+double inverseDistribution(const InputDistribution &distribution, double u);
+
+const char *samplerName(sampler_t kind);
+
+#endif
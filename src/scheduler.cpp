@@ -0,0 +1,86 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "profile.hpp"
+
+/* due times closer than this are one boundary, periods such as 0.1 and 0.01
+ * land a rounding error apart on what should be the same time
+ */
+static const double SCHEDULE_TOLERANCE = 1e-9;
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Scheduler::Scheduler(Task advance, double start):
+  time(start){
+    this->physics.statistics.name = "physics";
+    this->physics.statistics.period = 0.0;
+    this->physics.statistics.runs = 0;
+    this->physics.statistics.seconds = 0.0;
+    this->physics.task = advance;
+  }
+
+void Scheduler::addTask(const char *name, double period, Task task){
+  ScheduledTask scheduled;
+  scheduled.statistics.name = name;
+  scheduled.statistics.period = period;
+  scheduled.statistics.runs = 0;
+  scheduled.statistics.seconds = 0.0;
+  scheduled.task = task;
+  scheduled.origin = this->time;
+  scheduled.next = this->time + period;
+  this->tasks.push_back(scheduled);
+}
+
+void Scheduler::runUntil(double end_time){
+  RSIM_PROFILE_SCOPE("Scheduler::runUntil");
+  while(this->time < end_time){
+    double boundary = end_time;
+    for(size_t k = 0; k < this->tasks.size(); ++k){
+      boundary = std::min(boundary,this->tasks[k].next);
+    }
+    if(boundary - this->time < SCHEDULE_TOLERANCE){
+      boundary = this->time;
+    }
+
+    if(boundary > this->time){
+      std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+      this->physics.task(boundary);
+      this->physics.statistics.seconds += secondsSince(started);
+      ++this->physics.statistics.runs;
+      this->time = boundary;
+    }
+
+    for(size_t k = 0; k < this->tasks.size(); ++k){
+      ScheduledTask &task = this->tasks[k];
+      if(task.next > boundary + SCHEDULE_TOLERANCE){
+        continue;
+      }
+      std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+      task.task(boundary);
+      task.statistics.seconds += secondsSince(started);
+      ++task.statistics.runs;
+      /* counted from the origin rather than the last run so the rate does
+       * not drift
+       */
+      const double period = task.statistics.period;
+      task.next = task.origin + (floor((boundary - task.origin)/period + 0.5) + 1.0)*period;
+    }
+  }
+}
+
+double Scheduler::getTime() const{
+  return this->time;
+}
+
+std::vector<Scheduler::TaskStatistics> Scheduler::statistics() const{
+  std::vector<TaskStatistics> out(1,this->physics.statistics);
+  for(size_t k = 0; k < this->tasks.size(); ++k){
+    out.push_back(this->tasks[k].statistics);
+  }
+  return out;
+}
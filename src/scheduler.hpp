@@ -0,0 +1,57 @@
+#ifndef RSIM_SCHEDULER_HPP
+#define RSIM_SCHEDULER_HPP
+/* tasks run at their own rates around one physics integration
+ *
+ * Each task runs every period seconds from when it is added. The physics is
+ * carried exactly to the next time any task is due, however many adaptive
+ * steps that takes, then every task due then runs in the order the tasks were
+ * added. So a slow task costs only its own rate and the integrator is never
+ * stopped anywhere but a task boundary.
+ */
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class Scheduler{
+public:
+  typedef std::function<void(double time)> Task;
+
+  /* advance carries the physics from the current time to the one given */
+  Scheduler(Task advance, double start = 0.0);
+
+  /* run task every period seconds, which must be more than 0, first one
+   * period from now
+   */
+  void addTask(const char *name, double period, Task task);
+
+  /* run everything up to and including end_time, the physics ends there */
+  void runUntil(double end_time);
+
+  double getTime() const;
+
+  struct TaskStatistics{
+    std::string name;
+    double period;
+    unsigned long runs;
+    double seconds; /* wall clock spent in the task */
+  };
+
+  /* the tasks in the order they were added, the physics first with a period
+   * of 0
+   */
+  std::vector<TaskStatistics> statistics() const;
+
+private:
+  struct ScheduledTask{
+    TaskStatistics statistics;
+    Task task;
+    double origin; /* time it was added, it is due whole periods on */
+    double next;
+  };
+  ScheduledTask physics;
+  std::vector<ScheduledTask> tasks;
+  double time;
+};
+
+#endif
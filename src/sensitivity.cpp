@@ -0,0 +1,52 @@
+#include "sensitivity.hpp"
+
+#include <cstring>
+
+#include "flightpropagator.hpp"
+#include "profile.hpp"
+
+static const char *const parameter_names[FLIGHT_PARAMETER_COUNT] = {
+  "pitch_time",
+  "kick_angle",
+  "stage1_fuel",
+  "stage2_fuel",
+  "isp_sea_level",
+  "isp_vacuum",
+  "isp_merlinvac",
+  "drag"
+};
+
+void flightSensitivity(const FlightParameters<double> &parameters, double dt, double end_time, FlightSensitivity *out){
+  RSIM_PROFILE_SCOPE("flightSensitivity");
+  /* seed one direction per parameter */
+  FlightParameters<FlightDual> seeded(*parameters.vehicle);
+  for(unsigned int j = 0; j < FLIGHT_PARAMETER_COUNT; ++j){
+    seeded[j] = FlightDual::variable(parameters[j],j);
+  }
+
+  FlightState<FlightDual> flight;
+  launchState(seeded,&flight);
+  propagateFlight(&flight,seeded,dt,end_time);
+
+  for(unsigned int i = 0; i < RigidBody::STATE_SIZE; ++i){
+    out->state[i] = flight.y[i].value;
+    for(unsigned int j = 0; j < FLIGHT_PARAMETER_COUNT; ++j){
+      out->gradient[i][j] = flight.y[i].d[j];
+    }
+  }
+}
+
+void simulateFlight(const FlightParameters<double> &parameters, double dt, double end_time, double state[]){
+  RSIM_PROFILE_SCOPE("simulateFlight");
+  FlightState<double> flight;
+  launchState(parameters,&flight);
+  propagateFlight(&flight,parameters,dt,end_time);
+  memcpy(state,flight.y,RigidBody::STATE_SIZE*sizeof(double));
+}
+
+const char *flightParameterName(unsigned int parameter){
+  if(parameter >= FLIGHT_PARAMETER_COUNT){
+    return "unknown";
+  }
+  return parameter_names[parameter];
+}
@@ -0,0 +1,35 @@
+#ifndef RSIM_SENSITIVITY_HPP
+#define RSIM_SENSITIVITY_HPP
+/* derivatives of a whole flight with respect to its parameters
+ *
+ * The flight is integrated once on dual numbers, so the final state and its
+ * gradient with respect to every FlightParameters entry come out of a single
+ * pass instead of 2N+1 finite difference runs. GSL only integrates doubles,
+ * so this uses the fixed step propagator of flightpropagator.hpp, which splits
+ * steps exactly at the pitch over and at each burnout and so keeps the event
+ * times (and the derivatives through them) exact.
+ */
+
+#include "dual.hpp"
+#include "flightmodel.hpp"
+#include "rigidbody.hpp"
+
+typedef Dual<FLIGHT_PARAMETER_COUNT> FlightDual;
+
+struct FlightSensitivity{
+  double state[RigidBody::STATE_SIZE];
+  /* gradient[i][j] = d(state[i])/d(parameter j) */
+  double gradient[RigidBody::STATE_SIZE][FLIGHT_PARAMETER_COUNT];
+};
+
+/* fly from launch to end_time with steps of dt and take the gradient of the
+ * final state
+ */
+void flightSensitivity(const FlightParameters<double> &parameters, double dt, double end_time, FlightSensitivity *out);
+
+/* the same flight on doubles only, used to check the gradient */
+void simulateFlight(const FlightParameters<double> &parameters, double dt, double end_time, double state[]);
+
+const char *flightParameterName(unsigned int parameter);
+
+#endif
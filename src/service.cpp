@@ -0,0 +1,497 @@
+#include "service.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "profile.hpp"
+#include "rocket.hpp"
+#include "sensitivity.hpp"
+#include "trace.hpp"
+
+/* most runs a worker takes off the queue at once, keeps one client's burst
+ * from holding up everyone else's runs behind a single worker
+ */
+static const size_t MAX_BATCH = 16;
+
+/* longest request line accepted */
+static const size_t MAX_LINE = 4096;
+
+/* one client, shared by its reader thread and the workers running its
+ * scenarios so lines can still be sent while the client is reading
+ */
+struct ServiceConnection{
+  int fd;
+  std::mutex write_mutex;
+  std::mutex pending_mutex;
+  std::condition_variable idle;
+  unsigned int pending; /* queued or running scenarios */
+
+  ServiceConnection(int fd):
+    fd(fd),
+    pending(0){}
+
+  ~ServiceConnection(){
+    close(this->fd);
+  }
+
+  /* send one line, a client that went away just stops receiving */
+  void send(const std::string &line){
+    std::lock_guard<std::mutex> lock(this->write_mutex);
+    std::string data = line + "\n";
+    const char *bytes = data.c_str();
+    size_t size = data.size();
+    while(size > 0){
+      const ssize_t sent = ::send(this->fd,bytes,size,MSG_NOSIGNAL);
+      if(sent < 0 && errno == EINTR){
+        continue;
+      }
+      if(sent <= 0){
+        return;
+      }
+      bytes += sent;
+      size -= sent;
+    }
+  }
+
+  void started(){
+    std::lock_guard<std::mutex> lock(this->pending_mutex);
+    ++this->pending;
+  }
+
+  void finished(){
+    std::lock_guard<std::mutex> lock(this->pending_mutex);
+    --this->pending;
+    this->idle.notify_all();
+  }
+
+  void waitIdle(){
+    std::unique_lock<std::mutex> lock(this->pending_mutex);
+    while(this->pending > 0){
+      this->idle.wait(lock);
+    }
+  }
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Scenario::Scenario():
+  name("run"),
+  dt(0.01),
+  end_time(600.0),
+  decimation(0),
+  queued(std::chrono::steady_clock::now())
+  {}
+
+static bool parseNumber(const std::string &text, double *out){
+  char *end = NULL;
+  *out = strtod(text.c_str(),&end);
+  return !text.empty() && *end == '\0' && std::isfinite(*out);
+}
+
+bool parseScenario(const std::string &arguments, Scenario *scenario, std::string &error){
+  std::istringstream tokens(arguments);
+  std::string token;
+  while(tokens >> token){
+    const size_t equals = token.find('=');
+    if(equals == std::string::npos){
+      error = "expected <key>=<value>, got '" + token + "'";
+      return false;
+    }
+    const std::string key = token.substr(0,equals);
+    const std::string text = token.substr(equals + 1);
+    if(key == "id"){
+      if(text.empty()){
+        error = "empty id";
+        return false;
+      }
+      scenario->name = text;
+      continue;
+    }
+
+    double value;
+    if(!parseNumber(text,&value)){
+      error = "'" + text + "' is not a number for " + key;
+      return false;
+    }
+    if(key == "dt"){
+      scenario->dt = value;
+    }else if(key == "end"){
+      scenario->end_time = value;
+    }else if(key == "every"){
+      scenario->decimation = value > 0.0 ? (unsigned int) value : 0;
+    }else{
+      unsigned int j = 0;
+      while(j < FLIGHT_PARAMETER_COUNT && key != flightParameterName(j)){
+        ++j;
+      }
+      if(j == FLIGHT_PARAMETER_COUNT){
+        error = "unknown key '" + key + "'";
+        return false;
+      }
+      scenario->parameters[j] = value;
+    }
+  }
+  if(!(scenario->dt > 0.0) || !(scenario->end_time > 0.0) || scenario->end_time/scenario->dt > 1e8){
+    error = "dt and end must be positive and at most 1e8 steps apart";
+    return false;
+  }
+  return true;
+}
+
+SimulationService::SimulationService(const char *socket_path, unsigned int workers,
+    const FlightParameters<double> &vehicle):
+  socket_path(socket_path),
+  listen_fd(-1),
+  worker_count(std::max(1u,workers)),
+  vehicle(vehicle),
+  started(std::chrono::steady_clock::now()),
+  stopping(false),
+  running(0),
+  submitted(0),
+  completed(0),
+  steps(0),
+  batches(0),
+  queue_seconds(0.0),
+  busy_seconds(0.0){
+    struct sockaddr_un address;
+    memset(&address,0,sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(this->socket_path.size() >= sizeof(address.sun_path)){
+      std::cerr << "Socket path is too long: " << socket_path << std::endl;
+      return;
+    }
+    strcpy(address.sun_path,socket_path);
+
+    this->listen_fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if(this->listen_fd < 0){
+      std::cerr << "Error creating service socket" << std::endl;
+      return;
+    }
+    /* a previous service that died leaves its socket file behind, but only
+     * a socket is ever removed
+     */
+    struct stat existing;
+    if(lstat(socket_path,&existing) == 0){
+      if(!S_ISSOCK(existing.st_mode)){
+        std::cerr << "Not replacing " << socket_path << ", it is not a socket" << std::endl;
+        close(this->listen_fd);
+        this->listen_fd = -1;
+        return;
+      }
+      unlink(socket_path);
+    }
+    if(bind(this->listen_fd,(struct sockaddr *) &address,sizeof(address)) != 0
+        || listen(this->listen_fd,64) != 0){
+      std::cerr << "Error listening on " << socket_path << ": " << strerror(errno) << std::endl;
+      close(this->listen_fd);
+      this->listen_fd = -1;
+    }
+  }
+
+SimulationService::~SimulationService(){
+  if(this->listen_fd >= 0){
+    close(this->listen_fd);
+    unlink(this->socket_path.c_str());
+  }
+}
+
+bool SimulationService::isOpen() const {
+  return this->listen_fd >= 0;
+}
+
+int SimulationService::run(){
+  if(this->listen_fd < 0){
+    return 1;
+  }
+  printf("serving on %s with %u workers\n",this->socket_path.c_str(),this->worker_count);
+  fflush(stdout);
+  for(unsigned int i = 0; i < this->worker_count; ++i){
+    this->workers.push_back(std::thread(&SimulationService::work,this));
+  }
+
+  for(;;){
+    const int fd = accept(this->listen_fd,NULL,NULL);
+    if(fd < 0){
+      if(errno == EINTR || errno == ECONNABORTED){
+        continue;
+      }
+      /* stop() shuts the listening socket down to get here */
+      break;
+    }
+    std::shared_ptr<ServiceConnection> connection(new ServiceConnection(fd));
+    {
+      std::lock_guard<std::mutex> lock(this->connection_mutex);
+      this->connections.push_back(connection);
+    }
+    std::thread(&SimulationService::serveClient,this,connection).detach();
+  }
+
+  this->stop();
+  /* the queue drains before the workers return */
+  for(size_t i = 0; i < this->workers.size(); ++i){
+    this->workers[i].join();
+  }
+  this->workers.clear();
+
+  /* unblock clients still waiting to send, then wait for their threads */
+  std::unique_lock<std::mutex> lock(this->connection_mutex);
+  for(std::list<std::shared_ptr<ServiceConnection> >::iterator it = this->connections.begin(); it != this->connections.end(); ++it){
+    shutdown((*it)->fd,SHUT_RD);
+  }
+  while(!this->connections.empty()){
+    this->connections_closed.wait(lock);
+  }
+  printf("service stopped\n");
+  return 0;
+}
+
+void SimulationService::stop(){
+  std::lock_guard<std::mutex> lock(this->queue_mutex);
+  if(!this->stopping){
+    this->stopping = true;
+    shutdown(this->listen_fd,SHUT_RDWR);
+  }
+  this->queue_ready.notify_all();
+}
+
+void SimulationService::serveClient(std::shared_ptr<ServiceConnection> connection){
+  std::string buffer;
+  char chunk[1024];
+  bool open = true;
+  while(open){
+    const ssize_t received = recv(connection->fd,chunk,sizeof(chunk),0);
+    if(received < 0 && errno == EINTR){
+      continue;
+    }
+    if(received <= 0){
+      break;
+    }
+    buffer.append(chunk,received);
+
+    size_t newline;
+    while(open && (newline = buffer.find('\n')) != std::string::npos){
+      std::string line = buffer.substr(0,newline);
+      buffer.erase(0,newline + 1);
+      if(!line.empty() && line[line.size()-1] == '\r'){
+        line.erase(line.size()-1);
+      }
+
+      const size_t space = line.find(' ');
+      const std::string request = line.substr(0,space);
+      const std::string arguments = space == std::string::npos ? std::string() : line.substr(space + 1);
+      if(request.empty()){
+        continue;
+      }else if(request == "run"){
+        Scenario scenario;
+        scenario.parameters = this->vehicle;
+        std::string error;
+        if(!parseScenario(arguments,&scenario,error)){
+          connection->send("error " + error);
+          continue;
+        }
+        scenario.client = connection;
+        scenario.queued = std::chrono::steady_clock::now();
+        size_t depth;
+        {
+          std::lock_guard<std::mutex> lock(this->queue_mutex);
+          if(this->stopping){
+            connection->send("error service is stopping");
+            continue;
+          }
+          connection->started();
+          this->queue.push_back(scenario);
+          ++this->submitted;
+          depth = this->queue.size();
+        }
+        this->queue_ready.notify_one();
+        std::ostringstream reply;
+        reply << "queued " << scenario.name << " depth " << depth;
+        connection->send(reply.str());
+      }else if(request == "status"){
+        connection->send(this->status());
+      }else if(request == "metrics"){
+        connection->send(this->metrics());
+      }else if(request == "shutdown"){
+        connection->send("stopping");
+        this->stop();
+        open = false;
+      }else{
+        connection->send("error unknown request '" + request + "'");
+      }
+    }
+    if(buffer.size() > MAX_LINE){
+      connection->send("error request line too long");
+      break;
+    }
+  }
+
+  /* the client is done sending, answer the rest of its runs */
+  connection->waitIdle();
+  shutdown(connection->fd,SHUT_RDWR);
+
+  std::lock_guard<std::mutex> lock(this->connection_mutex);
+  this->connections.remove(connection);
+  this->connections_closed.notify_all();
+}
+
+void SimulationService::work(){
+  std::vector<Scenario> batch;
+  for(;;){
+    batch.clear();
+    {
+      std::unique_lock<std::mutex> lock(this->queue_mutex);
+      while(!this->stopping && this->queue.empty()){
+        this->queue_ready.wait(lock);
+      }
+      if(this->queue.empty()){
+        return;
+      }
+      /* an even share of what is waiting, so a burst spreads over every worker */
+      const size_t share = std::min(MAX_BATCH,std::max<size_t>(1,this->queue.size()/this->worker_count));
+      for(size_t i = 0; i < share; ++i){
+        batch.push_back(this->queue.front());
+        this->queue.pop_front();
+      }
+      this->running += batch.size();
+      ++this->batches;
+    }
+    RSIM_PROFILE_COUNT("service batches",1);
+    for(size_t i = 0; i < batch.size(); ++i){
+      this->simulate(batch[i]);
+      /* drop the connection before another scenario can keep it alive */
+      batch[i].client.reset();
+    }
+  }
+}
+
+void SimulationService::simulate(Scenario &scenario){
+  RSIM_PROFILE_SCOPE("service run");
+  RSIM_TRACE_SCOPE("service run");
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const double waited = std::chrono::duration<double>(start - scenario.queued).count();
+
+  Rocket rocket(scenario.dt,scenario.parameters);
+  /* the daemon's stdout is not the client's */
+  rocket.setLog(NULL);
+  const uint64_t step_count = (uint64_t) ceil(scenario.end_time/scenario.dt - 1e-9);
+  char line[256];
+  for(uint64_t i = 1; i <= step_count; ++i){
+    rocket.step();
+    if(scenario.decimation > 0 && i % scenario.decimation == 0){
+      const double *y = rocket.getState()->data;
+      snprintf(line,sizeof(line),"sample %s %.3f %.3f %.3f %.3f %.3f %u",scenario.name.c_str(),
+          rocket.getTime(),y[0],y[1],y[2],y[19],rocket.getStageProgress());
+      scenario.client->send(line);
+    }
+  }
+
+  const double *y = rocket.getState()->data;
+  double distance = 0.0;
+  double momentum = 0.0;
+  for(unsigned int i = 0; i < 3; ++i){
+    distance += (y[i] - earth.position[i])*(y[i] - earth.position[i]);
+    momentum += y[12+i]*y[12+i];
+  }
+  const double seconds = secondsSince(start);
+  snprintf(line,sizeof(line),"done %s t=%.3f altitude=%.3f speed=%.3f mass=%.3f stage=%u queued=%.4fs ran=%.4fs",
+      scenario.name.c_str(),rocket.getTime(),sqrt(distance) - earth.radius,sqrt(momentum)/y[19],y[19],
+      rocket.getStageProgress(),waited,seconds);
+  scenario.client->send(line);
+
+  {
+    std::lock_guard<std::mutex> lock(this->queue_mutex);
+    --this->running;
+    ++this->completed;
+    this->steps += step_count;
+    this->queue_seconds += waited;
+    this->busy_seconds += seconds;
+  }
+  scenario.client->finished();
+}
+
+std::string SimulationService::status(){
+  size_t clients;
+  {
+    std::lock_guard<std::mutex> lock(this->connection_mutex);
+    clients = this->connections.size();
+  }
+  std::lock_guard<std::mutex> lock(this->queue_mutex);
+  std::ostringstream out;
+  out << "status queued=" << this->queue.size()
+      << " running=" << this->running
+      << " workers=" << this->worker_count
+      << " clients=" << clients
+      << (this->stopping ? " stopping" : "");
+  return out.str();
+}
+
+std::string SimulationService::metrics(){
+  const double uptime = secondsSince(this->started);
+  std::lock_guard<std::mutex> lock(this->queue_mutex);
+  const double done = this->completed > 0 ? this->completed : 1;
+  char line[512];
+  snprintf(line,sizeof(line),
+      "metrics uptime=%.1fs submitted=%llu completed=%llu batches=%llu queued=%zu "
+      "runs_per_second=%.3f steps_per_second=%.0f mean_queue=%.4fs mean_run=%.4fs utilisation=%.3f",
+      uptime,(unsigned long long) this->submitted,(unsigned long long) this->completed,
+      (unsigned long long) this->batches,this->queue.size(),this->completed/uptime,this->steps/uptime,
+      this->queue_seconds/done,this->busy_seconds/done,this->busy_seconds/(uptime*this->worker_count));
+  return line;
+}
+
+int serviceRequest(const char *socket_path, const char *request){
+  struct sockaddr_un address;
+  memset(&address,0,sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(strlen(socket_path) >= sizeof(address.sun_path)){
+    std::cerr << "Socket path is too long: " << socket_path << std::endl;
+    return 1;
+  }
+  strcpy(address.sun_path,socket_path);
+
+  const int fd = socket(AF_UNIX,SOCK_STREAM,0);
+  if(fd < 0 || connect(fd,(struct sockaddr *) &address,sizeof(address)) != 0){
+    std::cerr << "Could not connect to the service on " << socket_path << std::endl;
+    if(fd >= 0){
+      close(fd);
+    }
+    return 1;
+  }
+
+  const std::string line = std::string(request) + "\n";
+  const char *bytes = line.c_str();
+  size_t size = line.size();
+  while(size > 0){
+    const ssize_t sent = ::send(fd,bytes,size,MSG_NOSIGNAL);
+    if(sent <= 0){
+      close(fd);
+      return 1;
+    }
+    bytes += sent;
+    size -= sent;
+  }
+  /* nothing more to send, the service closes once everything is answered */
+  shutdown(fd,SHUT_WR);
+
+  char chunk[4096];
+  ssize_t received;
+  while((received = recv(fd,chunk,sizeof(chunk),0)) > 0){
+    fwrite(chunk,1,received,stdout);
+  }
+  fflush(stdout);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#ifndef RSIM_SERVICE_HPP
+#define RSIM_SERVICE_HPP
+/* long lived simulation service on a unix domain socket
+ *
+ * Clients send one request per line and get text lines back, so a scenario
+ * can be submitted with socat or nc as well as with 'rocketsim request':
+ *
+ *   run [id=<name>] [<parameter>=<value> ...] [dt=<s>] [end=<s>] [every=<steps>]
+ *     <parameter> is any flightParameterName(), changed from the vehicle
+ *     the service was started with, every is the output
+ *     decimation, 0 for the summary only. Answered by 'queued', then a
+ *     'sample' line every <every> steps and a 'done' summary.
+ *   status     queue depth, runs in flight and worker count
+ *   metrics    totals and throughput since the service started
+ *   shutdown   finish the runs in flight and exit
+ *
+ * Runs are queued and taken off the queue in batches by a fixed pool of
+ * worker threads. A client that closes its sending side still gets every
+ * line of the runs it queued before its connection is closed.
+ */
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flightmodel.hpp"
+
+struct ServiceConnection;
+
+struct Scenario{
+  std::string name;
+  FlightParameters<double> parameters;
+  double dt;
+  double end_time;
+  unsigned int decimation; /* steps between samples, 0 for none */
+  std::shared_ptr<ServiceConnection> client;
+  std::chrono::steady_clock::time_point queued;
+
+  Scenario();
+};
+
+/* fill scenario from the arguments of a run request, false and a reason in
+ * error for anything not understood
+ */
+bool parseScenario(const std::string &arguments, Scenario *scenario, std::string &error);
+
+class SimulationService{
+public:
+  /* a stale socket at socket_path is replaced, anything else there is left
+   * alone and the service does not open
+   */
+  SimulationService(const char *socket_path, unsigned int workers,
+      const FlightParameters<double> &vehicle = FlightParameters<double>());
+  ~SimulationService();
+
+  bool isOpen() const;
+
+  /* serve clients until a shutdown request */
+  int run();
+
+private:
+  std::string socket_path;
+  int listen_fd;
+  unsigned int worker_count;
+  const FlightParameters<double> vehicle; /* what runs start from */
+  const std::chrono::steady_clock::time_point started;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_ready;
+  std::deque<Scenario> queue;
+  bool stopping;
+  unsigned int running;
+
+  /* totals for the metrics request, guarded by queue_mutex */
+  uint64_t submitted;
+  uint64_t completed;
+  uint64_t steps;
+  uint64_t batches;
+  double queue_seconds;
+  double busy_seconds;
+
+  /* clients are served on detached threads, shutdown waits for the list
+   * to empty
+   */
+  std::mutex connection_mutex;
+  std::condition_variable connections_closed;
+  std::list<std::shared_ptr<ServiceConnection> > connections;
+  std::vector<std::thread> workers;
+
+  void serveClient(std::shared_ptr<ServiceConnection> connection);
+
+  void work();
+
+  void simulate(Scenario &scenario);
+
+  std::string status();
+
+  std::string metrics();
+
+  void stop();
+
+  SimulationService(const SimulationService&);
+  SimulationService &operator=(const SimulationService&);
+};
+
+/* connect to a service, send one request line and copy everything it answers
+ * to stdout until the service closes the connection
+ */
+int serviceRequest(const char *socket_path, const char *request);
+
+#endif
@@ -0,0 +1,217 @@
+#include "subsetsimulation.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <utility>
+
+#include <gsl/gsl_cdf.h>
+
+#include "profile.hpp"
+
+/* the acceptance the chains' spread is steered towards */
+static const double SUBSET_TARGET_ACCEPTANCE = 0.44;
+
+SubsetOptions::SubsetOptions():
+  samples(1000),
+  level_probability(0.1),
+  max_levels(10),
+  spread(0.6),
+  seed(1)
+  {}
+
+/* one flight of a level, where it is in standard normal space */
+struct SubsetSample{
+  double z[FLIGHT_PARAMETER_COUNT];
+  double margin;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double flyMargin(const FlightDistributions &inputs, const FailureMargin &margin, const DispersionOptions &options,
+    unsigned int n, const double z[]){
+  double u[FLIGHT_PARAMETER_COUNT];
+  for(unsigned int d = 0; d < n; ++d){
+    /* kept off 0 and 1, where the inverse distributions run off to infinity */
+    u[d] = std::min(std::max(gsl_cdf_ugaussian_P(z[d]),1e-300),1.0 - 1e-16);
+  }
+  FlightParameters<double> parameters(inputs.base);
+  flightFromUnit(inputs,u,&parameters);
+  DispersionOutcome outcome;
+  flyToEvents(parameters,options,&outcome);
+  return margin(outcome);
+}
+
+/* body(k) for every k below count, shared out over the threads */
+static void parallelFor(unsigned int threads, size_t count, const std::function<void(size_t)> &body){
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  const unsigned int thread_count = std::max<size_t>(1,std::min<size_t>(threads,count));
+  for(unsigned int t = 0; t < thread_count; ++t){
+    workers.push_back(std::thread([&](){
+      for(size_t k = next++; k < count; k = next++){
+        body(k);
+      }
+    }));
+  }
+  for(size_t t = 0; t < workers.size(); ++t){
+    workers[t].join();
+  }
+}
+
+/* where chain c of a level of n flights made of chains starts, the
+ * remainder of n over chains goes one each to the first chains
+ */
+static size_t chainStart(size_t n, size_t chains, size_t c){
+  const size_t length = n/chains;
+  return c*length + std::min(c,n % chains);
+}
+
+/* squared coefficient of variation of the fraction p of a level under
+ * threshold, with the level made of chains (Au and Beck): the correlation
+ * along the chains counts the flights fewer times. Each lag is weighted by
+ * the pairs that far apart, 1 - k/length when the chains are all as long
+ */
+static double levelVariation(const std::vector<SubsetSample> &level, size_t chains, double threshold, double p){
+  const size_t n = level.size();
+  if(!(p > 0.0)){
+    return INFINITY;
+  }
+  if(p >= 1.0){
+    return 0.0;
+  }
+  const size_t longest = (n + chains - 1)/chains;
+  const double r0 = p*(1.0 - p);
+  double gamma = 0.0;
+  for(size_t k = 1; k < longest; ++k){
+    double sum = 0.0;
+    size_t pairs = 0;
+    for(size_t c = 0; c < chains; ++c){
+      const size_t begin = chainStart(n,chains,c);
+      const size_t end = chainStart(n,chains,c + 1);
+      for(size_t l = begin; l + k < end; ++l){
+        sum += (level[l].margin <= threshold && level[l + k].margin <= threshold) ? 1.0 : 0.0;
+        ++pairs;
+      }
+    }
+    if(pairs == 0){
+      break;
+    }
+    const double rk = sum/pairs - p*p;
+    gamma += 2.0*((double)pairs/n)*rk/r0;
+  }
+  return (1.0 - p)/(p*n)*(1.0 + gamma);
+}
+
+bool subsetSimulation(const FlightDistributions &inputs, const FailureMargin &margin, const SubsetOptions &options,
+    SubsetResult *out){
+  RSIM_PROFILE_SCOPE("subsetSimulation");
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  const unsigned int n = inputs.varying();
+  const size_t samples = options.samples;
+  const size_t seeds = (size_t)(samples*options.level_probability + 0.5);
+  if(n == 0 || samples < 2 || seeds < 1 || seeds >= samples){
+    return false;
+  }
+  const unsigned int threads = options.flight.threads;
+
+  /* the first level is plain Monte Carlo */
+  std::vector<SubsetSample> level(samples);
+  parallelFor(threads,samples,[&](size_t k){
+    std::seed_seq sequence{(unsigned long)options.seed,0ul,(unsigned long)k};
+    std::mt19937_64 generator(sequence);
+    std::normal_distribution<double> normal;
+    for(unsigned int d = 0; d < n; ++d){
+      level[k].z[d] = normal(generator);
+    }
+    level[k].margin = flyMargin(inputs,margin,options.flight,n,level[k].z);
+  });
+  out->flights = samples;
+  out->thresholds.clear();
+  out->acceptance.clear();
+
+  double probability = 1.0;
+  double variation = 0.0;
+  double spread = std::min(std::max(options.spread,0.01),1.0);
+  size_t level_chains = samples; /* the level is made of, one flight each at first */
+  for(unsigned int l = 0; ; ++l){
+    /* lowest margins first, ties broken by position so the order is fixed */
+    std::vector<std::pair<double,size_t> > order(level.size());
+    for(size_t k = 0; k < level.size(); ++k){
+      order[k] = std::make_pair(level[k].margin,k);
+    }
+    std::sort(order.begin(),order.end());
+    const double threshold = 0.5*(order[seeds - 1].first + order[seeds].first);
+
+    if(threshold <= 0.0 || l + 1 >= options.max_levels){
+      size_t failures = 0;
+      for(size_t k = 0; k < level.size(); ++k){
+        failures += level[k].margin <= 0.0 ? 1 : 0;
+      }
+      const double p = (double)failures/level.size();
+      probability *= p;
+      variation += levelVariation(level,level_chains,0.0,p);
+      out->thresholds.push_back(0.0);
+      out->levels = l + 1;
+      break;
+    }
+    /* ties at the threshold put more than the seeds under it */
+    const size_t under = std::upper_bound(order.begin(),order.end(),
+        std::make_pair(threshold,level.size())) - order.begin();
+    const double p = (double)under/level.size();
+    probability *= p;
+    variation += levelVariation(level,level_chains,threshold,p);
+    out->thresholds.push_back(threshold);
+
+    /* a chain from every flight under the threshold, so ties there do not
+     * leave the seeds leaning to the lowest margins. Every state of a chain
+     * is one flight of the next level, which is as big as the first
+     */
+    const size_t chains = under;
+    const double keep = sqrt(1.0 - spread*spread);
+    std::vector<SubsetSample> next(samples);
+    std::atomic<unsigned long> accepted(0);
+    parallelFor(threads,chains,[&](size_t c){
+      std::seed_seq sequence{(unsigned long)options.seed,(unsigned long)(l + 1),(unsigned long)c};
+      std::mt19937_64 generator(sequence);
+      std::normal_distribution<double> normal;
+      SubsetSample current = level[order[c].second];
+      const size_t begin = chainStart(samples,chains,c);
+      const size_t end = chainStart(samples,chains,c + 1);
+      next[begin] = current;
+      unsigned long kept = 0;
+      for(size_t s = begin + 1; s < end; ++s){
+        SubsetSample candidate;
+        for(unsigned int d = 0; d < n; ++d){
+          candidate.z[d] = keep*current.z[d] + spread*normal(generator);
+        }
+        candidate.margin = flyMargin(inputs,margin,options.flight,n,candidate.z);
+        if(candidate.margin <= threshold){
+          current = candidate;
+          ++kept;
+        }
+        next[s] = current;
+      }
+      accepted += kept;
+    });
+    const size_t steps = samples - chains;
+    out->flights += steps;
+    const double acceptance = steps > 0 ? (double)accepted/steps : 0.0;
+    out->acceptance.push_back(acceptance);
+    /* wider steps while too many are kept, narrower while too few */
+    spread = std::min(std::max(spread*exp(acceptance - SUBSET_TARGET_ACCEPTANCE),0.01),1.0);
+
+    level.swap(next);
+    level_chains = chains;
+  }
+
+  out->probability = probability;
+  out->variation = sqrt(variation);
+  out->seconds = secondsSince(start);
+  return true;
+}
@@ -0,0 +1,68 @@
+#ifndef RSIM_SUBSETSIMULATION_HPP
+#define RSIM_SUBSETSIMULATION_HPP
+/* the probability of a rare failure of the flight by subset simulation
+ *
+ * Plain Monte Carlo has to fly some hundred flights per failure it wants to
+ * see. Subset simulation reaches a rare failure through a ladder of
+ * commoner ones. The failure metric is a margin, and a flight fails when its
+ * margin is 0 or less. Each level flies the same number of flights. The
+ * level's threshold is the margin that the lowest fraction p0 of them fall
+ * under, so the next level is p0 as likely as this one. Those flights seed
+ * Markov chains that only step to flights under the threshold, and the
+ * chains fill the next level. Once a threshold reaches 0 the probability is
+ * the fraction under the threshold per level before it, p0 unless margins
+ * tie there, times the fraction of the last level that fails.
+ * A probability of 1e-4 then takes four levels of a thousand flights where
+ * Monte Carlo would want a million.
+ *
+ * The chains walk the uncertain inputs in standard normal space, one
+ * coordinate per varying input mapped through its own distribution. Each
+ * step is preconditioned Crank-Nicolson, which leaves the standard normal
+ * in place. So a step is kept whenever it stays under the threshold, and
+ * the chains stay correct however many inputs vary. The step's spread is
+ * tuned between levels to keep the acceptance reasonable.
+ *
+ * Every chain is a sequence of flights of its own, with its own random
+ * stream, and the chains of a level run on all threads at once. The answer
+ * does not depend on the thread count.
+ */
+
+#include <functional>
+#include <vector>
+
+#include "dispersion.hpp"
+
+/* the distance of a flight from failing, which it does at 0 or less */
+typedef std::function<double(const DispersionOutcome &outcome)> FailureMargin;
+
+struct SubsetOptions{
+  unsigned int samples; /* flights per level */
+  double level_probability; /* p0, the fraction of each level that seeds the next */
+  unsigned int max_levels; /* the last level is taken as it is */
+  double spread; /* first step size of the chains, 0 to 1 */
+  unsigned long seed;
+  DispersionOptions flight;
+
+  SubsetOptions();
+};
+
+struct SubsetResult{
+  double probability;
+  /* coefficient of variation of the probability from the chains'
+   * correlation, levels taken as independent so it is a lower bound
+   */
+  double variation;
+  unsigned int levels;
+  unsigned int flights;
+  std::vector<double> thresholds; /* margin of each level, the last is 0 */
+  std::vector<double> acceptance; /* of the chain steps on each level after the first */
+  double seconds;
+};
+
+/* false if nothing varies or the options leave fewer than two flights per
+ * level or no seeds
+ */
+bool subsetSimulation(const FlightDistributions &inputs, const FailureMargin &margin, const SubsetOptions &options,
+    SubsetResult *out);
+
+#endif
@@ -5,6 +5,8 @@
 //
 
 //
+// version 0.9.8: Add LoadObjFast, memory mapped and optionally multithreaded
+//                parsing with an open addressing vertex cache.
 // version 0.9.7: Support multi-materials(per-face material ID) per object/group.
 // version 0.9.6: Support Ni(index of refraction) mtl parameter.
 //                Parse transmittance material parameter correctly.
@@ -27,6 +29,13 @@
 #include <map>
 #include <fstream>
 #include <sstream>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "tiny_obj_loader.h"
 
@@ -721,5 +730,508 @@ std::string LoadObj(
   return err.str();
 }
 
+//
+// Streaming parse path. The file is memory mapped and split on line
+// boundaries into chunks that are tokenized independently (optionally on
+// separate threads). Relative indices and group/material switches are
+// resolved afterwards in file order, and vertices are deduplicated through an
+// open addressing hash instead of std::map.
+//
+
+// Raw face corner as written in the file. Negative (relative) indices are
+// resolved against the counts inside the chunk and marked so the chunk's
+// global offset can be added once all chunks are parsed.
+struct raw_index {
+  int v_idx, vt_idx, vn_idx;
+  unsigned char relative;  // bit 0: v, bit 1: vt, bit 2: vn
+};
+
+enum chunk_event_type {
+  EVENT_GROUP,
+  EVENT_OBJECT,
+  EVENT_USEMTL,
+  EVENT_MTLLIB
+};
+
+// Something that ends the current face group, in file order.
+struct chunk_event {
+  chunk_event_type type;
+  size_t face;  // number of faces of the chunk before the event
+  std::string name;
+};
+
+struct obj_chunk {
+  std::vector<float> v;
+  std::vector<float> vn;
+  std::vector<float> vt;
+  std::vector<raw_index> corners;
+  std::vector<unsigned int> face_start;  // first corner of each face
+  std::vector<chunk_event> events;
+};
+
+static const double pow10_table[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+  1e21, 1e22
+};
+
+// atof replacement for the plain decimal numbers found in OBJ files.
+// Handles sign, fraction and exponent, stops at the first other character.
+static inline float fastParseFloat(const char*& p, const char* end)
+{
+  while (p < end && isSpace(*p)) p++;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+
+  unsigned long long mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    if (digits < 18) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa != 0);
+    } else {
+      exponent++;
+    }
+    p++;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (digits < 18) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        exponent--;
+      }
+      p++;
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool exp_negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      exp_negative = (*p == '-');
+      p++;
+    }
+    int e = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (e < 10000) e = e * 10 + (*p - '0');
+      p++;
+    }
+    exponent += exp_negative ? -e : e;
+  }
+
+  // skip anything unexpected up to the next separator, as atof callers did
+  while (p < end && !isSpace(*p) && !isNewLine(*p)) p++;
+
+  double value = (double)mantissa;
+  if (exponent < 0) {
+    while (exponent < -22) {
+      value /= 1e22;
+      exponent += 22;
+    }
+    value /= pow10_table[-exponent];
+  } else {
+    while (exponent > 22) {
+      value *= 1e22;
+      exponent -= 22;
+    }
+    value *= pow10_table[exponent];
+  }
+  return (float)(negative ? -value : value);
+}
+
+static inline int fastParseInt(const char*& p, const char* end)
+{
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  int i = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    i = i * 10 + (*p - '0');
+    p++;
+  }
+  return negative ? -i : i;
+}
+
+// Same rules as fixIndex, relative indices are kept chunk local.
+static inline int fastFixIndex(int idx, int n, unsigned char bit, unsigned char& relative)
+{
+  if (idx > 0) return idx - 1;
+  if (idx == 0) return 0;
+  relative |= bit;
+  return n + idx;
+}
+
+static inline std::string parseName(const char* p, const char* end)
+{
+  while (p < end && isSpace(*p)) p++;
+  const char* e = p;
+  while (e < end && !isSpace(*e) && !isNewLine(*e)) e++;
+  return std::string(p, e);
+}
+
+static void parseChunk(const char* p, const char* end, obj_chunk& chunk)
+{
+  while (p < end) {
+    const char* eol = (const char*)memchr(p, '\n', end - p);
+    if (!eol) eol = end;
+    const char* line_end = eol;
+    if (line_end > p && line_end[-1] == '\r') line_end--;
+
+    const char* token = p;
+    p = eol + 1;
+    while (token < line_end && isSpace(*token)) token++;
+    if (token >= line_end || token[0] == '#') continue;
+
+    const size_t len = line_end - token;
+    if (token[0] == 'v' && len > 1 && isSpace(token[1])) {
+      token += 2;
+      chunk.v.push_back(fastParseFloat(token, line_end));
+      chunk.v.push_back(fastParseFloat(token, line_end));
+      chunk.v.push_back(fastParseFloat(token, line_end));
+    } else if (token[0] == 'v' && len > 2 && token[1] == 'n' && isSpace(token[2])) {
+      token += 3;
+      chunk.vn.push_back(fastParseFloat(token, line_end));
+      chunk.vn.push_back(fastParseFloat(token, line_end));
+      chunk.vn.push_back(fastParseFloat(token, line_end));
+    } else if (token[0] == 'v' && len > 2 && token[1] == 't' && isSpace(token[2])) {
+      token += 3;
+      chunk.vt.push_back(fastParseFloat(token, line_end));
+      chunk.vt.push_back(fastParseFloat(token, line_end));
+    } else if (token[0] == 'f' && len > 1 && isSpace(token[1])) {
+      token += 2;
+      const int vsize = chunk.v.size() / 3;
+      const int vnsize = chunk.vn.size() / 3;
+      const int vtsize = chunk.vt.size() / 2;
+      chunk.face_start.push_back(chunk.corners.size());
+      for (;;) {
+        while (token < line_end && isSpace(*token)) token++;
+        if (token >= line_end) break;
+
+        raw_index ri;
+        ri.vt_idx = -1;
+        ri.vn_idx = -1;
+        ri.relative = 0;
+        ri.v_idx = fastFixIndex(fastParseInt(token, line_end), vsize, 1, ri.relative);
+        if (token < line_end && *token == '/') {
+          token++;
+          if (token < line_end && *token != '/') {
+            ri.vt_idx = fastFixIndex(fastParseInt(token, line_end), vtsize, 2, ri.relative);
+          }
+          if (token < line_end && *token == '/') {
+            token++;
+            ri.vn_idx = fastFixIndex(fastParseInt(token, line_end), vnsize, 4, ri.relative);
+          }
+        }
+        // skip anything unexpected in the corner
+        while (token < line_end && !isSpace(*token)) token++;
+        chunk.corners.push_back(ri);
+      }
+    } else {
+      chunk_event event;
+      event.face = chunk.face_start.size();
+      if (len > 6 && 0 == strncmp(token, "usemtl", 6) && isSpace(token[6])) {
+        event.type = EVENT_USEMTL;
+        event.name = parseName(token + 7, line_end);
+      } else if (len > 6 && 0 == strncmp(token, "mtllib", 6) && isSpace(token[6])) {
+        event.type = EVENT_MTLLIB;
+        event.name = parseName(token + 7, line_end);
+      } else if (token[0] == 'g' && (len == 1 || isSpace(token[1]))) {
+        event.type = EVENT_GROUP;
+        event.name = len > 1 ? parseName(token + 2, line_end) : "";
+      } else if (token[0] == 'o' && len > 1 && isSpace(token[1])) {
+        event.type = EVENT_OBJECT;
+        event.name = parseName(token + 2, line_end);
+      } else {
+        continue;  // Ignore unknown command.
+      }
+      chunk.events.push_back(event);
+    }
+  }
+}
+
+// Open addressing (linear probing) map from face corner to output vertex.
+class VertexHash {
+ public:
+  VertexHash() : mask_(0), used_(0) {}
+
+  void clear() {
+    slots_.assign(slots_.size(), slot());
+    used_ = 0;
+  }
+
+  // Returns true and the stored index if present, otherwise inserts value.
+  bool findOrInsert(const vertex_index& key, unsigned int value, unsigned int& out) {
+    if ((used_ + 1) * 2 > slots_.size()) grow();
+    size_t i = hash(key) & mask_;
+    for (;;) {
+      slot& s = slots_[i];
+      if (!s.used) {
+        s.used = true;
+        s.key = key;
+        s.value = value;
+        used_++;
+        out = value;
+        return false;
+      }
+      if (s.key.v_idx == key.v_idx && s.key.vn_idx == key.vn_idx && s.key.vt_idx == key.vt_idx) {
+        out = s.value;
+        return true;
+      }
+      i = (i + 1) & mask_;
+    }
+  }
+
+ private:
+  struct slot {
+    vertex_index key;
+    unsigned int value;
+    bool used;
+    slot() : value(0), used(false) {}
+  };
+
+  std::vector<slot> slots_;
+  size_t mask_;
+  size_t used_;
+
+  static size_t hash(const vertex_index& k) {
+    // combine then finish with the murmur3 mixer so the low bits used for
+    // the slot depend on every input bit
+    unsigned long long h = (unsigned int)k.v_idx;
+    h = h * 0x9E3779B97F4A7C15ull + (unsigned int)k.vn_idx;
+    h = h * 0x9E3779B97F4A7C15ull + (unsigned int)k.vt_idx;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return (size_t)h;
+  }
+
+  void grow() {
+    std::vector<slot> old;
+    old.swap(slots_);
+    slots_.assign(old.empty() ? 1024 : old.size() * 2, slot());
+    mask_ = slots_.size() - 1;
+    used_ = 0;
+    for (size_t i = 0; i < old.size(); i++) {
+      if (old[i].used) {
+        unsigned int unused;
+        findOrInsert(old[i].key, old[i].value, unused);
+      }
+    }
+  }
+};
+
+// Builds shapes from faces in file order, the fast counterpart of
+// exportFaceGroupToShape/updateVertex.
+struct shape_builder {
+  std::vector<float> v, vn, vt;  // all chunks concatenated
+  VertexHash cache;
+  std::vector<unsigned int> resolved;
+  shape_t shape;
+  int material;
+  std::string name;
+  bool has_faces;
+
+  shape_builder() : material(-1), has_faces(false) {}
+
+  unsigned int vertex(const vertex_index& i) {
+    mesh_t& mesh = shape.mesh;
+    unsigned int idx;
+    if (cache.findOrInsert(i, mesh.positions.size() / 3, idx)) {
+      return idx;
+    }
+    assert(v.size() > (unsigned int)(3 * i.v_idx + 2));
+    mesh.positions.push_back(v[3 * i.v_idx + 0]);
+    mesh.positions.push_back(v[3 * i.v_idx + 1]);
+    mesh.positions.push_back(v[3 * i.v_idx + 2]);
+    if (i.vn_idx >= 0) {
+      mesh.normals.push_back(vn[3 * i.vn_idx + 0]);
+      mesh.normals.push_back(vn[3 * i.vn_idx + 1]);
+      mesh.normals.push_back(vn[3 * i.vn_idx + 2]);
+    }
+    if (i.vt_idx >= 0) {
+      mesh.texcoords.push_back(vt[2 * i.vt_idx + 0]);
+      mesh.texcoords.push_back(vt[2 * i.vt_idx + 1]);
+    }
+    return idx;
+  }
+
+  void face(const vertex_index* corners, size_t count) {
+    // look each corner up once, then fan
+    resolved.resize(count);
+    for (size_t k = 0; k < count; k++) {
+      resolved[k] = vertex(corners[k]);
+    }
+    // Polygon -> triangle fan conversion
+    for (size_t k = 2; k < count; k++) {
+      shape.mesh.indices.push_back(resolved[0]);
+      shape.mesh.indices.push_back(resolved[k - 1]);
+      shape.mesh.indices.push_back(resolved[k]);
+      shape.mesh.material_ids.push_back(material);
+    }
+    has_faces = true;
+  }
+
+  void flush(std::vector<shape_t>& shapes) {
+    if (has_faces) {
+      shape.name = name;
+      shapes.push_back(shape_t());
+      std::swap(shapes.back(), shape);
+    }
+    shape = shape_t();
+    cache.clear();
+    has_faces = false;
+  }
+};
+
+static void parseChunks(const char* data, size_t size, std::vector<obj_chunk>& chunks, int num_threads)
+{
+  // split on line boundaries, small files are not worth the threads
+  const size_t min_chunk = 1 << 20;
+  size_t n = num_threads > 1 ? (size_t)num_threads : 1;
+  if (size / n < min_chunk) n = size / min_chunk > 0 ? size / min_chunk : 1;
+
+  std::vector<const char*> bounds;
+  bounds.push_back(data);
+  for (size_t i = 1; i < n; i++) {
+    const char* p = data + size * i / n;
+    if (p < bounds.back()) p = bounds.back();
+    const char* nl = (const char*)memchr(p, '\n', data + size - p);
+    bounds.push_back(nl ? nl + 1 : data + size);
+  }
+  bounds.push_back(data + size);
+
+  chunks.resize(n);
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < n; i++) {
+    workers.push_back(std::thread(parseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i])));
+  }
+  parseChunk(bounds[0], bounds[1], chunks[0]);
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+std::string LoadObjFast(
+  std::vector<shape_t>& shapes,
+  std::vector<material_t>& materials,   // [output]
+  const char* filename,
+  const char* mtl_basepath,
+  int num_threads)
+{
+  shapes.clear();
+
+  std::stringstream err;
+
+  int fd = open(filename, O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0) {
+    if (fd >= 0) close(fd);
+    err << "Cannot open file [" << filename << "]" << std::endl;
+    return err.str();
+  }
+  if (info.st_size == 0) {
+    close(fd);
+    return err.str();
+  }
+  void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    err << "Cannot map file [" << filename << "]" << std::endl;
+    return err.str();
+  }
+  madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+
+  std::vector<obj_chunk> chunks;
+  parseChunks((const char*)mapping, info.st_size, chunks, num_threads);
+  munmap(mapping, info.st_size);
+
+  // concatenate attributes, remembering where each chunk starts
+  shape_builder builder;
+  std::vector<int> v_base(chunks.size()), vn_base(chunks.size()), vt_base(chunks.size());
+  for (size_t c = 0; c < chunks.size(); c++) {
+    v_base[c] = builder.v.size() / 3;
+    vn_base[c] = builder.vn.size() / 3;
+    vt_base[c] = builder.vt.size() / 2;
+    builder.v.insert(builder.v.end(), chunks[c].v.begin(), chunks[c].v.end());
+    builder.vn.insert(builder.vn.end(), chunks[c].vn.begin(), chunks[c].vn.end());
+    builder.vt.insert(builder.vt.end(), chunks[c].vt.begin(), chunks[c].vt.end());
+    std::vector<float>().swap(chunks[c].v);
+    std::vector<float>().swap(chunks[c].vn);
+    std::vector<float>().swap(chunks[c].vt);
+  }
+
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
+  }
+  MaterialFileReader matFileReader(basePath);
+  std::map<std::string, int> material_map;
+
+  std::vector<vertex_index> face;
+  for (size_t c = 0; c < chunks.size(); c++) {
+    obj_chunk& chunk = chunks[c];
+    size_t next_event = 0;
+    const size_t face_count = chunk.face_start.size();
+    for (size_t f = 0; f <= face_count; f++) {
+      // apply the switches that came before this face
+      while (next_event < chunk.events.size() && chunk.events[next_event].face == f) {
+        const chunk_event& event = chunk.events[next_event++];
+        switch (event.type) {
+          case EVENT_GROUP:
+          case EVENT_OBJECT:
+            builder.flush(shapes);
+            builder.name = event.name;
+            break;
+          case EVENT_USEMTL:
+            // LoadObj flattens every material's faces on their own, so no
+            // vertex is shared across a usemtl
+            builder.cache.clear();
+            if (material_map.find(event.name) != material_map.end()) {
+              builder.material = material_map[event.name];
+            } else {
+              builder.material = -1;
+            }
+            break;
+          case EVENT_MTLLIB: {
+            std::string err_mtl = matFileReader(event.name, materials, material_map);
+            if (!err_mtl.empty()) {
+              return err_mtl;
+            }
+            break;
+          }
+        }
+      }
+      if (f == face_count) break;
+
+      const size_t begin = chunk.face_start[f];
+      const size_t end = f + 1 < face_count ? chunk.face_start[f + 1] : chunk.corners.size();
+      face.clear();
+      for (size_t k = begin; k < end; k++) {
+        const raw_index& ri = chunk.corners[k];
+        vertex_index vi(ri.v_idx, ri.vt_idx, ri.vn_idx);
+        if (ri.relative & 1) vi.v_idx += v_base[c];
+        if (ri.relative & 2) vi.vt_idx += vt_base[c];
+        if (ri.relative & 4) vi.vn_idx += vn_base[c];
+        face.push_back(vi);
+      }
+      builder.face(face.data(), face.size());
+    }
+    std::vector<raw_index>().swap(chunk.corners);
+  }
+  builder.flush(shapes);
+
+  return err.str();
+}
+
 
 }
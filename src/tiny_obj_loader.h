@@ -87,6 +87,18 @@ std::string LoadObj(
     const char* filename,
     const char* mtl_basepath = NULL);
 
+/// Loads .obj from a file through a memory mapping instead of a stream.
+/// Produces the same shapes as LoadObj, but parses floats by hand, dedups
+/// vertices with a hash table and splits the file on line boundaries across
+/// 'num_threads' threads when it is large enough.
+/// Returns empty string when loading .obj success.
+std::string LoadObjFast(
+    std::vector<shape_t>& shapes,   // [output]
+    std::vector<material_t>& materials,   // [output]
+    const char* filename,
+    const char* mtl_basepath = NULL,
+    int num_threads = 1);
+
 /// Loads object from a std::istream, uses GetMtlIStreamFn to retrieve
 /// std::istream for materials.
 /// Returns empty string when loading .obj success.
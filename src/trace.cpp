@@ -0,0 +1,149 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Trace{
+  std::atomic<bool> enabled(false);
+
+  /* events kept per thread, a power of two */
+  static const uint64_t RING_SIZE = 1 << 16;
+
+  /* fields are relaxed atomics, writeTrace may read a slot while the owning
+   * thread overwrites it
+   */
+  struct Event{
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> timestamp; /* nanoseconds since start() */
+    std::atomic<char> phase; /* 'B', 'E' or 'i' as in the trace-event format */
+  };
+
+  /* a copy of an event taken by writeTrace */
+  struct EventCopy{
+    const char *name;
+    uint64_t timestamp;
+    char phase;
+  };
+
+  /* single producer ring, the owning thread publishes with head. Writing the
+   * slot of event head overwrites event head - RING_SIZE
+   */
+  struct Ring{
+    Event events[RING_SIZE];
+    std::atomic<uint64_t> head;
+    unsigned int tid;
+  };
+
+  struct State{
+    std::mutex mutex; /* only taken when a thread first records */
+    std::vector<Ring*> rings;
+    std::string path;
+    std::chrono::steady_clock::time_point epoch;
+  };
+
+  static State &state(){
+    static State instance;
+    return instance;
+  }
+
+  /* rings are never freed so they can still be dumped after their thread ends */
+  static Ring *threadRing(){
+    static thread_local Ring *ring = NULL;
+    if(ring == NULL){
+      ring = new Ring;
+      ring->head.store(0,std::memory_order_relaxed);
+      State &s = state();
+      std::lock_guard<std::mutex> lock(s.mutex);
+      ring->tid = s.rings.size() + 1;
+      s.rings.push_back(ring);
+    }
+    return ring;
+  }
+
+  static void push(const char *name, char phase){
+    Ring *ring = threadRing();
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    Event &event = ring->events[head & (RING_SIZE - 1)];
+    /* a reader that sees any of the stores below also sees head, so it knows
+     * which event they overwrite
+     */
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name,std::memory_order_relaxed);
+    event.timestamp.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - state().epoch).count(),std::memory_order_relaxed);
+    event.phase.store(phase,std::memory_order_relaxed);
+    ring->head.store(head + 1,std::memory_order_release);
+  }
+
+  void begin(const char *name){
+    push(name,'B');
+  }
+
+  void end(const char *name){
+    push(name,'E');
+  }
+
+  void instant(const char *name){
+    push(name,'i');
+  }
+
+  static void writeTrace(){
+    enabled.store(false,std::memory_order_relaxed);
+    State &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    FILE *file = fopen(s.path.c_str(),"w");
+    if(file == NULL){
+      fprintf(stderr,"trace: could not write %s\n",s.path.c_str());
+      return;
+    }
+    fprintf(file,"{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    bool first = true;
+    std::vector<EventCopy> events;
+    for(size_t r = 0; r < s.rings.size(); ++r){
+      const Ring *ring = s.rings[r];
+      /* threads may still be recording, copy what is there and then drop
+       * whatever they overwrote while it was being copied
+       */
+      const uint64_t head = ring->head.load(std::memory_order_acquire);
+      const uint64_t oldest = head > RING_SIZE ? head - RING_SIZE : 0;
+      events.resize(head - oldest);
+      for(uint64_t i = oldest; i < head; ++i){
+        const Event &event = ring->events[i & (RING_SIZE - 1)];
+        EventCopy &copy = events[i - oldest];
+        copy.name = event.name.load(std::memory_order_relaxed);
+        copy.timestamp = event.timestamp.load(std::memory_order_relaxed);
+        copy.phase = event.phase.load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t later = ring->head.load(std::memory_order_relaxed);
+      const uint64_t kept = later >= RING_SIZE && later - RING_SIZE + 1 > oldest ? later - RING_SIZE + 1 : oldest;
+      for(uint64_t i = kept; i < head; ++i){
+        const EventCopy &event = events[i - oldest];
+        fprintf(file,"%s\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u%s}",
+          first ? "" : ",",event.name,event.phase,event.timestamp*1e-3,ring->tid,
+          event.phase == 'i' ? ", \"s\": \"p\"" : "");
+        first = false;
+      }
+    }
+    fprintf(file,"\n]}\n");
+    fclose(file);
+  }
+
+  void start(const char *path){
+    State &s = state();
+    {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      s.path = path;
+      s.epoch = std::chrono::steady_clock::now();
+    }
+    if(!enabled.load(std::memory_order_relaxed)){
+      atexit(writeTrace);
+    }
+    enabled.store(true,std::memory_order_relaxed);
+  }
+}
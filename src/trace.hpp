@@ -0,0 +1,58 @@
+#ifndef RSIM_TRACE_HPP
+#define RSIM_TRACE_HPP
+/* optional timeline tracer writing chrome trace-event JSON (chrome://tracing,
+ * ui.perfetto.dev)
+ *
+ * RSIM_TRACE_SCOPE("name") records a begin event now and an end event when
+ * the block ends, RSIM_TRACE_INSTANT("name") marks a single point in time.
+ * Events go into a fixed size ring buffer per thread that only that thread
+ * writes, so recording takes no locks. The newest events are kept when a
+ * buffer wraps. Until Trace::start() is called every macro costs one
+ * predictable branch on a relaxed load of Trace::enabled.
+ */
+#include <atomic>
+#include <stdint.h>
+
+namespace Trace{
+  extern std::atomic<bool> enabled;
+
+  /* start recording and write all buffers to path when the process exits */
+  void start(const char *path);
+
+  void begin(const char *name);
+  void end(const char *name);
+  void instant(const char *name);
+
+  class Scope{
+  public:
+    Scope(const char *name):
+      name(enabled.load(std::memory_order_relaxed) ? name : 0){
+        if(this->name){
+          begin(this->name);
+        }
+      }
+
+    ~Scope(){
+      if(this->name){
+        end(this->name);
+      }
+    }
+
+  private:
+    const char *name; /* null when tracing was off on entry */
+  };
+}
+
+#define RSIM_TRACE_JOIN2(a,b) a##b
+#define RSIM_TRACE_JOIN(a,b) RSIM_TRACE_JOIN2(a,b)
+
+#define RSIM_TRACE_SCOPE(name) Trace::Scope RSIM_TRACE_JOIN(rsim_trace_scope_,__LINE__)(name)
+
+#define RSIM_TRACE_INSTANT(name) \
+  do{ \
+    if(Trace::enabled.load(std::memory_order_relaxed)){ \
+      Trace::instant(name); \
+    } \
+  }while(0)
+
+#endif
@@ -0,0 +1,325 @@
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rocket.hpp"
+
+/* file layout: header followed by packed TrajectoryRecords */
+struct TrajectoryHeader{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+static const char TRAJECTORY_MAGIC[8] = {'R','S','I','M','T','R','J','\0'};
+static const uint32_t TRAJECTORY_VERSION = 1;
+
+static bool compare_record_time(double time, const TrajectoryRecord &record){
+  return time < record.time;
+}
+
+/* the 12 channels a record is simplified on */
+static double channel(const TrajectoryRecord &record, unsigned int i){
+  return i < 3 ? record.position[i] : record.rotation[i-3];
+}
+
+TrajectorySimplifier::TrajectorySimplifier(double position_tolerance, double rotation_tolerance):
+  has_anchor(false),
+  has_last(false){
+    for(unsigned int i = 0; i < CHANNELS; ++i){
+      this->tolerance[i] = i < 3 ? position_tolerance : rotation_tolerance;
+    }
+  }
+
+void TrajectorySimplifier::restart(const TrajectoryRecord &record){
+  this->anchor = record;
+  this->has_anchor = true;
+  this->has_last = false;
+  for(unsigned int i = 0; i < CHANNELS; ++i){
+    this->slope_low[i] = -HUGE_VAL;
+    this->slope_high[i] = HUGE_VAL;
+  }
+}
+
+unsigned int TrajectorySimplifier::add(const TrajectoryRecord &record, TrajectoryRecord out[2]){
+  if(!this->has_anchor){
+    this->restart(record);
+    out[0] = record;
+    return 1;
+  }
+
+  const TrajectoryRecord &previous = this->has_last ? this->last : this->anchor;
+  if(record.stage != previous.stage){
+    /* keep the last record of the old stage and the first of the new */
+    unsigned int count = 0;
+    if(this->has_last){
+      out[count++] = this->last;
+    }
+    out[count++] = record;
+    this->restart(record);
+    return count;
+  }
+
+  const double dt = record.time - this->anchor.time;
+  if(!this->has_last){
+    if(dt > 0.0){
+      this->last = record;
+      this->has_last = true;
+    }
+    return 0;
+  }
+
+  /* skipping last as well, the line to record must pass within tolerance of it */
+  const double last_dt = this->last.time - this->anchor.time;
+  double low[CHANNELS];
+  double high[CHANNELS];
+  bool fits = dt > last_dt;
+  for(unsigned int i = 0; i < CHANNELS && fits; ++i){
+    const double start = channel(this->anchor,i);
+    const double value = channel(this->last,i);
+    const double next = channel(record,i);
+    if(std::isnan(start) && std::isnan(value) && std::isnan(next)){
+      /* a channel that is nan throughout replays as nan either way */
+      low[i] = this->slope_low[i];
+      high[i] = this->slope_high[i];
+      continue;
+    }
+    low[i] = fmax(this->slope_low[i],(value - this->tolerance[i] - start)/last_dt);
+    high[i] = fmin(this->slope_high[i],(value + this->tolerance[i] - start)/last_dt);
+    const double slope = (next - start)/dt;
+    fits = low[i] <= slope && slope <= high[i];
+  }
+
+  if(fits){
+    memcpy(this->slope_low,low,sizeof(low));
+    memcpy(this->slope_high,high,sizeof(high));
+    this->last = record;
+    return 0;
+  }
+
+  /* last is as far as a straight line reaches, keep it and start from there */
+  out[0] = this->last;
+  this->restart(this->last);
+  this->last = record;
+  this->has_last = true;
+  return 1;
+}
+
+bool TrajectorySimplifier::flush(TrajectoryRecord *out){
+  if(!this->has_last){
+    return false;
+  }
+  *out = this->last;
+  this->restart(this->last);
+  return true;
+}
+
+TrajectoryWriter::TrajectoryWriter(const char *filename):
+  file(fopen(filename,"wb")),
+  simplifier(NULL),
+  seen(0),
+  written(0){
+    if(this->file == NULL){
+      std::cerr << "Error opening trajectory file for writing: " << filename << std::endl;
+      return;
+    }
+    TrajectoryHeader header;
+    memcpy(header.magic,TRAJECTORY_MAGIC,sizeof(header.magic));
+    header.version = TRAJECTORY_VERSION;
+    header.record_size = sizeof(TrajectoryRecord);
+    fwrite(&header,sizeof(header),1,this->file);
+  }
+
+TrajectoryWriter::~TrajectoryWriter(){
+  this->flush();
+  if(this->file != NULL){
+    fclose(this->file);
+  }
+  delete this->simplifier;
+}
+
+bool TrajectoryWriter::isOpen() const {
+  return this->file != NULL;
+}
+
+void TrajectoryWriter::simplify(double position_tolerance, double rotation_tolerance){
+  this->flush();
+  delete this->simplifier;
+  this->simplifier = new TrajectorySimplifier(position_tolerance,rotation_tolerance);
+}
+
+void TrajectoryWriter::put(const TrajectoryRecord &record){
+  if(this->file != NULL){
+    fwrite(&record,sizeof(record),1,this->file);
+    ++this->written;
+  }
+}
+
+void TrajectoryWriter::write(const TrajectoryRecord &record){
+  ++this->seen;
+  if(this->simplifier == NULL){
+    this->put(record);
+    return;
+  }
+  TrajectoryRecord kept[2];
+  const unsigned int count = this->simplifier->add(record,kept);
+  for(unsigned int i = 0; i < count; ++i){
+    this->put(kept[i]);
+  }
+}
+
+void TrajectoryWriter::flush(){
+  TrajectoryRecord record;
+  if(this->simplifier != NULL && this->simplifier->flush(&record)){
+    this->put(record);
+  }
+  if(this->file != NULL){
+    fflush(this->file);
+  }
+}
+
+size_t TrajectoryWriter::recordsSeen() const {
+  return this->seen;
+}
+
+size_t TrajectoryWriter::recordsWritten() const {
+  return this->written;
+}
+
+void TrajectoryWriter::write(Rocket &rocket){
+  TrajectoryRecord record;
+  gsl_vector const *state = rocket.getState();
+  record.time = rocket.getTime();
+  memcpy(record.position,&state->data[0],3*sizeof(double));
+  memcpy(record.rotation,&state->data[3],9*sizeof(double));
+  record.stage = rocket.getStageProgress();
+  record.reserved = 0;
+  this->write(record);
+}
+
+Trajectory::Trajectory(const char *filename):
+  mapping(NULL),
+  mapping_size(0),
+  records(NULL),
+  count(0){
+    const int fd = open(filename,O_RDONLY);
+    if(fd < 0){
+      std::cerr << "Error opening trajectory file: " << filename << std::endl;
+      return;
+    }
+
+    struct stat info;
+    if(fstat(fd,&info) != 0 || (size_t)info.st_size < sizeof(TrajectoryHeader)){
+      std::cerr << "Trajectory file is too small: " << filename << std::endl;
+      close(fd);
+      return;
+    }
+
+    void *data = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd); /* the mapping stays valid after closing */
+    if(data == MAP_FAILED){
+      std::cerr << "Error mapping trajectory file: " << filename << std::endl;
+      return;
+    }
+
+    const TrajectoryHeader *header = (const TrajectoryHeader *) data;
+    if(memcmp(header->magic,TRAJECTORY_MAGIC,sizeof(header->magic)) != 0
+        || header->version != TRAJECTORY_VERSION
+        || header->record_size != sizeof(TrajectoryRecord)){
+      std::cerr << "Not a trajectory file or wrong version: " << filename << std::endl;
+      munmap(data,info.st_size);
+      return;
+    }
+
+    this->mapping = data;
+    this->mapping_size = info.st_size;
+    this->records = (const TrajectoryRecord *)((const char *) data + sizeof(TrajectoryHeader));
+    /* a partially written last record is ignored */
+    this->count = (info.st_size - sizeof(TrajectoryHeader))/sizeof(TrajectoryRecord);
+
+    /* replay reads forwards and backwards, let the kernel read ahead */
+    madvise(data,info.st_size,MADV_WILLNEED);
+  }
+
+Trajectory::~Trajectory(){
+  if(this->mapping != NULL){
+    munmap(this->mapping,this->mapping_size);
+  }
+}
+
+bool Trajectory::isOpen() const {
+  return this->count > 0;
+}
+
+size_t Trajectory::size() const {
+  return this->count;
+}
+
+const TrajectoryRecord &Trajectory::operator[](size_t i) const {
+  return this->records[i];
+}
+
+double Trajectory::startTime() const {
+  return this->records[0].time;
+}
+
+double Trajectory::endTime() const {
+  return this->records[this->count-1].time;
+}
+
+size_t Trajectory::seek(double time) const {
+  const TrajectoryRecord *end = this->records + this->count;
+  const TrajectoryRecord *after = std::upper_bound(this->records,end,time,compare_record_time);
+  if(after == this->records){
+    return 0;
+  }
+  return (after - this->records) - 1;
+}
+
+void Trajectory::sample(double time, TrajectoryRecord *out) const {
+  const size_t i = this->seek(time);
+  const TrajectoryRecord &a = this->records[i];
+  if(i + 1 >= this->count || time <= a.time){
+    *out = a;
+    return;
+  }
+  const TrajectoryRecord &b = this->records[i+1];
+  const double alpha = (time - a.time)/(b.time - a.time);
+
+  out->time = time;
+  out->stage = a.stage;
+  out->reserved = 0;
+  for(unsigned int k = 0; k < 3; ++k){
+    out->position[k] = a.position[k] + alpha*(b.position[k] - a.position[k]);
+  }
+  for(unsigned int k = 0; k < 9; ++k){
+    out->rotation[k] = a.rotation[k] + alpha*(b.rotation[k] - a.rotation[k]);
+  }
+
+  /* blended rotation is not orthonormal, fix up rows with gram-schmidt */
+  double *r = out->rotation;
+  for(unsigned int row = 0; row < 3; ++row){
+    double *v = &r[row*3];
+    for(unsigned int prev = 0; prev < row; ++prev){
+      const double *u = &r[prev*3];
+      const double d = v[0]*u[0] + v[1]*u[1] + v[2]*u[2];
+      v[0] -= d*u[0];
+      v[1] -= d*u[1];
+      v[2] -= d*u[2];
+    }
+    const double norm = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    if(norm > 0.0){
+      v[0] /= norm;
+      v[1] /= norm;
+      v[2] /= norm;
+    }
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef RSIM_TRAJECTORY_HPP
+#define RSIM_TRAJECTORY_HPP
+/* recorded flight trajectories, written by a live simulation and memory
+ * mapped again for replay without re-simulating
+ */
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+
+class Rocket;
+
+/* one sample of a flight, stored as is in the trajectory file */
+struct TrajectoryRecord{
+  double time;
+  double position[3];
+  double rotation[9];
+  uint32_t stage;
+  uint32_t reserved; /* keeps records 8 byte aligned */
+};
+
+/* online simplification of a stream of records
+ * A record is only kept when the straight line from the last kept record to
+ * the newest one would miss a skipped record by more than the tolerance in
+ * some channel, so replaying by linear interpolation (as Trajectory::sample
+ * does) stays within the tolerance at every skipped sample. For each channel
+ * the slopes that keep all skipped records within tolerance form an interval
+ * that only narrows as records arrive (a swing door), so a record costs O(1)
+ * and only the newest one is held back. Both sides of a stage change are
+ * always kept.
+ */
+class TrajectorySimplifier{
+public:
+  /* metres for the position, matrix entries (about radians) for the rotation */
+  TrajectorySimplifier(double position_tolerance, double rotation_tolerance);
+
+  /* feed the next record, the records to keep now are placed in out and
+   * their number (0 to 2) returned
+   */
+  unsigned int add(const TrajectoryRecord &record, TrajectoryRecord out[2]);
+
+  /* keep the record held back, if there is one */
+  bool flush(TrajectoryRecord *out);
+
+private:
+  static const unsigned int CHANNELS = 12;
+
+  double tolerance[CHANNELS];
+  double slope_low[CHANNELS];
+  double slope_high[CHANNELS];
+  TrajectoryRecord anchor; /* last record kept */
+  TrajectoryRecord last; /* newest record, not kept yet */
+  bool has_anchor;
+  bool has_last;
+
+  void restart(const TrajectoryRecord &record);
+};
+
+/* appends records to a trajectory file
+ * the record count is not stored, readers derive it from the file size so
+ * a run that exits mid flight still leaves a usable file
+ */
+class TrajectoryWriter{
+public:
+  TrajectoryWriter(const char *filename);
+  ~TrajectoryWriter();
+
+  bool isOpen() const;
+
+  /* only keep the records needed to replay within these tolerances, see
+   * TrajectorySimplifier
+   */
+  void simplify(double position_tolerance, double rotation_tolerance);
+
+  void write(const TrajectoryRecord &record);
+
+  /* record the current state of a rocket */
+  void write(Rocket &rocket);
+
+  /* write out a record held back by the simplifier and flush the file, call
+   * before exiting without the destructor
+   */
+  void flush();
+
+  size_t recordsSeen() const;
+
+  size_t recordsWritten() const;
+
+private:
+  FILE *file;
+  TrajectorySimplifier *simplifier;
+  size_t seen;
+  size_t written;
+
+  void put(const TrajectoryRecord &record);
+
+  TrajectoryWriter(const TrajectoryWriter&);
+  TrajectoryWriter &operator=(const TrajectoryWriter&);
+};
+
+/* read only view of a trajectory file mapped into memory */
+class Trajectory{
+public:
+  Trajectory(const char *filename);
+  ~Trajectory();
+
+  bool isOpen() const;
+
+  size_t size() const;
+
+  const TrajectoryRecord &operator[](size_t i) const;
+
+  double startTime() const;
+
+  double endTime() const;
+
+  /* index of the last record at or before time, binary search on time */
+  size_t seek(double time) const;
+
+  /* interpolate the flight at time between the surrounding records,
+   * times outside the recording are clamped to the first/last record
+   */
+  void sample(double time, TrajectoryRecord *out) const;
+
+private:
+  void *mapping;
+  size_t mapping_size;
+  const TrajectoryRecord *records;
+  size_t count;
+
+  /* no copies of the mapping */
+  Trajectory(const Trajectory&);
+  Trajectory &operator=(const Trajectory&);
+};
+
+#endif
@@ -6,6 +6,8 @@ const char* VPOSITION = "vPosition";
 const char* VNORMAL = "vNormal";
 
 VertexArrayObject::VertexArrayObject(){
+  this->vertex_buffer = 0;
+  this->index_buffer = 0;
   this->translation = glm::vec3(0,0,0);
   this->scale = glm::vec3(1,1,1);
 }
@@ -25,9 +27,8 @@ VertexArrayObject loadMeshIntoBuffer(MeshData& data, GLuint program) {
     size_t index_buffer_size = data.index_count*sizeof(IndexT);
 
     // generate vertex buffer
-    GLuint vertex_buffer;
-    glGenBuffers(1, &vertex_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glGenBuffers(1, &vao.vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vao.vertex_buffer);
     glBufferData(GL_ARRAY_BUFFER, position_buffer_size+normal_buffer_size, NULL, GL_STATIC_DRAW);
     glBufferSubData(GL_ARRAY_BUFFER, 0, position_buffer_size, data.vertices);
     glBufferSubData(GL_ARRAY_BUFFER, position_buffer_size, normal_buffer_size, data.normals);
@@ -46,13 +47,67 @@ VertexArrayObject loadMeshIntoBuffer(MeshData& data, GLuint program) {
     glEnableVertexAttribArray(vNormal);
 
     //  indices
+    glGenBuffers(1, &vao.index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao.index_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_buffer_size
+        , data.indices, GL_STATIC_DRAW);
+
+    // done
+    return vao;
+}
+
+GLuint loadIndexBuffer(const IndexT* indices, SizeT index_count) {
     GLuint index_buffer;
     glGenBuffers(1, &index_buffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_buffer_size
-        , data.indices, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count*sizeof(IndexT)
+        , indices, GL_STATIC_DRAW);
+    return index_buffer;
+}
+
+VertexArrayObject loadMeshIntoBuffer(const InterleavedVertex* vertices, SizeT vertex_count
+    , GLuint index_buffer, SizeT index_count, GLuint program) {
+    // generate vertex array
+    VertexArrayObject vao;
+    vao.program = program;
+    vao.index_count = index_count;
+    glGenVertexArrays(1, &vao.id);
+    glBindVertexArray(vao.id);
+
+    // one buffer of position/normal pairs
+    glGenBuffers(1, &vao.vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vao.vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertex_count*sizeof(InterleavedVertex)
+        , vertices, GL_STATIC_DRAW);
+
+    // link up to program
+    glUseProgram(program);
+
+    // vertex position
+    GLint vPosition = glGetAttribLocation(program, VPOSITION);
+    glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, sizeof(InterleavedVertex)
+        , (void*)offsetof(InterleavedVertex, position));
+    glEnableVertexAttribArray(vPosition);
+
+    // vertex normal
+    GLint vNormal= glGetAttribLocation(program, VNORMAL);
+    glVertexAttribPointer(vNormal, 3, GL_FLOAT, GL_FALSE, sizeof(InterleavedVertex)
+        , (void*)offsetof(InterleavedVertex, normal));
+    glEnableVertexAttribArray(vNormal);
+
+    //  indices, owned by the caller
+    vao.index_buffer = index_buffer;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
 
     // done
     return vao;
 }
+
+void releaseMeshBuffer(VertexArrayObject& vao) {
+    glDeleteVertexArrays(1, &vao.id);
+    glDeleteBuffers(1, &vao.vertex_buffer);
+    vao.id = 0;
+    vao.vertex_buffer = 0;
+    vao.index_count = 0;
+}
 } // namespace RSimView
@@ -13,6 +13,8 @@ public:
     GLuint program;
     GLsizei index_count;
     GLuint id; // vao index
+    GLuint vertex_buffer;
+    GLuint index_buffer;
     glm::vec3 translation;
     glm::vec3 scale;
 
@@ -21,6 +23,16 @@ public:
 
 VertexArrayObject loadMeshIntoBuffer(MeshData& data, GLuint program);
 
+/// upload indices that several meshes draw with
+GLuint loadIndexBuffer(const IndexT* indices, SizeT index_count);
+
+/// upload interleaved position/normal vertices drawn with a shared index buffer
+VertexArrayObject loadMeshIntoBuffer(const InterleavedVertex* vertices, SizeT vertex_count
+    , GLuint index_buffer, SizeT index_count, GLuint program);
+
+/// free the vertex array and vertex buffer, the index buffer is left to its owner
+void releaseMeshBuffer(VertexArrayObject& vao);
+
 } // namespace RSimView
 
 
@@ -0,0 +1,153 @@
+#include "vehicle.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+/* the heights of the stages below each one, once the tables are filled */
+static void stackStages(Vehicle *vehicle){
+  vehicle->base[0] = 0.0;
+  for(unsigned int s = 0; s < vehicle->stages; ++s){
+    vehicle->base[s+1] = vehicle->base[s] + vehicle->height[s];
+  }
+}
+
+static Vehicle makeFalcon9(){
+  Vehicle vehicle;
+  memset(&vehicle,0,sizeof(vehicle));
+  vehicle.stages = 2;
+  vehicle.radius = 3.66/2;
+  /* payload of launch from video (dragon spacecraft) */
+  vehicle.payload_mass = 6000;
+  vehicle.payload_height = 6.1;
+
+  /* nine merlin 1d, the fuel is the 507500kg total less the second stage's */
+  vehicle.height[0] = 47;
+  vehicle.mass_empty[0] = 22200;
+  vehicle.mass_fuel[0] = 507500 - 108185;
+  vehicle.mass_flow[0] = -273.6*9;
+  vehicle.isp_sea_level[0] = 281.8;
+  vehicle.isp_vacuum[0] = 307.4;
+
+  /* one merlin vacuum */
+  vehicle.height[1] = 12.6;
+  vehicle.mass_empty[1] = 4000;
+  vehicle.mass_fuel[1] = 108185;
+  vehicle.mass_flow[1] = -273.6;
+  vehicle.isp_sea_level[1] = 348.0;
+  vehicle.isp_vacuum[1] = 348.0;
+
+  stackStages(&vehicle);
+  return vehicle;
+}
+
+const Vehicle &falcon9(){
+  static const Vehicle vehicle = makeFalcon9();
+  return vehicle;
+}
+
+/* the numbers on the rest of a line, at most most of them, -1 if any are
+ * negative or not numbers or if there are too many
+ */
+static int readValues(std::istringstream &line, double values[], unsigned int most){
+  std::string word;
+  unsigned int count = 0;
+  while(line >> word){
+    char *end;
+    const double value = strtod(word.c_str(),&end);
+    if(count == most || *end != '\0' || !(value >= 0.0)){
+      return -1;
+    }
+    values[count++] = value;
+  }
+  return count;
+}
+
+bool loadVehicle(const char *path, Vehicle *vehicle, std::string &error){
+  std::ifstream file(path);
+  if(!file){
+    error = std::string("could not open '") + path + "'";
+    return false;
+  }
+
+  Vehicle loaded;
+  memset(&loaded,0,sizeof(loaded));
+  int stage = -1; /* the stage settings go to, -1 for the vehicle itself */
+  std::string text;
+  for(unsigned int number = 1; std::getline(file,text); ++number){
+    const size_t comment = text.find('#');
+    if(comment != std::string::npos){
+      text.erase(comment);
+    }
+    std::istringstream line(text);
+    std::string key;
+    if(!(line >> key)){
+      continue;
+    }
+
+    std::ostringstream where;
+    where << path << ":" << number << ": ";
+    double values[2] = {0.0,0.0};
+    const int count = readValues(line,values,2);
+    bool valid;
+    if(key == "stage"){
+      if(loaded.stages == VEHICLE_MAX_STAGES){
+        where << "more than " << VEHICLE_MAX_STAGES << " stages";
+        error = where.str();
+        return false;
+      }
+      stage = loaded.stages++;
+      valid = count == 0;
+    }else if(key == "radius" && stage < 0){
+      valid = count == 1;
+      loaded.radius = values[0];
+    }else if(key == "payload" && stage < 0){
+      valid = count == 2;
+      loaded.payload_mass = values[0];
+      loaded.payload_height = values[1];
+    }else if(key == "height" && stage >= 0){
+      valid = count == 1;
+      loaded.height[stage] = values[0];
+    }else if(key == "empty" && stage >= 0){
+      valid = count == 1;
+      loaded.mass_empty[stage] = values[0];
+    }else if(key == "fuel" && stage >= 0){
+      valid = count == 1;
+      loaded.mass_fuel[stage] = values[0];
+    }else if(key == "engines" && stage >= 0){
+      valid = count == 2;
+      loaded.mass_flow[stage] = -values[0]*values[1];
+    }else if(key == "isp" && stage >= 0){
+      /* one value for an engine that does not care about the air */
+      valid = count == 1 || count == 2;
+      loaded.isp_sea_level[stage] = values[0];
+      loaded.isp_vacuum[stage] = values[count == 2 ? 1 : 0];
+    }else{
+      where << "'" << key << "' is not a " << (stage < 0 ? "vehicle" : "stage") << " setting";
+      error = where.str();
+      return false;
+    }
+    if(!valid){
+      where << "bad values for '" << key << "'";
+      error = where.str();
+      return false;
+    }
+  }
+
+  if(loaded.stages == 0 || !(loaded.radius > 0.0) || !(loaded.payload_mass > 0.0)){
+    error = std::string(path) + ": needs a radius, a payload and at least one stage";
+    return false;
+  }
+  for(unsigned int s = 0; s < loaded.stages; ++s){
+    if(!(loaded.height[s] > 0.0) || !(loaded.mass_empty[s] > 0.0) || !(loaded.mass_flow[s] < 0.0) || !(loaded.isp_sea_level[s] > 0.0)){
+      std::ostringstream message;
+      message << path << ": stage " << s + 1 << " needs a height, an empty mass, engines and an isp";
+      error = message.str();
+      return false;
+    }
+  }
+  stackStages(&loaded);
+  *vehicle = loaded;
+  return true;
+}
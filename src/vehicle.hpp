@@ -0,0 +1,55 @@
+#ifndef RSIM_VEHICLE_HPP
+#define RSIM_VEHICLE_HPP
+/* launch vehicles described by data instead of code
+ *
+ * A vehicle is a stack of stages, the first at the bottom, with the payload
+ * on top. Every stage is a cylinder of the vehicle's radius with its own
+ * engines and specific impulse curve. A vehicle file is parsed once into the
+ * flat per stage tables below, so the flight only ever indexes them by stage.
+ *
+ * The file is one setting per line, '#' starts a comment:
+ *
+ *   radius <m>
+ *   payload <kg> <m>                 mass and height
+ *   stage                            starts the next stage up
+ *   height <m>
+ *   empty <kg>                       dry mass
+ *   fuel <kg>                        fuel burned before the stage drops
+ *   engines <count> <kg/s>           fuel flow of each engine
+ *   isp <s> [<s>]                    sea level and vacuum, one for constant
+ *
+ * Settings before the first 'stage' belong to the vehicle, after it to the
+ * last stage started.
+ */
+
+#include <string>
+
+static const unsigned int VEHICLE_MAX_STAGES = 8;
+
+struct Vehicle{
+  unsigned int stages;
+  double radius;
+  double payload_mass;
+  double payload_height;
+
+  /* per stage, the first stage at 0 */
+  double height[VEHICLE_MAX_STAGES];
+  double mass_empty[VEHICLE_MAX_STAGES];
+  double mass_fuel[VEHICLE_MAX_STAGES];
+  double mass_flow[VEHICLE_MAX_STAGES]; /* kg/s of all engines, negative */
+  double isp_sea_level[VEHICLE_MAX_STAGES];
+  double isp_vacuum[VEHICLE_MAX_STAGES]; /* from the karman line up */
+
+  /* derived when the tables are filled: height of the bottom of each stage
+   * above the bottom of the first, and of the payload at stages
+   */
+  double base[VEHICLE_MAX_STAGES + 1];
+};
+
+/* the falcon 9 the simulation was written for */
+const Vehicle &falcon9();
+
+/* fill vehicle from a file, false with error set if it can not be used */
+bool loadVehicle(const char *path, Vehicle *vehicle, std::string &error);
+
+#endif